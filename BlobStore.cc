@@ -0,0 +1,229 @@
+#include <cstring>
+#include "BlobStore.h"
+#include "utils.h"
+
+LsmValue BlobIndex::encode() const {
+    LsmValue value(BLOB_INDEX_SIZE, '\0');
+    memcpy(&value[0], &fileNumber, sizeof(fileNumber));
+    memcpy(&value[8], &offset, sizeof(offset));
+    memcpy(&value[12], &size, sizeof(size));
+    return value;
+}
+
+BlobIndex BlobIndex::decode(string_view value) {
+    if (value.size() != BLOB_INDEX_SIZE) {
+        cerr << "Corrupted blob index." << endl;
+        exit(-1);
+    }
+    BlobIndex index;
+    memcpy(&index.fileNumber, value.data(), sizeof(index.fileNumber));
+    memcpy(&index.offset, value.data() + 8, sizeof(index.offset));
+    memcpy(&index.size, value.data() + 12, sizeof(index.size));
+    return index;
+}
+
+
+/**
+ * @param writeOptions: How the file is written.
+ */
+BlobFileBuilder::BlobFileBuilder(uint64_t fileNumber, string filename, const FileWriteOptions& writeOptions)
+        : fileNumber(fileNumber), filename(std::move(filename)), writeOptions(writeOptions), fileSize(0) {}
+
+/**
+ * Append a value to the file, creating the file first if it is the first value.
+ * @return Where the value is written.
+ */
+BlobIndex BlobFileBuilder::add(LsmKey key, string_view value) {
+    if (!out)
+        out = make_unique<FileWriter>(filename, writeOptions);
+
+    uint32_t size = value.size();
+    out->append(&key, sizeof(key));
+    out->append(&size, sizeof(size));
+    out->append(value);
+
+    BlobIndex index(fileNumber, fileSize + BLOB_RECORD_HEADER_SIZE, size);
+    fileSize += BLOB_RECORD_HEADER_SIZE + size;
+    return index;
+}
+
+/**
+ * Close the file.
+ * @return The size of the file, or 0 if no value was added and no file created.
+ */
+uint32_t BlobFileBuilder::finish() {
+    if (out) {
+        out->close();
+        out.reset();
+    }
+    return fileSize;
+}
+
+uint64_t BlobFileBuilder::getFileNumber() const {
+    return fileNumber;
+}
+
+uint32_t BlobFileBuilder::getFileSize() const {
+    return fileSize;
+}
+
+
+/**
+ * @param dataDir: The directory of the store, ending with a slash.
+ */
+BlobStore::BlobStore(const string& dataDir) : dirname(dataDir + "blobs/"), nextFileNumber(1) {}
+
+const string& BlobStore::getDirname() const {
+    return dirname;
+}
+
+string BlobStore::getFilename(uint64_t fileNumber) const {
+    return getDirname() + to_string(fileNumber) + ".blob";
+}
+
+/**
+ * Find the blob files on the disk. No byte of them is live until the SSTs
+ * pointing at them are retained.
+ */
+void BlobStore::readFilesFromDisk() {
+    if (!utils::dirExists(dirname))
+        return;
+
+    vector<string> filenames;
+    utils::scanDir(dirname, filenames);
+    for (const auto& filename : filenames) {
+        if (FileWriter::isTemporaryFile(filename)) {
+            utils::rmfile((dirname + filename).c_str());    // Left by a write that did not finish.
+            continue;
+        }
+        uint64_t fileNumber = stoull(filename);
+        ifstream file(dirname + filename, ios::in | ios::binary | ios::ate);
+        if (!file) {
+            cerr << "Cannot open file `" << dirname + filename << "`." << endl;
+            exit(-1);
+        }
+        files[fileNumber] = BlobFile{(uint64_t)file.tellg(), 0};
+        nextFileNumber = max(nextFileNumber, fileNumber + 1);
+    }
+}
+
+/**
+ * @return A builder of a blob file with a new number. Pass it to `addFile`
+ * once finished.
+ */
+BlobFileBuilder BlobStore::newFile(const FileWriteOptions& writeOptions) {
+    utils::mkdir(getDirname().c_str());
+    uint64_t fileNumber = nextFileNumber++;
+    return BlobFileBuilder(fileNumber, getFilename(fileNumber), writeOptions);
+}
+
+/**
+ * Take a finished blob file, all of whose bytes are live.
+ */
+void BlobStore::addFile(const BlobFileBuilder& builder) {
+    if (builder.getFileSize() == 0)
+        return;
+    files[builder.getFileNumber()] = BlobFile{builder.getFileSize(), builder.getFileSize()};
+}
+
+/**
+ * Count the value as live, since an SST entry now points at it.
+ */
+void BlobStore::retain(const BlobIndex& index) {
+    auto it = files.find(index.fileNumber);
+    if (it != files.end())
+        it->second.liveBytes += BLOB_RECORD_HEADER_SIZE + index.size;
+}
+
+/**
+ * Count the value as garbage, since an SST entry pointing at it is discarded.
+ */
+void BlobStore::release(const BlobIndex& index) {
+    auto it = files.find(index.fileNumber);
+    if (it != files.end())
+        it->second.liveBytes -= min(it->second.liveBytes, (uint64_t)BLOB_RECORD_HEADER_SIZE + index.size);
+}
+
+/**
+ * Map the file on its first read.
+ */
+const shared_ptr<const MappedFile>& BlobStore::getMappedFile(uint64_t fileNumber) const {
+    shared_ptr<const MappedFile>& mappedFile = mappedFiles[fileNumber];
+    if (!mappedFile)
+        mappedFile = MappedFile::open(getFilename(fileNumber));
+    return mappedFile;
+}
+
+/**
+ * @return The value, pointing into the mapping of its blob file.
+ */
+string_view BlobStore::getValueView(const BlobIndex& index) const {
+    const shared_ptr<const MappedFile>& mappedFile = getMappedFile(index.fileNumber);
+    if ((uint64_t)index.offset + index.size > mappedFile->getSize()) {
+        cerr << "Corrupted blob file `" << getFilename(index.fileNumber) << "`." << endl;
+        exit(-1);
+    }
+    return string_view(mappedFile->getData() + index.offset, index.size);
+}
+
+void BlobStore::get(const BlobIndex& index, LsmValue& value) const {
+    value.assign(getValueView(index));
+}
+
+/**
+ * Pin the value in the mapping of its blob file, which stays readable after
+ * the file is collected.
+ */
+void BlobStore::get(const BlobIndex& index, PinnableValue& value) const {
+    value.pin(getMappedFile(index.fileNumber), getValueView(index));
+}
+
+/**
+ * @return The numbers of the files still pointed at whose live bytes are
+ * below `liveRatio` of their size.
+ */
+vector<uint64_t> BlobStore::getFilesToCollect(double liveRatio) const {
+    vector<uint64_t> fileNumbers;
+    for (const auto& file : files)
+        if (file.second.liveBytes > 0 && file.second.liveBytes < liveRatio * file.second.fileSize)
+            fileNumbers.push_back(file.first);
+    return fileNumbers;
+}
+
+/**
+ * Remove the files no SST points at from the disk.
+ * @return The number of files removed.
+ */
+size_t BlobStore::removeUnreferencedFiles() {
+    size_t removedNumber = 0;
+    for (auto it = files.begin(); it != files.end(); ) {
+        if (it->second.liveBytes > 0) {
+            ++it;
+            continue;
+        }
+        string filename = getFilename(it->first);
+        if (utils::rmfile(filename.c_str()) < 0) {
+            cerr << "Fail to remove file `" << filename << "`." << endl;
+            exit(-1);
+        }
+        mappedFiles.erase(it->first);
+        it = files.erase(it);
+        removedNumber++;
+    }
+    return removedNumber;
+}
+
+/**
+ * Remove every blob file and the directory holding them.
+ */
+void BlobStore::clear() {
+    for (const auto& file : files)
+        utils::rmfile(getFilename(file.first).c_str());
+    utils::rmdir(getDirname().c_str());
+    files.clear();
+    mappedFiles.clear();
+}
+
+bool BlobStore::empty() const {
+    return files.empty();
+}
@@ -0,0 +1,104 @@
+#ifndef LSM_TREE_BLOBSTORE_H
+#define LSM_TREE_BLOBSTORE_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "MappedFile.h"
+#include "PinnableValue.h"
+#include "FileIO.h"
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * Where a value moved out of its SST lies. The SST stores the index,
+ * encoded in BLOB_INDEX_SIZE bytes, as the value of a TYPE_BLOB_INDEX entry.
+ */
+struct BlobIndex {
+    uint64_t fileNumber;
+    uint32_t offset;    // Of the value, after its record header.
+    uint32_t size;
+
+    BlobIndex() {}
+    BlobIndex(uint64_t fileNumber, uint32_t offset, uint32_t size)
+            : fileNumber(fileNumber), offset(offset), size(size) {}
+
+    LsmValue encode() const;
+    static BlobIndex decode(string_view value);
+};
+
+/**
+ * Append values to a new blob file. Each value follows a record header of
+ * its key and size, so that a blob file can be read without the SSTs. The
+ * file is only created by the first value added.
+ */
+class BlobFileBuilder {
+
+private:
+    uint64_t fileNumber;
+    string filename;
+    FileWriteOptions writeOptions;
+    unique_ptr<FileWriter> out;
+    uint32_t fileSize;
+
+public:
+    BlobFileBuilder(uint64_t fileNumber, string filename,
+                    const FileWriteOptions& writeOptions = FileWriteOptions());
+
+    BlobIndex add(LsmKey key, string_view value);
+    uint32_t finish();
+    uint64_t getFileNumber() const;
+    uint32_t getFileSize() const;
+};
+
+/**
+ * The blob files of a store. Keeps how many bytes of every file the SSTs
+ * still point at, so that files made mostly of garbage can be found and
+ * rewritten. Blob files are immutable once built, and are read through
+ * their mappings like SSTs.
+ */
+class BlobStore {
+
+    struct BlobFile {
+        uint64_t fileSize;
+        uint64_t liveBytes;     // Values and record headers some SST entry points at.
+    };
+
+private:
+    const string dirname;
+    map<uint64_t, BlobFile> files;
+    uint64_t nextFileNumber;
+    mutable unordered_map<uint64_t, shared_ptr<const MappedFile>> mappedFiles;
+
+    const shared_ptr<const MappedFile>& getMappedFile(uint64_t fileNumber) const;
+
+public:
+    explicit BlobStore(const string& dataDir);
+
+    const string& getDirname() const;
+    string getFilename(uint64_t fileNumber) const;
+
+    void readFilesFromDisk();
+    BlobFileBuilder newFile(const FileWriteOptions& writeOptions = FileWriteOptions());
+    void addFile(const BlobFileBuilder& builder);
+    void retain(const BlobIndex& index);
+    void release(const BlobIndex& index);
+
+    string_view getValueView(const BlobIndex& index) const;
+    void get(const BlobIndex& index, LsmValue& value) const;
+    void get(const BlobIndex& index, PinnableValue& value) const;
+
+    vector<uint64_t> getFilesToCollect(double liveRatio) const;
+    size_t removeUnreferencedFiles();
+    void clear();
+    bool empty() const;
+};
+
+
+#endif //LSM_TREE_BLOBSTORE_H
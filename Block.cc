@@ -0,0 +1,44 @@
+#include "Block.h"
+#include "Checksum.h"
+
+bool BlockHandle::isCompressed() const {
+    return size != rawSize;
+}
+
+/**
+ * @param dataStart: Where the first value goes in the file.
+ */
+BlockBuilder::BlockBuilder(CompressionType compression, uint32_t dataStart)
+        : compression(compression), dataStart(dataStart), offset(dataStart) {}
+
+void BlockBuilder::add(string_view value) {
+    if (!block.empty() && block.size() + value.size() > BLOCK_SIZE)
+        writeBlock();
+    block.append(value);
+    offset += value.size();
+}
+
+void BlockBuilder::writeBlock() {
+    uint32_t rawSize = block.size();
+    const string& stored = Compression::compress(compression, block, compressedBlock) ? compressedBlock : block;
+    handles.emplace_back(offset - rawSize, dataStart + data.size(), stored.size(), rawSize,
+                         Checksum::crc32c(stored));
+    data.append(stored);
+    block.clear();
+}
+
+/**
+ * Add the last block and the handles of the blocks.
+ * @return Everything to write into the file from `dataStart` to the end.
+ */
+const string& BlockBuilder::finish() {
+    if (!block.empty())
+        writeBlock();
+    for (const auto& handle : handles)
+        data.append((const char*)&handle, BLOCK_HANDLE_SIZE);
+    return data;
+}
+
+const vector<BlockHandle>& BlockBuilder::getHandles() const {
+    return handles;
+}
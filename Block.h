@@ -0,0 +1,59 @@
+#ifndef LSM_TREE_BLOCK_H
+#define LSM_TREE_BLOCK_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Compression.h"
+#include "constants.h"
+
+using namespace std;
+
+// Where a block of values lies. The handles of the blocks follow the blocks
+// at the end of an SST.
+struct BlockHandle {
+    uint32_t offset;        // Of the first value, counted like DataIndex::offset.
+    uint32_t fileOffset;
+    uint32_t size;          // Bytes stored. Equal to `rawSize` if the block is not compressed.
+    uint32_t rawSize;
+    uint32_t checksum;      // CRC32C of the bytes stored.
+
+    BlockHandle() {}
+    BlockHandle(uint32_t offset, uint32_t fileOffset, uint32_t size, uint32_t rawSize, uint32_t checksum)
+            : offset(offset), fileOffset(fileOffset), size(size), rawSize(rawSize), checksum(checksum) {}
+
+    bool isCompressed() const;
+};
+
+/**
+ * Lay out the values of an SST in memory, in the order of their data
+ * indexes, so that the file can be written in one pass once the number of
+ * blocks is known. The values are cut into blocks of about BLOCK_SIZE bytes,
+ * which never split a value, so that each block can be checked on its own
+ * when read, and every block that the codec makes smaller is stored
+ * compressed.
+ */
+class BlockBuilder {
+
+private:
+    const CompressionType compression;
+    const uint32_t dataStart;
+    uint32_t offset;        // Of the next value, counted like DataIndex::offset.
+    string data;            // Blocks done, then their handles.
+    string block;
+    string compressedBlock;
+    vector<BlockHandle> handles;
+
+    void writeBlock();
+
+public:
+    BlockBuilder(CompressionType compression, uint32_t dataStart);
+
+    void add(string_view value);
+    const string& finish();
+    const vector<BlockHandle>& getHandles() const;
+};
+
+
+#endif //LSM_TREE_BLOCK_H
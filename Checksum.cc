@@ -0,0 +1,85 @@
+#include <cstring>
+#include "Checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC32C
+#endif
+
+#define CRC32C_POLYNOMIAL 0x82f63b78    // Reversed.
+
+namespace {
+
+struct Crc32cTable {
+    uint32_t entries[256];
+
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+            entries[i] = crc;
+        }
+    }
+};
+
+const Crc32cTable table;
+
+}
+
+/**
+ * @return true if the CPU computes CRC32C itself.
+ */
+bool Checksum::isHardwareAccelerated() {
+#ifdef HAVE_SSE42_CRC32C
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @param crc: The checksum of the bytes before `data`, to extend it.
+ */
+uint32_t Checksum::crc32c(const void* data, size_t size, uint32_t crc) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (isHardwareAccelerated())
+        return ~crc32cHardware(~crc, p, size);
+    return ~crc32cSoftware(~crc, p, size);
+}
+
+uint32_t Checksum::crc32c(string_view data, uint32_t crc) {
+    return crc32c(data.data(), data.size(), crc);
+}
+
+uint32_t Checksum::crc32cSoftware(uint32_t crc, const unsigned char* p, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+        crc = table.entries[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef HAVE_SSE42_CRC32C
+/**
+ * Eight bytes per instruction, then the bytes left one by one.
+ */
+__attribute__((target("sse4.2")))
+uint32_t Checksum::crc32cHardware(uint32_t crc, const unsigned char* p, size_t size) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = crc64;
+#endif
+    for (; size > 0; --size, ++p)
+        crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+#else
+uint32_t Checksum::crc32cHardware(uint32_t crc, const unsigned char* p, size_t size) {
+    return crc32cSoftware(crc, p, size);
+}
+#endif
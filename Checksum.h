@@ -0,0 +1,27 @@
+#ifndef LSM_TREE_CHECKSUM_H
+#define LSM_TREE_CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * CRC32C (Castagnoli) of the blocks and metadata of SSTs, computed with the
+ * SSE4.2 instruction where the CPU has it, and with a table otherwise.
+ */
+class Checksum {
+
+private:
+    static uint32_t crc32cSoftware(uint32_t crc, const unsigned char* p, size_t size);
+    static uint32_t crc32cHardware(uint32_t crc, const unsigned char* p, size_t size);
+
+public:
+    static bool isHardwareAccelerated();
+    static uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0);
+    static uint32_t crc32c(string_view data, uint32_t crc = 0);
+};
+
+
+#endif //LSM_TREE_CHECKSUM_H
@@ -0,0 +1,282 @@
+#include <fstream>
+#include <cctype>
+#include "ColumnFamilyStore.h"
+
+void ColumnFamilyWriteBatch::put(ColumnFamily family, LsmKey key, const LsmValue& value) {
+    batches[family].put(key, value);
+}
+
+void ColumnFamilyWriteBatch::del(ColumnFamily family, LsmKey key) {
+    batches[family].del(key);
+}
+
+void ColumnFamilyWriteBatch::merge(ColumnFamily family, LsmKey key, const LsmValue& operand) {
+    batches[family].merge(key, operand);
+}
+
+void ColumnFamilyWriteBatch::clear() {
+    batches.clear();
+}
+
+bool ColumnFamilyWriteBatch::empty() const {
+    return batches.empty();
+}
+
+const map<ColumnFamily, WriteBatch>& ColumnFamilyWriteBatch::getBatches() const {
+    return batches;
+}
+
+
+/**
+ * Open or create the column families, numbered in the order given. Every
+ * family the store already has must be given.
+ * @param rateLimiter: Given to the families whose options set none, so
+ * that their flushes and compactions write within one budget.
+ */
+ColumnFamilyStore::ColumnFamilyStore(const std::string &dir, const vector<pair<string, Options>>& columnFamilies,
+                                     shared_ptr<RateLimiter> rateLimiter)
+        : dataDir(dir.empty() || dir.back() == '/' ? dir : dir + "/"), rateLimiter(std::move(rateLimiter))
+{
+    if (!utils::dirExists(dataDir))
+        utils::mkdir(dataDir.c_str());
+
+    for (const auto& columnFamily : columnFamilies)
+        openColumnFamily(columnFamily.first, columnFamily.second);
+
+    ifstream in(getListFilename());
+    string name;
+    while (in >> name) {
+        bool opened = false;
+        for (const auto& family : families)
+            opened = opened || family->name == name;
+        if (!opened) {
+            cerr << "Column family `" << name << "` of store `" << dataDir << "` is not opened." << endl;
+            exit(-1);
+        }
+    }
+    in.close();
+    writeList();
+}
+
+string ColumnFamilyStore::getListFilename() const {
+    return dataDir + "column-families.list";
+}
+
+/**
+ * Record the names of the families, so that none is left out when the
+ * store is opened again.
+ */
+void ColumnFamilyStore::writeList() const {
+    string filename = getListFilename();
+    ofstream out(filename);
+    for (const auto& family : families)
+        out << family->name << endl;
+    if (!out) {
+        cerr << "Cannot write file `" << filename << "`." << endl;
+        exit(-1);
+    }
+}
+
+/**
+ * Open the family from its directory, creating it if it does not exist.
+ * Names are made of letters, digits, '_' and '-'. Called with the list
+ * locked, or by the constructor.
+ */
+ColumnFamily ColumnFamilyStore::openColumnFamily(const string& name, const Options& options) {
+    bool valid = !name.empty();
+    for (char c : name)
+        valid = valid && (isalnum((unsigned char)c) || c == '_' || c == '-');
+    if (!valid) {
+        cerr << "Invalid column family name `" << name << "`." << endl;
+        exit(-1);
+    }
+    for (const auto& family : families) {
+        if (family->name == name) {
+            cerr << "Column family `" << name << "` already exists." << endl;
+            exit(-1);
+        }
+    }
+
+    Options familyOptions = options;
+    if (!familyOptions.rateLimiter)
+        familyOptions.rateLimiter = rateLimiter;
+    families.push_back(make_unique<Family>());
+    families.back()->name = name;
+    families.back()->store = make_unique<KVStore>(dataDir + name, familyOptions);
+    return families.size() - 1;
+}
+
+/**
+ * Add a family to the open store.
+ */
+ColumnFamily ColumnFamilyStore::createColumnFamily(const std::string &name, const Options& options) {
+    lock_guard<mutex> lock(familiesMutex);
+    ColumnFamily family = openColumnFamily(name, options);
+    writeList();
+    return family;
+}
+
+ColumnFamily ColumnFamilyStore::getColumnFamily(const std::string &name) const {
+    lock_guard<mutex> lock(familiesMutex);
+    for (size_t i = 0; i < families.size(); ++i)
+        if (families[i]->name == name)
+            return i;
+    cerr << "No column family `" << name << "`." << endl;
+    exit(-1);
+}
+
+size_t ColumnFamilyStore::getColumnFamilyNumber() const {
+    lock_guard<mutex> lock(familiesMutex);
+    return families.size();
+}
+
+ColumnFamilyStore::Family& ColumnFamilyStore::getFamily(ColumnFamily family) const {
+    lock_guard<mutex> lock(familiesMutex);
+    if (family >= families.size()) {
+        cerr << "No column family " << family << "." << endl;
+        exit(-1);
+    }
+    return *families[family];
+}
+
+/**
+ * @return Every family, in the order of their numbers.
+ */
+vector<ColumnFamilyStore::Family*> ColumnFamilyStore::getFamilies() const {
+    lock_guard<mutex> lock(familiesMutex);
+    vector<Family*> allFamilies;
+    for (const auto& family : families)
+        allFamilies.push_back(family.get());
+    return allFamilies;
+}
+
+/**
+ * Lock the families a write goes to, in the order of their numbers like
+ * every thread taking several. If the write would make any of them flush
+ * its part of a batch written across families alone, lock every family
+ * instead and flush the parts together first.
+ * @param writes: Families in the order of their numbers, each with the
+ * bytes the entries written into it take in an SST.
+ * @return The locks, to hold while the write is applied.
+ */
+vector<unique_lock<mutex>> ColumnFamilyStore::lockForWrite(const vector<pair<ColumnFamily, uint64_t>>& writes) {
+    vector<unique_lock<mutex>> locks;
+    for (const auto& write : writes)
+        locks.emplace_back(getFamily(write.first).storeMutex);
+    if (!needsBatchFlush(writes))
+        return locks;
+
+    locks.clear();
+    vector<Family*> allFamilies = getFamilies();
+    for (Family* family : allFamilies)
+        locks.emplace_back(family->storeMutex);
+    if (needsBatchFlush(writes))
+        flushBatchParts(allFamilies);
+    return locks;
+}
+
+/**
+ * @return true if a write would make a family flush its part of a batch
+ * written across families alone.
+ */
+bool ColumnFamilyStore::needsBatchFlush(const vector<pair<ColumnFamily, uint64_t>>& writes) const {
+    for (const auto& write : writes) {
+        Family& family = getFamily(write.first);
+        if (family.holdsBatchPart && family.store->needsFlush(write.second))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Flush every family holding part of a batch written across families.
+ * @param lockedFamilies: Every family, all locked.
+ */
+void ColumnFamilyStore::flushBatchParts(const vector<Family*>& lockedFamilies) {
+    for (Family* family : lockedFamilies) {
+        if (!family->holdsBatchPart)
+            continue;
+        family->store->flush();
+        family->holdsBatchPart = false;
+    }
+}
+
+void ColumnFamilyStore::put(ColumnFamily family, uint64_t key, const std::string &s)
+{
+    auto locks = lockForWrite({{family, DATA_INDEX_SIZE + s.size()}});
+    getFamily(family).store->put(key, s);
+}
+
+std::string ColumnFamilyStore::get(ColumnFamily family, uint64_t key)
+{
+    Family& readFamily = getFamily(family);
+    lock_guard<mutex> lock(readFamily.storeMutex);
+    return readFamily.store->get(key);
+}
+
+bool ColumnFamilyStore::del(ColumnFamily family, uint64_t key)
+{
+    auto locks = lockForWrite({{family, DATA_INDEX_SIZE}});
+    return getFamily(family).store->del(key);
+}
+
+void ColumnFamilyStore::merge(ColumnFamily family, uint64_t key, const std::string &operand)
+{
+    auto locks = lockForWrite({{family, DATA_INDEX_SIZE + operand.size()}});
+    getFamily(family).store->merge(key, operand);
+}
+
+/**
+ * Apply the part of the batch of each family atomically, all under the
+ * locks of the families, so that readers see none or all of the batch.
+ */
+void ColumnFamilyStore::write(const ColumnFamilyWriteBatch &batch)
+{
+    const map<ColumnFamily, WriteBatch>& batches = batch.getBatches();
+    vector<pair<ColumnFamily, uint64_t>> writes;
+    for (const auto& part : batches)
+        writes.emplace_back(part.first, part.second.getByteSize());
+    auto locks = lockForWrite(writes);
+    for (const auto& part : batches)
+        getFamily(part.first).store->write(part.second);
+
+    if (batches.size() > 1)
+        for (const auto& part : batches)
+            getFamily(part.first).holdsBatchPart = true;
+}
+
+void ColumnFamilyStore::reset()
+{
+    vector<Family*> allFamilies = getFamilies();
+    vector<unique_lock<mutex>> locks;
+    for (Family* family : allFamilies)
+        locks.emplace_back(family->storeMutex);
+    for (Family* family : allFamilies) {
+        family->store->reset();
+        family->holdsBatchPart = false;
+    }
+}
+
+void ColumnFamilyStore::deleteRange(ColumnFamily family, uint64_t start, uint64_t end)
+{
+    Family& writeFamily = getFamily(family);
+    lock_guard<mutex> lock(writeFamily.storeMutex);
+    writeFamily.store->deleteRange(start, end);
+}
+
+void ColumnFamilyStore::scan(ColumnFamily family, uint64_t start, uint64_t end,
+                             std::list<std::pair<uint64_t, std::string>> &list)
+{
+    Family& readFamily = getFamily(family);
+    lock_guard<mutex> lock(readFamily.storeMutex);
+    readFamily.store->scan(start, end, list);
+}
+
+/**
+ * @return A copy of the counters of the family.
+ */
+Statistics ColumnFamilyStore::getStatistics(ColumnFamily family) {
+    Family& readFamily = getFamily(family);
+    lock_guard<mutex> lock(readFamily.storeMutex);
+    return readFamily.store->getStatistics();
+}
@@ -0,0 +1,95 @@
+#ifndef LSM_TREE_COLUMNFAMILYSTORE_H
+#define LSM_TREE_COLUMNFAMILYSTORE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <mutex>
+#include "kvstore.h"
+
+using namespace std;
+
+typedef size_t ColumnFamily;    // Numbered in the order the families were created.
+
+/**
+ * Writes to one or more column families, applied by `ColumnFamilyStore::write`
+ * at once.
+ */
+class ColumnFamilyWriteBatch {
+
+private:
+    map<ColumnFamily, WriteBatch> batches;
+
+public:
+    void put(ColumnFamily family, LsmKey key, const LsmValue& value);
+    void del(ColumnFamily family, LsmKey key);
+    void merge(ColumnFamily family, LsmKey key, const LsmValue& operand);
+    void clear();
+
+    bool empty() const;
+    const map<ColumnFamily, WriteBatch>& getBatches() const;
+};
+
+/**
+ * Named keyspaces in one store, each a KVStore of its own in `dir/<name>`,
+ * with its own memTable, levels and options. Each family has a lock of its
+ * own, so that threads using different families flush and compact in
+ * parallel. The families may share a rate limiter bounding the bytes their
+ * flushes and compactions write together.
+ *
+ * A batch across families holds the locks of all of them while it is
+ * applied, so readers see it whole. The families holding its parts are
+ * flushed together, before a write makes any of them flush alone. Still,
+ * like any write, a batch is lost by a crash before it is flushed, and a
+ * crash between the flushes of its families may leave part of it on the disk.
+ */
+class ColumnFamilyStore {
+
+    struct Family {
+        string name;
+        unique_ptr<KVStore> store;
+        bool holdsBatchPart = false;    // memTable holds part of a batch written across families.
+        mutex storeMutex;
+    };
+
+private:
+    const string dataDir;       // Ends with a slash.
+    const shared_ptr<RateLimiter> rateLimiter;
+    vector<unique_ptr<Family>> families;    // Only appended to, so a family outlives the lock on the list.
+    mutable mutex familiesMutex;            // Guards the list, not the families in it.
+
+    string getListFilename() const;
+    void writeList() const;
+    ColumnFamily openColumnFamily(const string& name, const Options& options);
+    Family& getFamily(ColumnFamily family) const;
+    vector<Family*> getFamilies() const;
+    vector<unique_lock<mutex>> lockForWrite(const vector<pair<ColumnFamily, uint64_t>>& writes);
+    bool needsBatchFlush(const vector<pair<ColumnFamily, uint64_t>>& writes) const;
+    static void flushBatchParts(const vector<Family*>& lockedFamilies);
+
+public:
+    ColumnFamilyStore(const std::string &dir, const vector<pair<string, Options>>& columnFamilies,
+                      shared_ptr<RateLimiter> rateLimiter = nullptr);
+
+    ColumnFamily createColumnFamily(const std::string &name, const Options& options = Options());
+    ColumnFamily getColumnFamily(const std::string &name) const;
+    size_t getColumnFamilyNumber() const;
+
+    void put(ColumnFamily family, uint64_t key, const std::string &s);
+    std::string get(ColumnFamily family, uint64_t key);
+    bool del(ColumnFamily family, uint64_t key);
+    void merge(ColumnFamily family, uint64_t key, const std::string &operand);
+    void write(const ColumnFamilyWriteBatch &batch);
+    void reset();
+
+    void deleteRange(ColumnFamily family, uint64_t start, uint64_t end);
+    void scan(ColumnFamily family, uint64_t start, uint64_t end,
+              std::list<std::pair<uint64_t, std::string>> &list);
+
+    Statistics getStatistics(ColumnFamily family);
+};
+
+
+#endif //LSM_TREE_COLUMNFAMILYSTORE_H
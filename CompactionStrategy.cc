@@ -0,0 +1,395 @@
+#include "CompactionStrategy.h"
+
+shared_ptr<CompactionStrategy> CompactionStrategy::create(const Options& options) {
+    switch (options.compactionStyle) {
+        case TIERED_COMPACTION:
+            return make_shared<TieredCompaction>();
+        case LAZY_LEVELED_COMPACTION:
+            return make_shared<LazyLeveledCompaction>();
+        default:
+            return make_shared<LeveledCompaction>(options);
+    }
+}
+
+/**
+ * @return Roughly how many bytes compactions have to write before no level
+ * overflows. By default, the size of L0 once it has to be compacted.
+ */
+uint64_t CompactionStrategy::estimatePendingBytes(const Levels& levels, const vector<SubLevel>& L0SubLevels) const {
+    if (L0SubLevels.size() < L0_SUBLEVEL_TRIGGER && levels.at(0)->size() <= L0_MAX_SST_NUMBER)
+        return 0;
+    uint64_t bytes = 0;
+    for (const auto& sst : *levels.at(0))
+        bytes += sst->getFileSize();
+    return bytes;
+}
+
+LeveledCompaction::LeveledCompaction(const Options& options)
+        : levelBaseBytes(options.levelBaseBytes),
+          levelSizeMultiplier(max(options.levelSizeMultiplier, 2u)),
+          dynamicLevelBytes(options.dynamicLevelBytes),
+          picker(options.compactionPicker),
+          tombstoneCompactionRatio(options.tombstoneCompactionRatio) {}
+
+bool LeveledCompaction::pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                                       CompactionTask& task) {
+
+    // Compact the level that exceeds its target the most.
+    vector<double> scores = getLevelScores(levels, L0SubLevels);
+    size_t level = max_element(scores.begin(), scores.end()) - scores.begin();
+    if (scores[level] < 1 || (level > 0 && scores[level] == 1))
+        return pickTombstoneCompaction(levels, task);
+
+    if (level == 0) {
+        task.kind = COMPACT_L0;
+        task.level = 0;
+        task.SSTs = *levels.at(0);
+        return true;
+    }
+
+    const vector<SSTPtr>& levelSSTs = *levels.at(level);
+    uint64_t targetBytes = getLevelTargets(levels)[level];
+    task.kind = PUSH_DOWN;
+    task.level = level;
+    task.SSTs = getCompactSSTs(levels, level, getLevelBytes(levelSSTs) - targetBytes);
+    return true;
+}
+
+/**
+ * The bytes over the target of a level are pushed into the next level,
+ * where they rewrite about `levelSizeMultiplier` times as many bytes, and
+ * make the next level overflow by as much in turn.
+ */
+uint64_t LeveledCompaction::estimatePendingBytes(const Levels& levels, const vector<SubLevel>& L0SubLevels) const {
+
+    uint64_t pendingBytes = CompactionStrategy::estimatePendingBytes(levels, L0SubLevels);
+    uint64_t incomingBytes = pendingBytes;
+    vector<uint64_t> targets = getLevelTargets(levels);
+    size_t levelNumber = levels.size();
+    for (size_t level = 1; level < levelNumber; ++level) {
+        uint64_t levelBytes = getLevelBytes(*levels.at(level)) + incomingBytes;
+        incomingBytes = levelBytes > targets[level] ? levelBytes - targets[level] : 0;
+        pendingBytes += incomingBytes * (levelSizeMultiplier + 1);
+    }
+    return pendingBytes;
+}
+
+/**
+ * The score of L0 is its number of sub-levels or SSTs relative to the
+ * limits, and the score of any other level is its size relative to its
+ * target. L0 needs compaction from a score of 1, other levels above 1.
+ * @return Compaction scores of every level.
+ */
+vector<double> LeveledCompaction::getLevelScores(const Levels& levels, const vector<SubLevel>& L0SubLevels) const {
+
+    vector<double> scores;
+    scores.push_back(max((double)L0SubLevels.size() / L0_SUBLEVEL_TRIGGER,
+                         (double)levels.at(0)->size() / (L0_MAX_SST_NUMBER + 1)));
+
+    vector<uint64_t> targets = getLevelTargets(levels);
+    size_t levelNumber = levels.size();
+    for (size_t level = 1; level < levelNumber; ++level)
+        scores.push_back((double)getLevelBytes(*levels.at(level)) / targets[level]);
+
+    return scores;
+}
+
+/**
+ * Level N aims at levelBaseBytes * multiplier^(N-1) bytes. In the dynamic
+ * mode, the levels above the last non-empty level instead aim at the size
+ * of the last level divided by the multiplier once per level, but never
+ * below levelBaseBytes, so they follow the amount of live data.
+ * @return Target size in bytes of every level. The target of L0 is unused.
+ */
+vector<uint64_t> LeveledCompaction::getLevelTargets(const Levels& levels) const {
+
+    size_t levelNumber = levels.size();
+    vector<uint64_t> targets(levelNumber, levelBaseBytes);
+    for (size_t level = 2; level < levelNumber; ++level)
+        targets[level] = targets[level - 1] * levelSizeMultiplier;
+
+    if (!dynamicLevelBytes || levelNumber <= 2)
+        return targets;
+
+    size_t lastLevel = levelNumber - 1;
+    while (lastLevel > 1 && levels.at(lastLevel)->empty())
+        lastLevel--;
+
+    uint64_t target = getLevelBytes(*levels.at(lastLevel));
+    for (size_t level = lastLevel - 1; level >= 1; --level) {
+        target /= levelSizeMultiplier;
+        targets[level] = max(target, levelBaseBytes);
+    }
+
+    return targets;
+}
+
+/**
+ * Pick the SST with the largest share of deletions above the last non-empty
+ * level if the share reaches tombstoneCompactionRatio. Every push moves its
+ * deletions one level down, and they are discarded at the last level at the
+ * latest, so that the picks end.
+ * @return false if no SST has enough deletions.
+ */
+bool LeveledCompaction::pickTombstoneCompaction(const Levels& levels, CompactionTask& task) const {
+
+    if (tombstoneCompactionRatio <= 0)
+        return false;
+
+    size_t lastLevel = levels.size() - 1;
+    while (lastLevel > 0 && levels.at(lastLevel)->empty())
+        lastLevel--;
+
+    SSTPtr densestSST;
+    double maxRatio = 0;
+    for (size_t level = 1; level < lastLevel; ++level) {
+        for (const auto& sst : *levels.at(level)) {
+            double ratio = (double)sst->getTombstoneNumber() / sst->getKeyNumber();
+            if (ratio >= tombstoneCompactionRatio && ratio > maxRatio) {
+                densestSST = sst;
+                maxRatio = ratio;
+            }
+        }
+    }
+
+    if (!densestSST)
+        return false;
+
+    task.kind = PUSH_DOWN;
+    task.level = densestSST->getLevel();
+    task.SSTs = vector<SSTPtr>{densestSST};
+    return true;
+}
+
+uint64_t LeveledCompaction::getLevelBytes(const vector<SSTPtr>& levelSSTs) {
+    uint64_t bytes = 0;
+    for (const auto& sst : levelSSTs)
+        bytes += sst->getFileSize();
+    return bytes;
+}
+
+/**
+ * @return Total size of the SSTs in the lower level that overlap the SST.
+ */
+uint64_t LeveledCompaction::getOverlappingBytes(const SSTPtr& sst, const vector<SSTPtr>& lowerLevelSSTs) {
+    auto it = lower_bound(lowerLevelSSTs.cbegin(), lowerLevelSSTs.cend(), sst->getMinKey(),
+                          [](const SSTPtr& lowerSST, LsmKey key) { return lowerSST->getMaxKey() < key; });
+    uint64_t bytes = 0;
+    for (; it != lowerLevelSSTs.cend() && (*it)->getMinKey() <= sst->getMaxKey(); ++it)
+        bytes += (*it)->getFileSize();
+    return bytes;
+}
+
+/**
+ * Order the SSTs of the level by the configured picker and take them until
+ * they cover the overflowing bytes:
+ * - OLDEST_FIRST_PICKER: smallest time stamps first; if time stamps are
+ *   equal, smallest minimum keys first.
+ * - MIN_OVERLAPPING_RATIO_PICKER: smallest ratio of overlapping bytes in
+ *   the next level to the size of the SST first, so that pushing an SST
+ *   down rewrites as few lower level bytes as possible.
+ * - ROUND_ROBIN_PICKER: in key order, starting after the SST picked last
+ *   time and wrapping around.
+ * @param level: The level that exceeds its target size.
+ * @param overflowBytes: How many bytes the level exceeds its target. Always
+ * greater than 0.
+ * @return An array of the SSTs that need compaction.
+ */
+vector<SSTPtr> LeveledCompaction::getCompactSSTs(const Levels& levels, size_t level, uint64_t overflowBytes) {
+
+    const vector<SSTPtr>& levelSSTs = *levels.at(level);
+    vector<SSTPtr> sortedSSTs(levelSSTs);
+
+    if (picker == MIN_OVERLAPPING_RATIO_PICKER && levels.count(level + 1)) {
+        const vector<SSTPtr>& lowerLevelSSTs = *levels.at(level + 1);
+        unordered_map<SSTPtr, double> ratios;
+        for (const auto& sst : levelSSTs)
+            ratios[sst] = (double)getOverlappingBytes(sst, lowerLevelSSTs) / max(sst->getFileSize(), 1u);
+        sort(sortedSSTs.begin(), sortedSSTs.end(), [&](const SSTPtr& sst1, const SSTPtr& sst2) {
+            return ratios[sst1] < ratios[sst2];
+        });
+    } else if (picker == ROUND_ROBIN_PICKER && compactCursors.count(level)) {
+        // The level is sorted by key: rotate it to start after the cursor.
+        LsmKey cursor = compactCursors[level];
+        auto start = find_if(sortedSSTs.begin(), sortedSSTs.end(),
+                             [&](const SSTPtr& sst) { return sst->getMinKey() > cursor; });
+        rotate(sortedSSTs.begin(), start, sortedSSTs.end());
+    } else if (picker != ROUND_ROBIN_PICKER) {
+        SSTTimeStampPriorComparator sstComparator;
+        sort(sortedSSTs.begin(), sortedSSTs.end(), sstComparator);
+    }
+
+    vector<SSTPtr> compactSSTs;
+    uint64_t compactBytes = 0;
+    for (const auto& sst : sortedSSTs) {
+        if (compactBytes >= overflowBytes)
+            break;
+        compactSSTs.push_back(sst);
+        compactBytes += sst->getFileSize();
+    }
+
+    if (picker == ROUND_ROBIN_PICKER)
+        compactCursors[level] = compactSSTs.back()->getMaxKey();
+
+    return compactSSTs;
+
+}
+
+bool TieredCompaction::pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                                      CompactionTask& task) {
+
+    vector<SortedRun> runs = getSortedRuns(levels, L0SubLevels);
+    if (!needCompaction(levels, runs))
+        return false;
+
+    // Bound space amplification: if the newer runs have grown too large compared
+    // with the oldest one, merge everything into the oldest run.
+    size_t runNumber = runs.size();
+    if (runNumber >= 2) {
+        uint64_t newerSize = 0;
+        for (size_t i = 0; i < runNumber - 1; ++i)
+            newerSize += runs[i].size;
+        if (newerSize * 100 >= TIERED_MAX_SIZE_AMPLIFICATION * runs.back().size) {
+            makeTask(runs, 0, runNumber - 1, task);
+            return true;
+        }
+    }
+
+    size_t first, last;
+    bool forceL0 = levels.at(0)->size() > L0_MAX_SST_NUMBER;
+    if (!pickSimilarRuns(runs, runNumber, forceL0, first, last))
+        return false;
+    makeTask(runs, first, last, task);
+    return true;
+}
+
+/**
+ * @return Sorted runs from the newest to the oldest: the L0 sub-levels
+ * first, then every non-empty level.
+ */
+vector<SortedRun> TieredCompaction::getSortedRuns(const Levels& levels, const vector<SubLevel>& L0SubLevels) {
+
+    vector<SortedRun> runs;
+    auto addRun = [&](size_t level, const vector<SSTPtr>& SSTs) {
+        SortedRun run = {level, 0, SSTs};
+        for (const auto& sst : SSTs)
+            run.size += sst->getFileSize();
+        runs.push_back(run);
+    };
+
+    for (auto it = L0SubLevels.crbegin(); it != L0SubLevels.crend(); ++it)
+        addRun(0, it->SSTs);
+
+    size_t levelNumber = levels.size();
+    for (size_t level = 1; level < levelNumber; ++level)
+        if (!levels.at(level)->empty())
+            addRun(level, *levels.at(level));
+
+    return runs;
+}
+
+bool TieredCompaction::needCompaction(const Levels& levels, const vector<SortedRun>& runs) {
+    return runs.size() >= TIERED_RUN_TRIGGER || levels.at(0)->size() > L0_MAX_SST_NUMBER;
+}
+
+/**
+ * Starting from the newest run, find consecutive runs whose sizes are
+ * within TIERED_SIZE_RATIO percent of the total size of the newer runs
+ * picked before them. If there are none, merge the newest runs until the
+ * number of runs drops below the trigger.
+ * A run in L0 can only be merged together with every older L0 sub-level,
+ * since the output is placed below all the runs left.
+ * @param runNumber: Only the newest `runNumber` runs may be picked.
+ * @param forceL0: Set true if L0 holds too many SSTs and must be picked.
+ * @return false if no runs can be merged.
+ */
+bool TieredCompaction::pickSimilarRuns(const vector<SortedRun>& runs, size_t runNumber, bool forceL0,
+                                       size_t& first, size_t& last) {
+
+    if (runNumber == 0)
+        return false;
+
+    size_t L0RunNumber = 0;
+    while (L0RunNumber < runs.size() && runs[L0RunNumber].level == 0)
+        L0RunNumber++;
+
+    bool found = false;
+    for (size_t start = 0; start < runNumber && !found; ++start) {
+        if (forceL0 && start > 0)
+            break;
+        uint64_t candidateSize = runs[start].size;
+        size_t end = start;
+        while (end + 1 < runNumber
+               && runs[end + 1].size * 100 <= candidateSize * (100 + TIERED_SIZE_RATIO))
+            candidateSize += runs[++end].size;
+        if (end - start + 1 >= TIERED_MIN_MERGE_WIDTH || forceL0) {
+            first = start;
+            last = end;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        if (runs.size() < TIERED_RUN_TRIGGER || runNumber < 2)
+            return false;
+        first = 0;
+        last = min(runNumber - 1, runs.size() - TIERED_RUN_TRIGGER + 1);
+    }
+
+    if (first < L0RunNumber && last < L0RunNumber - 1)
+        last = L0RunNumber - 1;
+
+    return last > first || runs[first].level == 0;
+}
+
+/**
+ * Merge runs [first, last] into the level of the oldest run picked. If only
+ * L0 runs are picked, the output goes to the level right above the next
+ * non-empty level, or into L1 together with the L1 run if L1 is not empty.
+ */
+void TieredCompaction::makeTask(const vector<SortedRun>& runs, size_t first, size_t last,
+                                CompactionTask& task) {
+
+    if (runs[last].level == 0) {
+        size_t nextLevel = last + 1 < runs.size() ? runs[last + 1].level : TIERED_LEVEL_NUMBER;
+        if (nextLevel == 1)
+            last++;
+        task.level = nextLevel == 1 ? 1 : nextLevel - 1;
+    } else
+        task.level = runs[last].level;
+
+    task.kind = MERGE_RUNS;
+    task.SSTs.clear();
+    for (size_t i = first; i <= last; ++i)
+        task.SSTs.insert(task.SSTs.end(), runs[i].SSTs.begin(), runs[i].SSTs.end());
+}
+
+bool LazyLeveledCompaction::pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                                           CompactionTask& task) {
+
+    vector<SortedRun> runs = getSortedRuns(levels, L0SubLevels);
+    if (!needCompaction(levels, runs))
+        return false;
+
+    // Without a last level yet, all the runs are tiered.
+    size_t runNumber = runs.size();
+    if (runs.back().level == 0)
+        return TieredCompaction::pickCompaction(levels, L0SubLevels, task);
+
+    // The upper runs have grown to a fraction of the last level: merge them
+    // all into it, rewriting the last level once per LAZY_LEVELING_FANOUT growth.
+    uint64_t upperSize = 0;
+    for (size_t i = 0; i < runNumber - 1; ++i)
+        upperSize += runs[i].size;
+    if (upperSize * LAZY_LEVELING_FANOUT >= runs.back().size) {
+        makeTask(runs, 0, runNumber - 1, task);
+        return true;
+    }
+
+    size_t first, last;
+    bool forceL0 = levels.at(0)->size() > L0_MAX_SST_NUMBER;
+    if (!pickSimilarRuns(runs, runNumber - 1, forceL0, first, last))
+        return false;
+    makeTask(runs, first, last, task);
+    return true;
+}
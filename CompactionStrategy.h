@@ -0,0 +1,122 @@
+#ifndef LSM_TREE_COMPACTIONSTRATEGY_H
+#define LSM_TREE_COMPACTIONSTRATEGY_H
+
+#include <memory>
+#include <cmath>
+#include <vector>
+#include <unordered_map>
+#include "SSTable.h"
+#include "FencePointers.h"
+#include "Options.h"
+#include "constants.h"
+
+using namespace std;
+
+typedef unordered_map<size_t, shared_ptr<vector<SSTPtr>>> Levels;
+
+enum CompactionKind {
+    COMPACT_L0,     // Merge all the SSTs in L0 with the overlapping SSTs in L1.
+    PUSH_DOWN,      // Merge `SSTs` of `level` one by one into `level + 1`.
+    MERGE_RUNS      // Merge `SSTs`, a group of whole sorted runs, into `level`.
+};
+
+struct CompactionTask {
+    CompactionKind kind;
+    size_t level;
+    vector<SSTPtr> SSTs;
+};
+
+/**
+ * A sorted run of SSTs: one L0 sub-level or one whole level.
+ */
+struct SortedRun {
+    size_t level;
+    uint64_t size;
+    vector<SSTPtr> SSTs;
+};
+
+/**
+ * Decides which compaction the store runs next. The store keeps asking until
+ * no compaction is picked, so every picked task must shrink the overflow.
+ */
+class CompactionStrategy {
+
+public:
+    virtual ~CompactionStrategy() = default;
+
+    /**
+     * @param levels: SSTs of every level. L0 is sorted by time stamp and the
+     * other levels by minimum key.
+     * @param L0SubLevels: L0 organized into sub-levels, from the oldest to the newest.
+     * @return false if no compaction is needed.
+     */
+    virtual bool pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                                CompactionTask& task) = 0;
+
+    virtual uint64_t estimatePendingBytes(const Levels& levels, const vector<SubLevel>& L0SubLevels) const;
+
+    static shared_ptr<CompactionStrategy> create(const Options& options);
+};
+
+/**
+ * Every level has a target size in bytes, and the level whose size exceeds
+ * its target the most pushes its oldest SSTs into the next level. L0 is
+ * merged into L1 as a whole.
+ */
+class LeveledCompaction : public CompactionStrategy {
+
+private:
+    const uint64_t levelBaseBytes;
+    const uint32_t levelSizeMultiplier;
+    const bool dynamicLevelBytes;
+    const CompactionPicker picker;
+    const double tombstoneCompactionRatio;
+    unordered_map<size_t, LsmKey> compactCursors;   // Round-robin position of every level.
+
+    static uint64_t getLevelBytes(const vector<SSTPtr>& levelSSTs);
+    static uint64_t getOverlappingBytes(const SSTPtr& sst, const vector<SSTPtr>& lowerLevelSSTs);
+    vector<uint64_t> getLevelTargets(const Levels& levels) const;
+    vector<SSTPtr> getCompactSSTs(const Levels& levels, size_t level, uint64_t overflowBytes);
+    bool pickTombstoneCompaction(const Levels& levels, CompactionTask& task) const;
+
+public:
+    explicit LeveledCompaction(const Options& options);
+
+    vector<double> getLevelScores(const Levels& levels, const vector<SubLevel>& L0SubLevels) const;
+    bool pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                        CompactionTask& task) override;
+    uint64_t estimatePendingBytes(const Levels& levels, const vector<SubLevel>& L0SubLevels) const override;
+};
+
+/**
+ * Universal compaction: all data lives in sorted runs of any size, and runs
+ * of similar size are merged together, so each byte is rewritten only about
+ * once per size tier.
+ */
+class TieredCompaction : public CompactionStrategy {
+
+protected:
+    static vector<SortedRun> getSortedRuns(const Levels& levels, const vector<SubLevel>& L0SubLevels);
+    static bool needCompaction(const Levels& levels, const vector<SortedRun>& runs);
+    static bool pickSimilarRuns(const vector<SortedRun>& runs, size_t runNumber, bool forceL0,
+                                size_t& first, size_t& last);
+    static void makeTask(const vector<SortedRun>& runs, size_t first, size_t last, CompactionTask& task);
+
+public:
+    bool pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                        CompactionTask& task) override;
+};
+
+/**
+ * Tiered compaction above the last level, and leveled compaction into the
+ * last level, which holds most of the data.
+ */
+class LazyLeveledCompaction : public TieredCompaction {
+
+public:
+    bool pickCompaction(const Levels& levels, const vector<SubLevel>& L0SubLevels,
+                        CompactionTask& task) override;
+};
+
+
+#endif //LSM_TREE_COMPACTIONSTRATEGY_H
@@ -0,0 +1,210 @@
+#include <cstring>
+#include <vector>
+#include "Compression.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 13
+
+/**
+ * @return true if the build can write and read blocks of the codec.
+ */
+bool Compression::isSupported(CompressionType type) {
+    switch (type) {
+        case NO_COMPRESSION:
+        case LZ_COMPRESSION:
+            return true;
+        case ZLIB_COMPRESSION:
+#ifdef HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * @param compressed: Set to the compressed block.
+ * @return false if the codec does not make the block smaller, in which case
+ * it is stored as it is.
+ */
+bool Compression::compress(CompressionType type, string_view raw, string& compressed) {
+    compressed.clear();
+    switch (type) {
+        case NO_COMPRESSION:
+            return false;
+        case LZ_COMPRESSION:
+            lzCompress(raw, compressed);
+            break;
+        case ZLIB_COMPRESSION: {
+#ifdef HAVE_ZLIB
+            uLongf size = compressBound(raw.size());
+            compressed.resize(size);
+            if (compress2((Bytef*)&compressed[0], &size, (const Bytef*)raw.data(), raw.size(),
+                          Z_DEFAULT_COMPRESSION) != Z_OK)
+                return false;
+            compressed.resize(size);
+            break;
+#else
+            cerr << "zlib is not supported by this build." << endl;
+            exit(-1);
+#endif
+        }
+    }
+    return compressed.size() < raw.size();
+}
+
+/**
+ * @param raw: Set to the block, which must be `rawSize` bytes long.
+ */
+void Compression::uncompress(CompressionType type, string_view compressed, uint32_t rawSize, string& raw) {
+    bool succeeded = false;
+    switch (type) {
+        case NO_COMPRESSION:
+            raw.assign(compressed);
+            succeeded = raw.size() == rawSize;
+            break;
+        case LZ_COMPRESSION:
+            succeeded = lzUncompress(compressed, rawSize, raw);
+            break;
+        case ZLIB_COMPRESSION: {
+#ifdef HAVE_ZLIB
+            uLongf size = rawSize;
+            raw.resize(rawSize);
+            succeeded = ::uncompress((Bytef*)&raw[0], &size, (const Bytef*)compressed.data(),
+                                     compressed.size()) == Z_OK && size == rawSize;
+            break;
+#else
+            cerr << "zlib is not supported by this build." << endl;
+            exit(-1);
+#endif
+        }
+    }
+    if (!succeeded) {
+        cerr << "Corrupted block." << endl;
+        exit(-1);
+    }
+}
+
+/**
+ * A block is a list of sequences, each made of a token byte, literals, and
+ * a match. The high 4 bits of the token are the number of literals, and
+ * the low 4 bits the length of the match minus LZ_MIN_MATCH. A field of 15
+ * is continued by bytes added to it, up to the first byte below 255. The
+ * literals follow, then the distance back to the match in 2 bytes. The last
+ * sequence stops after its literals.
+ */
+void Compression::lzCompress(string_view raw, string& compressed) {
+
+    const char* src = raw.data();
+    size_t size = raw.size();
+    vector<int64_t> table(1 << LZ_HASH_BITS, -1);    // Last position of each hash of 4 bytes.
+
+    auto putLength = [&](size_t length) {
+        for (; length >= 255; length -= 255)
+            compressed.push_back((char)255);
+        compressed.push_back((char)length);
+    };
+    auto putSequence = [&](size_t literalStart, size_t literalEnd, size_t matchLength, size_t distance) {
+        size_t literalLength = literalEnd - literalStart;
+        size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+        compressed.push_back((char)((min<size_t>(literalLength, 15) << 4) | min<size_t>(matchCode, 15)));
+        if (literalLength >= 15)
+            putLength(literalLength - 15);
+        compressed.append(src + literalStart, literalLength);
+        if (!matchLength)
+            return;
+        compressed.push_back((char)(distance & 0xff));
+        compressed.push_back((char)(distance >> 8));
+        if (matchCode >= 15)
+            putLength(matchCode - 15);
+    };
+
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + LZ_MIN_MATCH <= size) {
+        uint32_t sequence;
+        memcpy(&sequence, src + i, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int64_t candidate = table[hash];
+        table[hash] = i;
+
+        if (candidate < 0 || i - candidate > LZ_MAX_OFFSET || memcmp(src + candidate, src + i, LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        size_t matchLength = LZ_MIN_MATCH;
+        while (i + matchLength < size && src[candidate + matchLength] == src[i + matchLength])
+            matchLength++;
+        putSequence(anchor, i, matchLength, i - candidate);
+        i += matchLength;
+        anchor = i;
+    }
+    putSequence(anchor, size, 0, 0);
+}
+
+/**
+ * @return false if the block is corrupted.
+ */
+bool Compression::lzUncompress(string_view compressed, uint32_t rawSize, string& raw) {
+
+    const unsigned char* p = (const unsigned char*)compressed.data();
+    const unsigned char* end = p + compressed.size();
+    raw.resize(rawSize);
+    char* out = &raw[0];
+    size_t written = 0;
+
+    // @return false if the input ends first.
+    auto getLength = [&](size_t& length) {
+        while (true) {
+            if (p == end)
+                return false;
+            unsigned char byte = *p++;
+            length += byte;
+            if (byte < 255)
+                return true;
+        }
+    };
+
+    while (p < end) {
+        unsigned char token = *p++;
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(literalLength))
+            return false;
+        if ((size_t)(end - p) < literalLength || written + literalLength > rawSize)
+            return false;
+        memcpy(out + written, p, literalLength);
+        written += literalLength;
+        p += literalLength;
+        if (p == end)
+            break;
+
+        if (end - p < 2)
+            return false;
+        size_t distance = p[0] | (p[1] << 8);
+        p += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !getLength(matchLength))
+            return false;
+        matchLength += LZ_MIN_MATCH;
+        if (distance == 0 || distance > written || written + matchLength > rawSize)
+            return false;
+
+        // The match may overlap the bytes it produces.
+        char* from = out + written - distance;
+        if (distance >= matchLength) {
+            memcpy(out + written, from, matchLength);
+        } else {
+            for (size_t k = 0; k < matchLength; ++k)
+                out[written + k] = from[k];
+        }
+        written += matchLength;
+    }
+    return written == rawSize;
+}
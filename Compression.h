@@ -0,0 +1,28 @@
+#ifndef LSM_TREE_COMPRESSION_H
+#define LSM_TREE_COMPRESSION_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * The codecs of the value blocks of SSTs. A block is compressed on its own,
+ * so that reading a value uncompresses only the block it lies in.
+ */
+class Compression {
+
+private:
+    static void lzCompress(string_view raw, string& compressed);
+    static bool lzUncompress(string_view compressed, uint32_t rawSize, string& raw);
+
+public:
+    static bool isSupported(CompressionType type);
+    static bool compress(CompressionType type, string_view raw, string& compressed);
+    static void uncompress(CompressionType type, string_view compressed, uint32_t rawSize, string& raw);
+};
+
+
+#endif //LSM_TREE_COMPRESSION_H
@@ -0,0 +1,93 @@
+#include "FencePointers.h"
+
+void FencePointers::rebuild(const vector<SSTPtr>& SSTs) {
+    minKeys.clear();
+    maxKeys.clear();
+    minKeys.reserve(SSTs.size());
+    maxKeys.reserve(SSTs.size());
+    for (const auto& sst : SSTs) {
+        minKeys.push_back(sst->getMinKey());
+        maxKeys.push_back(sst->getMaxKey());
+    }
+}
+
+size_t FencePointers::size() const {
+    return minKeys.size();
+}
+
+bool FencePointers::empty() const {
+    return minKeys.empty();
+}
+
+LsmKey FencePointers::getMinKey(size_t index) const {
+    return minKeys[index];
+}
+
+LsmKey FencePointers::getMaxKey(size_t index) const {
+    return maxKeys[index];
+}
+
+/**
+ * Only valid for a sorted level whose SSTs do not overlap.
+ * @return The index of the SST whose key range covers the key, or -1 if
+ * no SST in the level may contain the key.
+ */
+int64_t FencePointers::find(LsmKey key) const {
+    size_t count = countNotGreater(minKeys, key);
+    if (count == 0 || maxKeys[count - 1] < key)
+        return -1;
+    return count - 1;
+}
+
+/**
+ * @return The position where an SST with the given minimum key should be
+ * inserted to keep the level sorted.
+ */
+size_t FencePointers::insertPosition(LsmKey minKey) const {
+    return countNotGreater(minKeys, minKey);
+}
+
+/**
+ * Find the SSTs in a sorted level that overlap [minKey, maxKey]. The
+ * overlapping interval is [first, last).
+ * @return false if no SST overlaps.
+ */
+bool FencePointers::overlap(LsmKey minKey, LsmKey maxKey, size_t& first, size_t& last) const {
+    first = countLess(maxKeys, minKey);
+    last = countNotGreater(minKeys, maxKey);
+    return first < last;
+}
+
+/**
+ * Branchless binary search: the loop body has no data-dependent branch, so
+ * the comparison compiles to a conditional move instead of a mispredicted jump.
+ * @return Number of elements smaller than or equal to the key.
+ */
+size_t FencePointers::countNotGreater(const vector<LsmKey>& keys, LsmKey key) {
+    size_t n = keys.size();
+    if (n == 0)
+        return 0;
+    const LsmKey* base = keys.data();
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return (base - keys.data()) + (*base <= key);
+}
+
+/**
+ * @return Number of elements strictly smaller than the key.
+ */
+size_t FencePointers::countLess(const vector<LsmKey>& keys, LsmKey key) {
+    size_t n = keys.size();
+    if (n == 0)
+        return 0;
+    const LsmKey* base = keys.data();
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[half] < key) ? base + half : base;
+        n -= half;
+    }
+    return (base - keys.data()) + (*base < key);
+}
@@ -0,0 +1,47 @@
+#ifndef LSM_TREE_FENCEPOINTERS_H
+#define LSM_TREE_FENCEPOINTERS_H
+
+#include <vector>
+#include "SSTable.h"
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * Contiguous copies of the key ranges of the SSTs in one level, kept in the
+ * same order as the level itself. Searching the flat arrays avoids chasing a
+ * `shared_ptr` to a separate heap object at every probe.
+ * Must be rebuilt whenever the level changes.
+ */
+class FencePointers {
+
+private:
+    vector<LsmKey> minKeys;
+    vector<LsmKey> maxKeys;
+
+    static size_t countNotGreater(const vector<LsmKey>& keys, LsmKey key);
+    static size_t countLess(const vector<LsmKey>& keys, LsmKey key);
+
+public:
+    void rebuild(const vector<SSTPtr>& SSTs);
+
+    size_t size() const;
+    bool empty() const;
+    LsmKey getMinKey(size_t index) const;
+    LsmKey getMaxKey(size_t index) const;
+
+    int64_t find(LsmKey key) const;
+    size_t insertPosition(LsmKey minKey) const;
+    bool overlap(LsmKey minKey, LsmKey maxKey, size_t& first, size_t& last) const;
+};
+
+/**
+ * A group of non-overlapping SSTs in L0, sorted by minimum key.
+ */
+struct SubLevel {
+    vector<SSTPtr> SSTs;
+    FencePointers fences;
+};
+
+
+#endif //LSM_TREE_FENCEPOINTERS_H
@@ -0,0 +1,325 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include "FileIO.h"
+
+#define TMP_FILE_SUFFIX ".tmp"
+
+static uint64_t alignDown(uint64_t n) {
+    return n / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+}
+
+static uint64_t alignUp(uint64_t n) {
+    return alignDown(n + DIRECT_IO_ALIGNMENT - 1);
+}
+
+/**
+ * Open the file, bypassing the page cache if `directIO` is set.
+ */
+static int openFile(const string& filename, int flags, bool directIO) {
+#ifdef O_DIRECT
+    if (directIO)
+        flags |= O_DIRECT;
+#endif
+    int fd = ::open(filename.c_str(), flags, 0644);
+    if (fd < 0) {
+        cerr << "Cannot open file `" << filename << "`." << endl;
+        exit(-1);
+    }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    if (directIO)
+        fcntl(fd, F_NOCACHE, 1);
+#endif
+    return fd;
+}
+
+/**
+ * Wait for the entries of the directory, such as a file just renamed into
+ * it, to be on the device.
+ */
+static void syncDir(const string& dirname) {
+    int fd = ::open(dirname.empty() ? "." : dirname.c_str(), O_RDONLY);
+    if (fd < 0 || fsync(fd) < 0) {
+        cerr << "Sync directory `" << dirname << "` failed." << endl;
+        exit(-1);
+    }
+    ::close(fd);
+}
+
+
+AlignedBuffer::AlignedBuffer(size_t capacity) : data(nullptr), capacity(alignUp(capacity)) {
+    void* memory;
+    if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, this->capacity) != 0) {
+        cerr << "Cannot allocate an aligned buffer." << endl;
+        exit(-1);
+    }
+    data = (char*)memory;
+}
+
+AlignedBuffer::~AlignedBuffer() {
+    free(data);
+}
+
+/**
+ * Grow to at least `capacity` bytes, dropping the contents.
+ */
+void AlignedBuffer::reserve(size_t capacity) {
+    if (capacity <= this->capacity)
+        return;
+    free(data);
+    this->capacity = 0;
+    void* memory;
+    if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, alignUp(capacity)) != 0) {
+        cerr << "Cannot allocate an aligned buffer." << endl;
+        exit(-1);
+    }
+    data = (char*)memory;
+    this->capacity = alignUp(capacity);
+}
+
+char* AlignedBuffer::getData() const {
+    return data;
+}
+
+size_t AlignedBuffer::getCapacity() const {
+    return capacity;
+}
+
+
+/**
+ * @param expectedSize: Bytes reserved for the file on the device up front,
+ * so that it is laid out in one piece, or 0 to reserve nothing.
+ */
+FileWriter::FileWriter(string filename, const FileWriteOptions& options, uint64_t expectedSize)
+        : filename(std::move(filename)), options(options), buffer(FILE_WRITER_BUFFER_SIZE),
+          bufferedBytes(0), fileSize(0), flushedBytes(0), syncedBytes(0) {
+    tmpFilename = this->filename + TMP_FILE_SUFFIX;
+    fd = openFile(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, options.directIO);
+#ifdef FALLOC_FL_KEEP_SIZE
+    // Not every file system can reserve space, and it is only a hint.
+    if (expectedSize > 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, alignUp(expectedSize));
+#endif
+}
+
+FileWriter::~FileWriter() {
+    if (fd >= 0)
+        close();
+}
+
+/**
+ * @return true for a file left under its temporary name by a writer that
+ * did not finish, which should be removed.
+ */
+bool FileWriter::isTemporaryFile(const string& filename) {
+    size_t suffixSize = strlen(TMP_FILE_SUFFIX);
+    return filename.size() >= suffixSize
+           && filename.compare(filename.size() - suffixSize, suffixSize, TMP_FILE_SUFFIX) == 0;
+}
+
+void FileWriter::append(const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        size_t n = min(size, buffer.getCapacity() - bufferedBytes);
+        memcpy(buffer.getData() + bufferedBytes, p, n);
+        bufferedBytes += n;
+        fileSize += n;
+        p += n;
+        size -= n;
+        if (bufferedBytes == buffer.getCapacity())
+            flushBuffer(false);
+    }
+}
+
+void FileWriter::append(string_view data) {
+    append(data.data(), data.size());
+}
+
+/**
+ * Write the buffer into the file. The buffer is always full but for the last
+ * write, which direct I/O pads up to the alignment.
+ */
+void FileWriter::flushBuffer(bool last) {
+    size_t size = bufferedBytes;
+    if (options.directIO && last) {
+        size = alignUp(bufferedBytes);
+        memset(buffer.getData() + bufferedBytes, 0, size - bufferedBytes);
+    }
+
+    size_t written = 0;
+    while (written < size) {
+        size_t pieceSize = size - written;
+        if (options.rateLimiter) {
+            pieceSize = min<size_t>(pieceSize, FILE_WRITER_WRITE_SIZE);
+            options.rateLimiter->request(pieceSize, options.priority);
+        }
+        ssize_t n = ::write(fd, buffer.getData() + written, pieceSize);
+        if (n <= 0) {
+            cerr << "Write file `" << filename << "` failed." << endl;
+            exit(-1);
+        }
+        written += n;
+    }
+    flushedBytes += bufferedBytes;
+    bufferedBytes = 0;
+
+    // Start writing back what is written so far, without waiting for it,
+    // so that the file does not reach the device in one burst.
+#ifdef SYNC_FILE_RANGE_WRITE
+    if (options.bytesPerSync > 0 && flushedBytes - syncedBytes >= options.bytesPerSync) {
+        sync_file_range(fd, syncedBytes, flushedBytes - syncedBytes, SYNC_FILE_RANGE_WRITE);
+        syncedBytes = flushedBytes;
+    }
+#endif
+}
+
+/**
+ * Write the rest of the buffer, close the file and rename it into place.
+ * The space reserved past the end of the file is released.
+ * @return The size of the file.
+ */
+uint64_t FileWriter::close() {
+    flushBuffer(true);
+    if (ftruncate(fd, flushedBytes) < 0) {
+        cerr << "Truncate file `" << tmpFilename << "` failed." << endl;
+        exit(-1);
+    }
+    if (options.sync && fdatasync(fd) < 0) {
+        cerr << "Sync file `" << tmpFilename << "` failed." << endl;
+        exit(-1);
+    }
+    ::close(fd);
+    fd = -1;
+
+    if (rename(tmpFilename.c_str(), filename.c_str()) < 0) {
+        cerr << "Rename file `" << tmpFilename << "` failed." << endl;
+        exit(-1);
+    }
+    if (options.sync)
+        syncDir(filename.substr(0, filename.find_last_of('/') + 1));
+    return fileSize;
+}
+
+uint64_t FileWriter::getFileSize() const {
+    return fileSize;
+}
+
+
+BackgroundFileWriter::BackgroundFileWriter(const FileWriteOptions& options, size_t maxPendingFiles)
+        : options(options), maxPendingFiles(maxPendingFiles), finished(false), writeMicros(0), waitMicros(0) {
+    worker = thread(&BackgroundFileWriter::run, this);
+}
+
+BackgroundFileWriter::~BackgroundFileWriter() {
+    finish();
+}
+
+/**
+ * Write the files in the order they come, until finished and none is left.
+ */
+void BackgroundFileWriter::run() {
+    while (true) {
+        unique_lock<mutex> lock(pendingMutex);
+        pendingChanged.wait(lock, [this] { return finished || !pendingFiles.empty(); });
+        if (pendingFiles.empty())
+            return;
+        pair<string, string> file = std::move(pendingFiles.front());
+        pendingFiles.pop_front();
+        pendingChanged.notify_all();
+        lock.unlock();
+
+        auto start = chrono::steady_clock::now();
+        FileWriter out(file.first, options, file.second.size());
+        out.append(file.second);
+        out.close();
+        writeMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+}
+
+/**
+ * Queue the file to be written, waiting first while the queue is full.
+ */
+void BackgroundFileWriter::write(string filename, string contents) {
+    unique_lock<mutex> lock(pendingMutex);
+    auto start = chrono::steady_clock::now();
+    pendingChanged.wait(lock, [this] { return pendingFiles.size() < maxPendingFiles; });
+    waitMicros += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    pendingFiles.emplace_back(std::move(filename), std::move(contents));
+    pendingChanged.notify_all();
+}
+
+/**
+ * Wait for every file queued to be written.
+ */
+void BackgroundFileWriter::finish() {
+    {
+        lock_guard<mutex> lock(pendingMutex);
+        finished = true;
+    }
+    pendingChanged.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+/**
+ * @return The time spent writing files, once finished.
+ */
+uint64_t BackgroundFileWriter::getWriteMicros() const {
+    return writeMicros;
+}
+
+/**
+ * @return The time `write` spent waiting for the thread to catch up.
+ */
+uint64_t BackgroundFileWriter::getWaitMicros() const {
+    return waitMicros;
+}
+
+
+FileReader::FileReader(string filename, bool directIO)
+        : filename(std::move(filename)), buffer(COMPACTION_READAHEAD_SIZE), bufferOffset(0), bufferedBytes(0) {
+    fd = openFile(this->filename, O_RDONLY, directIO);
+}
+
+FileReader::~FileReader() {
+    ::close(fd);
+}
+
+/**
+ * Read the aligned range around [offset, offset + size) and as much of the
+ * file after it as the buffer holds.
+ */
+void FileReader::fill(uint64_t offset, size_t size) {
+    bufferOffset = alignDown(offset);
+    buffer.reserve(alignUp(offset + size) - bufferOffset);
+
+    // A short read ends at the end of the file.
+    bufferedBytes = 0;
+    while (bufferedBytes < buffer.getCapacity()) {
+        size_t wanted = buffer.getCapacity() - bufferedBytes;
+        ssize_t n = pread(fd, buffer.getData() + bufferedBytes, wanted, bufferOffset + bufferedBytes);
+        if (n < 0) {
+            cerr << "Read file `" << filename << "` failed." << endl;
+            exit(-1);
+        }
+        bufferedBytes += n;
+        if ((size_t)n < wanted)
+            break;
+    }
+}
+
+/**
+ * @return The bytes, pointing into the buffer until the next read.
+ */
+string_view FileReader::read(uint64_t offset, size_t size) {
+    if (offset < bufferOffset || offset + size > bufferOffset + bufferedBytes)
+        fill(offset, size);
+    if (offset + size > bufferOffset + bufferedBytes) {
+        cerr << "Corrupted file `" << filename << "`." << endl;
+        exit(-1);
+    }
+    return string_view(buffer.getData() + (offset - bufferOffset), size);
+}
@@ -0,0 +1,145 @@
+#ifndef LSM_TREE_FILEIO_H
+#define LSM_TREE_FILEIO_H
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include "RateLimiter.h"
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * A buffer aligned to DIRECT_IO_ALIGNMENT, as direct I/O requires of the
+ * memory it reads into and writes from.
+ */
+class AlignedBuffer {
+
+private:
+    char* data;
+    size_t capacity;
+
+public:
+    explicit AlignedBuffer(size_t capacity);
+    ~AlignedBuffer();
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    void reserve(size_t capacity);
+    char* getData() const;
+    size_t getCapacity() const;
+};
+
+// How a FileWriter writes its file.
+struct FileWriteOptions {
+    bool directIO = false;      // Bypass the page cache.
+    uint64_t bytesPerSync = 0;  // Start writing back every this many bytes, or never if 0.
+    bool sync = false;          // Wait for the file to be on the device before it is renamed.
+    shared_ptr<RateLimiter> rateLimiter;    // Every write waits for its bytes if set.
+    IOPriority priority = IO_LOW;
+};
+
+/**
+ * Write a new file in one sequential pass through a buffer of
+ * FILE_WRITER_BUFFER_SIZE bytes. The file is written under a temporary name
+ * and renamed into place once closed, so that a file under its final name is
+ * always complete. With a rate limiter, every write of at most
+ * FILE_WRITER_WRITE_SIZE bytes first takes its bytes from the limiter, so
+ * that the device never sees more than the limit. With direct I/O, the file bypasses the page cache: it is
+ * written in aligned pieces, the last one padded, and then truncated to the
+ * bytes appended.
+ */
+class FileWriter {
+
+private:
+    string filename;
+    string tmpFilename;
+    int fd;
+    FileWriteOptions options;
+    AlignedBuffer buffer;
+    size_t bufferedBytes;
+    uint64_t fileSize;      // Bytes appended, including the buffered ones.
+    uint64_t flushedBytes;  // Bytes written into the file, padding aside.
+    uint64_t syncedBytes;   // Bytes whose write-back was started.
+
+    void flushBuffer(bool last);
+
+public:
+    FileWriter(string filename, const FileWriteOptions& options, uint64_t expectedSize = 0);
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    static bool isTemporaryFile(const string& filename);
+
+    void append(const void* data, size_t size);
+    void append(string_view data);
+    uint64_t close();
+    uint64_t getFileSize() const;
+};
+
+/**
+ * Write whole files on a thread of its own, so that the next ones can be
+ * built meanwhile. At most `maxPendingFiles` files wait for the thread, and
+ * `write` blocks past them, which bounds the memory they take.
+ */
+class BackgroundFileWriter {
+
+private:
+    const FileWriteOptions options;
+    const size_t maxPendingFiles;
+    deque<pair<string, string>> pendingFiles;   // Names and contents.
+    bool finished;
+    mutex pendingMutex;
+    condition_variable pendingChanged;
+    uint64_t writeMicros;   // Spent by the thread writing.
+    uint64_t waitMicros;    // Spent by `write` waiting for room.
+    thread worker;
+
+    void run();
+
+public:
+    BackgroundFileWriter(const FileWriteOptions& options, size_t maxPendingFiles);
+    ~BackgroundFileWriter();
+
+    void write(string filename, string contents);
+    void finish();
+    uint64_t getWriteMicros() const;
+    uint64_t getWaitMicros() const;
+};
+
+/**
+ * Read a file from the start to the end through its own readahead buffer of
+ * COMPACTION_READAHEAD_SIZE bytes, bypassing the page cache with direct I/O.
+ * Reads may skip parts of the file but should not go back.
+ */
+class FileReader {
+
+private:
+    string filename;
+    int fd;
+    AlignedBuffer buffer;
+    uint64_t bufferOffset;  // Of the file, where the buffer starts.
+    size_t bufferedBytes;
+
+    void fill(uint64_t offset, size_t size);
+
+public:
+    FileReader(string filename, bool directIO);
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    string_view read(uint64_t offset, size_t size);
+};
+
+
+#endif //LSM_TREE_FILEIO_H
@@ -0,0 +1,52 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const char* data, size_t size) : data(data), size(size) {}
+
+MappedFile::~MappedFile() {
+    if (size > 0)
+        munmap((void*)data, size);
+}
+
+/**
+ * Map the whole file. The file descriptor is closed right away, since the
+ * mapping does not need it.
+ */
+shared_ptr<const MappedFile> MappedFile::open(const string& filename) {
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot open file `" << filename << "`." << endl;
+        exit(-1);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        cerr << "Cannot stat file `" << filename << "`." << endl;
+        exit(-1);
+    }
+
+    size_t size = st.st_size;
+    void* data = nullptr;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            cerr << "Cannot map file `" << filename << "`." << endl;
+            exit(-1);
+        }
+    }
+    close(fd);
+
+    return make_shared<MappedFile>((const char*)data, size);
+}
+
+const char* MappedFile::getData() const {
+    return data;
+}
+
+size_t MappedFile::getSize() const {
+    return size;
+}
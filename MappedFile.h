@@ -0,0 +1,35 @@
+#ifndef LSM_TREE_MAPPEDFILE_H
+#define LSM_TREE_MAPPEDFILE_H
+
+#include <iostream>
+#include <string>
+#include <memory>
+
+using namespace std;
+
+/**
+ * A whole file mapped read-only into memory. The mapping stays readable
+ * after the file is renamed or removed, until the last reference to it is
+ * dropped, so a value read from it may outlive a compaction of its SST.
+ */
+class MappedFile {
+
+private:
+    const char* data;
+    size_t size;
+
+public:
+    MappedFile(const char* data, size_t size);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    static shared_ptr<const MappedFile> open(const string& filename);
+
+    const char* getData() const;
+    size_t getSize() const;
+};
+
+
+#endif //LSM_TREE_MAPPEDFILE_H
@@ -12,7 +12,15 @@ MemTable::~MemTable() {
 }
 
 
-void MemTable::put(LsmKey k, const LsmValue& v) {
+/**
+ * Insert or substitute the entry of the key. A deletion is put as an entry
+ * of TYPE_DELETION with an empty value. The value is moved into the node of
+ * the lowest layer, and the nodes above it hold the key only.
+ * @param newestSnapshot: The substituted entry is kept as an older version
+ * if this snapshot sees it. 0 if there is no snapshot.
+ */
+void MemTable::put(LsmKey k, LsmValue v, ValueType type, SequenceNumber sequence,
+                   SequenceNumber newestSnapshot) {
 
     stack<Node*> path = stack<Node*>();
     Node* p = head;
@@ -21,11 +29,7 @@ void MemTable::put(LsmKey k, const LsmValue& v) {
         while (p->next && p->next->key < k)
             p = p->next;
         if (p->next && k == p->next->key) {    // substitute
-            p = p->next;        // p points to the topmost existing node
-            while (p) {
-                p->value = v;
-                p = p->down;
-            }
+            substitute(getLowestNode(p->next), LsmEntry{type, std::move(v), sequence}, newestSnapshot);
             return;
         }
         path.push(p);
@@ -41,7 +45,8 @@ void MemTable::put(LsmKey k, const LsmValue& v) {
         } else {
             prev = head = new Node(head);
         }
-        Node* newNode = new Node(k, v, prev->next, prevAddedNode);
+        Node* newNode = prevAddedNode ? new Node(k, "", type, sequence, prev->next, prevAddedNode)
+                                      : new Node(k, std::move(v), type, sequence, prev->next, nullptr);
         prev->next = newNode;
         prevAddedNode = newNode;
     } while (rand() & 1);
@@ -50,19 +55,100 @@ void MemTable::put(LsmKey k, const LsmValue& v) {
 
 }
 
-LsmValue MemTable::get(LsmKey k) {
+/**
+ * Insert or substitute entries whose keys are strictly increasing. The
+ * predecessors of the last key in every layer are kept as a finger, and the
+ * search for the next key starts from the lowest layer whose predecessor
+ * and successor still enclose the key instead of from the head, so that a
+ * batch of close keys costs little more than walking the lowest layer.
+ * The values are moved from `entries`. Substituted entries are kept for
+ * snapshots as in `put`.
+ */
+void MemTable::putSorted(vector<pair<LsmKey, LsmEntry>>& entries, SequenceNumber newestSnapshot) {
+
+    // Predecessors indexed from the lowest layer, starting at the heads. The
+    // layers of the finger always enclose one another, so if a layer encloses
+    // the key, every layer above it does too.
+    vector<Node*> prev;
+    for (Node* p = head; p; p = p->down)
+        prev.insert(prev.begin(), p);
+
+    for (auto& entry : entries) {
+        LsmKey k = entry.first;
+
+        size_t layer = 0;
+        while (layer + 1 < prev.size() && prev[layer]->next && prev[layer]->next->key < k)
+            layer++;
+
+        // Search the layers below from the predecessor of the lowest enclosing layer.
+        Node* p = prev[layer];
+        while (true) {
+            while (p->next && p->next->key < k)
+                p = p->next;
+            prev[layer] = p;
+            if (layer == 0)
+                break;
+            p = p->down;
+            layer--;
+        }
+
+        if (prev[0]->next && prev[0]->next->key == k) {    // substitute
+            substitute(prev[0]->next, std::move(entry.second), newestSnapshot);
+            continue;
+        }
+
+        Node* prevAddedNode = nullptr;
+        layer = 0;
+        do {                                // 50% add a new layer
+            if (layer == prev.size()) {
+                head = new Node(head);
+                prev.push_back(head);
+            }
+            Node* newNode = new Node(k, layer == 0 ? std::move(entry.second.value) : "", entry.second.type,
+                                     entry.second.sequence, prev[layer]->next, prevAddedNode);
+            prev[layer]->next = newNode;
+            prev[layer] = newNode;
+            prevAddedNode = newNode;
+            layer++;
+        } while (rand() & 1);
+
+        keyNumber++;
+    }
+
+}
+
+/**
+ * @param entry: Set to the newest version of the key written up to the
+ * snapshot, which may be a deletion.
+ * @return false if memTable holds no such version.
+ */
+bool MemTable::get(LsmKey k, LsmEntry& entry, SequenceNumber snapshot) {
 
     Node* p = head;
 
     while (p) {
         while (p->next && p->next->key < k)
             p = p->next;
-        if (p->next && k == p->next->key)
-            return p->next->value;
+        if (p->next && k == p->next->key) {
+            p = getLowestNode(p->next);
+            if (p->sequence <= snapshot) {
+                entry.type = p->type;
+                entry.value = p->value;
+                entry.sequence = p->sequence;
+                return true;
+            }
+            for (const auto& version : p->olderVersions) {
+                if (version.sequence <= snapshot) {
+                    entry = version;
+                    return true;
+                }
+            }
+            return false;
+        }
         p = p->down;
     }
 
-    return "";
+    return false;
 }
 
 bool MemTable::del(LsmKey k) {
@@ -74,7 +160,7 @@ bool MemTable::del(LsmKey k) {
         while (p->next && p->next->key < k)
             p = p->next;
         if (p->next && k == p->next->key) {
-            if (p->next->value == DELETE_SIGN)
+            if (getLowestNode(p->next)->type == TYPE_DELETION)
                 return false;
             find = true;
             Node *delNode = p->next;
@@ -94,6 +180,91 @@ bool MemTable::del(LsmKey k) {
 
 }
 
+/**
+ * Remove every key in [start, end] from all the layers.
+ * @return The bytes the removed entries took, counted as they are written to an SST.
+ */
+uint64_t MemTable::delRange(LsmKey start, LsmKey end) {
+
+    Node* p = head;
+    uint64_t removedBytes = 0;
+
+    while (p) {
+        while (p->next && p->next->key < start)
+            p = p->next;
+        while (p->next && p->next->key <= end) {
+            Node* delNode = p->next;
+            p->next = delNode->next;
+            if (!p->down) {     // Count the keys in the lowest layer only.
+                keyNumber--;
+                removedBytes += DATA_INDEX_SIZE + delNode->value.size();
+                for (const LsmEntry& version : delNode->olderVersions)
+                    removedBytes += DATA_INDEX_SIZE + version.value.size();
+            }
+            delete delNode;
+        }
+        p = p->down;
+    }
+
+    while (head->down && !head->next) {     // delete empty layer
+        Node* delHead = head;
+        head = head->down;
+        delete delHead;
+    }
+
+    return removedBytes;
+
+}
+
+/**
+ * Append the entries of the keys in [start, end] to `entries` in key order,
+ * every version of a key from the newest to the oldest.
+ */
+void MemTable::scan(LsmKey start, LsmKey end, vector<pair<LsmKey, LsmEntry>>& entries) const {
+
+    Node* p = head;
+
+    while (p->down) {
+        while (p->next && p->next->key < start)
+            p = p->next;
+        p = p->down;
+    }
+    while (p->next && p->next->key < start)
+        p = p->next;
+
+    for (p = p->next; p && p->key <= end; p = p->next) {
+        entries.emplace_back(p->key, LsmEntry{p->type, p->value, p->sequence});
+        for (const auto& version : p->olderVersions)
+            entries.emplace_back(p->key, version);
+    }
+
+}
+
+/**
+ * @return true if some key in [start, end] has a version older than `sequence`.
+ */
+bool MemTable::hasEntryBefore(LsmKey start, LsmKey end, SequenceNumber sequence) const {
+
+    Node* p = head;
+
+    while (p->down) {
+        while (p->next && p->next->key < start)
+            p = p->next;
+        p = p->down;
+    }
+    while (p->next && p->next->key < start)
+        p = p->next;
+
+    for (p = p->next; p && p->key <= end; p = p->next) {
+        if (p->sequence < sequence)
+            return true;
+        if (!p->olderVersions.empty() && p->olderVersions.back().sequence < sequence)
+            return true;
+    }
+    return false;
+
+}
+
 void MemTable::reset() {
     while (head) {
         while (head->next) {
@@ -113,84 +284,102 @@ bool MemTable::empty() {
     return head->next == nullptr;
 }
 
+/**
+ * Move every value of at least `minBlobSize` bytes into the blob file, and
+ * keep where it lies instead. Called right before memTable is flushed.
+ */
+void MemTable::separateValues(uint64_t minBlobSize, BlobFileBuilder& blobFile) {
+    auto separate = [&](LsmKey key, LsmValue& value, ValueType& type) {
+        if (type != TYPE_VALUE || value.size() < minBlobSize)
+            return;
+        value = blobFile.add(key, value).encode();
+        type = TYPE_BLOB_INDEX;
+    };
+    for (Node* p = getLowestHead()->next; p; p = p->next) {
+        separate(p->key, p->value, p->type);
+        for (auto& version : p->olderVersions)
+            separate(p->key, version.value, version.type);
+    }
+}
+
 /**
  * If overflow, write the data in memTable into level 0 in disk
  * in the order of data index, header, bloom filter and data.
+ * @param dataDir: The directory of the store, ending with a slash.
+ * @param fileNumber: Names the file apart from every other SST of the store.
+ * @param compression: The codec of the blocks of values.
+ * @param writeOptions: How the file is written.
  * @return an SSTable that stores the cached information.
  */
-SSTPtr MemTable::writeToDisk(TimeStamp timeStamp) {
+SSTPtr MemTable::writeToDisk(const string& dataDir, TimeStamp timeStamp, uint64_t fileNumber,
+                             CompressionType compression, const FileWriteOptions& writeOptions) {
 
     // Create the directory.
-    string pathname = "./data/level-0/";
+    string pathname = dataDir + "level-0/";
     utils::mkdir(pathname.c_str());
 
-    // Open the output file.
-    string filename = pathname + "table-" + to_string(timeStamp) + ".sst";
-    ofstream out(filename, ios::out | ios::binary);
-    if (!out.is_open()) {
-        cerr << "Open file failed." << endl;
-        exit(-1);
-    }
-
     // Initialize.
     SSTHeader sstHeader;
     BloomFilter bloomFilter;
     vector<DataIndex> dataIndexes = vector<DataIndex>();
-    uint32_t dataIndexStart = HEADER_SIZE + BLOOM_FILTER_SIZE;
-    uint32_t dataStart = HEADER_SIZE + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * keyNumber;
-
-    // Set the file position to tha start of data index.
-    out.seekp(dataIndexStart, ios::beg);
-
-    // Write data indexes into the file.
     Node* q = getLowestHead();
     Node* p = q;
-    uint32_t offset = dataStart;
-    while (p->next) {
-        LsmKey k = p->next->key;
-        LsmValue v = p->next->value;
-
-        out.write((char*)&k, sizeof(k));
-        out.write((char*)&offset, sizeof(offset));
+    size_t entryNumber = keyNumber;
+    for (p = q->next; p; p = p->next)
+        entryNumber += p->olderVersions.size();
+    uint32_t dataStart = HEADER_SIZE + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * entryNumber;
 
+    // Build data indexes, every version of a key from the newest, and lay out
+    // the values in memory, so that the file is written in one pass.
+    uint32_t offset = dataStart;
+    uint64_t tombstoneNumber = 0;
+    SequenceNumber minSequence = MAX_SEQUENCE_NUMBER;
+    SequenceNumber maxSequence = 0;
+    BlockBuilder blockBuilder(compression, dataStart);
+    auto addEntry = [&](LsmKey k, const LsmValue& v, ValueType type, SequenceNumber sequence) {
         bloomFilter.insert(k);
-        DataIndex dataIndex = DataIndex(k, offset);
+        DataIndex dataIndex = DataIndex(k, sequence, offset, type);
         dataIndexes.push_back(dataIndex);
+        blockBuilder.add(v);
 
+        if (type == TYPE_DELETION)
+            tombstoneNumber++;
+        minSequence = min(minSequence, sequence);
+        maxSequence = max(maxSequence, sequence);
         offset += v.size();
+    };
+    p = q;
+    while (p->next) {
         p = p->next;
+        addEntry(p->key, p->value, p->type, p->sequence);
+        for (const auto& version : p->olderVersions)
+            addEntry(p->key, version.value, version.type, version.sequence);
     }
 
     // After the loop, p now points to the max key.
-    sstHeader = SSTHeader(timeStamp, keyNumber, q->next->key, p->key);
-
-    // Set the file position to the beginning.
-    out.seekp(0, ios::beg);
-
-    // Write header and bloom filter into the file.
-    out.write((char*)&sstHeader, HEADER_SIZE);
-    out.write((char*)(bloomFilter.byteArray), BLOOM_FILTER_SIZE);
-
-    // Set the file position to the start of data.
-    out.seekp(dataStart, ios::beg);
-
-    // Write data into the file.
-    while (q->next) {
-        LsmValue v = q->next->value;
-        out.write((char*)&v[0], v.size());
-        q = q->next;
-    }
-
-    // Close the file.
-    out.close();
+    const string& data = blockBuilder.finish();
+    const vector<BlockHandle>& blockHandles = blockBuilder.getHandles();
+    sstHeader = SSTHeader(timeStamp, entryNumber, q->next->key, p->key, tombstoneNumber,
+                          minSequence, maxSequence, compression, blockHandles.size(), fileNumber);
+
+    // Write header, bloom filter, data indexes, data and footer into the file.
+    string filename = pathname + "table-" + to_string(timeStamp)
+                      + "-" + to_string(q->next->key)
+                      + "-" + to_string(p->key)
+                      + "-" + to_string(fileNumber)
+                      + ".sst";
+    SSTFooter sstFooter(sstHeader, bloomFilter, dataIndexes, blockHandles);
+    FileWriter out(filename, writeOptions, dataStart + data.size() + SST_FOOTER_SIZE);
+    out.append(&sstHeader, HEADER_SIZE);
+    out.append(bloomFilter.byteArray, BLOOM_FILTER_SIZE);
+    for (const auto& dataIndex : dataIndexes)
+        out.append(&dataIndex, DATA_INDEX_SIZE);
+    out.append(data);
+    out.append(&sstFooter, SST_FOOTER_SIZE);
+    uint32_t fileSize = out.close();
 
     // Create an SST in the memory.
-    SSTPtr sst = make_shared<SSTable>(0, sstHeader, bloomFilter, dataIndexes);
-
-    // Rename the file.
-    string newFilename = sst->getFilename();
-    rename(filename.c_str(), newFilename.c_str());
-
+    SSTPtr sst = make_shared<SSTable>(dataDir, 0, sstHeader, bloomFilter, dataIndexes, fileSize, blockHandles);
     return sst;
 
 }
@@ -200,4 +389,26 @@ MemTable::Node* MemTable::getLowestHead() const {
     while (p->down)
         p = p->down;
     return p;
-}
\ No newline at end of file
+}
+
+/**
+ * @return The node of `node`'s key in the lowest layer, which holds the entry.
+ */
+MemTable::Node* MemTable::getLowestNode(Node* node) {
+    while (node->down)
+        node = node->down;
+    return node;
+}
+
+/**
+ * Replace the entry held by a node of the lowest layer, keeping it as an
+ * older version if the newest snapshot sees it.
+ */
+void MemTable::substitute(Node* node, LsmEntry&& entry, SequenceNumber newestSnapshot) {
+    if (node->sequence <= newestSnapshot)
+        node->olderVersions.insert(node->olderVersions.begin(),
+                                   LsmEntry{node->type, std::move(node->value), node->sequence});
+    node->value = std::move(entry.value);
+    node->type = entry.type;
+    node->sequence = entry.sequence;
+}
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <stack>
+#include <vector>
 #include <cstdlib>
 #include <memory>
 #include <utility>
@@ -18,6 +19,9 @@ class MemTable {
 
         LsmKey key{};
         LsmValue value;
+        ValueType type = TYPE_VALUE;
+        SequenceNumber sequence = 0;
+        LsmVersions olderVersions;      // Kept for snapshots, in the lowest layer only.
         Node* next;
         Node* down;
 
@@ -27,6 +31,8 @@ class MemTable {
         Node(Node* next, Node* down) : next(next), down(down) {}
         Node(LsmKey key, LsmValue value, Node* next) : key(key), value(std::move(value)), next(next), down(nullptr) {}
         Node(LsmKey key, LsmValue value, Node* next, Node* down) : key(key), value(std::move(value)), next(next), down(down) {}
+        Node(LsmKey key, LsmValue value, ValueType type, SequenceNumber sequence, Node* next, Node* down)
+            : key(key), value(std::move(value)), type(type), sequence(sequence), next(next), down(down) {}
 
     };
 
@@ -35,17 +41,27 @@ private:
     uint64_t keyNumber;
 
     Node* getLowestHead() const;
+    static Node* getLowestNode(Node* node);
+    static void substitute(Node* node, LsmEntry&& entry, SequenceNumber newestSnapshot);
 
 public:
     MemTable();
     ~MemTable();
 
-    void put(LsmKey k, const LsmValue& v);
-    LsmValue get(LsmKey k);
+    void put(LsmKey k, LsmValue v, ValueType type, SequenceNumber sequence,
+             SequenceNumber newestSnapshot = 0);
+    void putSorted(vector<pair<LsmKey, LsmEntry>>& entries, SequenceNumber newestSnapshot = 0);
+    bool get(LsmKey k, LsmEntry& entry, SequenceNumber snapshot = MAX_SEQUENCE_NUMBER);
     bool del(LsmKey k);
+    uint64_t delRange(LsmKey start, LsmKey end);
+    void scan(LsmKey start, LsmKey end, vector<pair<LsmKey, LsmEntry>>& entries) const;
+    bool hasEntryBefore(LsmKey start, LsmKey end, SequenceNumber sequence) const;
     void reset();
     bool empty();
-    SSTPtr writeToDisk(TimeStamp timeStamp);
+    void separateValues(uint64_t minBlobSize, BlobFileBuilder& blobFile);
+    SSTPtr writeToDisk(const string& dataDir, TimeStamp timeStamp, uint64_t fileNumber,
+                       CompressionType compression = NO_COMPRESSION,
+                       const FileWriteOptions& writeOptions = FileWriteOptions());
 
 };
 
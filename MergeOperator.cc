@@ -0,0 +1,30 @@
+#include "MergeOperator.h"
+
+uint64_t UInt64AddOperator::parse(const LsmValue& value) {
+    uint64_t number = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9')
+            return 0;
+        number = number * 10 + (c - '0');
+    }
+    return number;
+}
+
+void UInt64AddOperator::merge(LsmKey key, const LsmValue* existingValue, const LsmValue& operand,
+                              LsmValue& newValue) const {
+    uint64_t base = existingValue ? parse(*existingValue) : 0;
+    newValue = to_string(base + parse(operand));
+}
+
+StringAppendOperator::StringAppendOperator(char delimiter) : delimiter(delimiter) {}
+
+void StringAppendOperator::merge(LsmKey key, const LsmValue* existingValue, const LsmValue& operand,
+                                 LsmValue& newValue) const {
+    if (!existingValue) {
+        newValue = operand;
+        return;
+    }
+    newValue = *existingValue;
+    newValue += delimiter;
+    newValue += operand;
+}
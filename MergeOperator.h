@@ -0,0 +1,61 @@
+#ifndef LSM_TREE_MERGEOPERATOR_H
+#define LSM_TREE_MERGEOPERATOR_H
+
+#include <string>
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * Combines the operands passed to `KVStore::merge` with the value of the
+ * key. Operands of one key are combined with each other before the value
+ * they apply to is known, so the operator must be associative:
+ * merging B into the result of merging A must equal merging the result of
+ * merging B into A.
+ */
+class MergeOperator {
+
+public:
+    virtual ~MergeOperator() = default;
+
+    /**
+     * @param existingValue: The older value or operand of the key, or nullptr
+     * if the key has no value.
+     * @param operand: The newer operand.
+     * @param newValue: Set to the result. Never aliases the other arguments.
+     */
+    virtual void merge(LsmKey key, const LsmValue* existingValue, const LsmValue& operand,
+                       LsmValue& newValue) const = 0;
+};
+
+/**
+ * Values and operands are unsigned integers in decimal, and merging adds
+ * the operand to the value. Text that is not a number counts as 0.
+ */
+class UInt64AddOperator : public MergeOperator {
+
+private:
+    static uint64_t parse(const LsmValue& value);
+
+public:
+    void merge(LsmKey key, const LsmValue* existingValue, const LsmValue& operand,
+               LsmValue& newValue) const override;
+};
+
+/**
+ * Merging appends the operand to the value, separated by the delimiter.
+ */
+class StringAppendOperator : public MergeOperator {
+
+private:
+    const char delimiter;
+
+public:
+    explicit StringAppendOperator(char delimiter = ',');
+
+    void merge(LsmKey key, const LsmValue* existingValue, const LsmValue& operand,
+               LsmValue& newValue) const override;
+};
+
+
+#endif //LSM_TREE_MERGEOPERATOR_H
@@ -0,0 +1,142 @@
+#ifndef LSM_TREE_OPTIONS_H
+#define LSM_TREE_OPTIONS_H
+
+#include <memory>
+#include <vector>
+#include "constants.h"
+
+class CompactionStrategy;
+class MergeOperator;
+class RateLimiter;
+
+enum CompactionStyle {
+    LEVELED_COMPACTION,         // Every level is one sorted run, merged into the next on overflow.
+    TIERED_COMPACTION,          // Sorted runs of similar size are merged together.
+    LAZY_LEVELED_COMPACTION     // Tiered upper levels, leveled last level.
+};
+
+// How leveled compaction chooses the SSTs pushed out of an overflowing level.
+enum CompactionPicker {
+    OLDEST_FIRST_PICKER,            // Smallest time stamp, then smallest minimum key.
+    MIN_OVERLAPPING_RATIO_PICKER,   // Fewest overlapping bytes in the next level per byte pushed.
+    ROUND_ROBIN_PICKER              // Cycle through the key space of the level.
+};
+
+// What `del` reads to tell whether the key existed before the deletion.
+enum DeleteMode {
+    CHECKED_DELETE,     // A full get: exact, but may read the disk.
+    PROBABLE_DELETE,    // memTable, fence pointers and bloom filters only, so
+                        // a deleted or absent key may be reported as existing.
+    BLIND_DELETE        // Nothing: always reports that the key existed.
+};
+
+// What is checked against the checksums of an SST when the store is opened.
+// Blocks are checked whenever they are read anyway.
+enum ChecksumVerification {
+    VERIFY_NOTHING,
+    VERIFY_METADATA,    // Header, bloom filter, data indexes and block handles: the bytes read to open the SST.
+    VERIFY_ALL          // Every block too, reading every SST in full.
+};
+
+// When the bloom filter, data indexes and block handles of an SST are read
+// from its file. Its header is always read when the store is opened.
+enum MetadataLoading {
+    LOAD_ON_OPEN,           // Before the store is opened.
+    LOAD_ON_FIRST_USE,      // When the SST is first read past its key range.
+    LOAD_IN_BACKGROUND      // On first use, or by a thread started with the store, whichever comes first.
+};
+
+/**
+ * Settings chosen per store when it is opened.
+ */
+struct Options {
+    CompactionStyle compactionStyle = LEVELED_COMPACTION;
+
+    // Overrides `compactionStyle` with a user-defined strategy if set.
+    // Strategies may keep state, so do not share one between stores.
+    std::shared_ptr<CompactionStrategy> compactionStrategy;
+
+    // Leveled compaction: target size of L1 in bytes, and how many times
+    // larger each level is than the one above it.
+    uint64_t levelBaseBytes = 4 * MAX_SSTABLE_SIZE;
+    uint32_t levelSizeMultiplier = 2;
+
+    // Leveled compaction: derive the targets of the levels above the last
+    // one from the current size of the last level instead of from L1.
+    bool dynamicLevelBytes = false;
+
+    CompactionPicker compactionPicker = OLDEST_FIRST_PICKER;
+
+    // A large compaction is split into up to this many key ranges, merged
+    // by threads of their own. 1 merges every compaction on one thread.
+    uint32_t maxSubcompactions = MAX_SUBCOMPACTIONS;
+
+    // Leveled compaction: push an SST down once this fraction of its keys
+    // are deletions, even if its level does not overflow. 0 disables it.
+    double tombstoneCompactionRatio = 0.5;
+
+    DeleteMode deleteMode = CHECKED_DELETE;
+
+    // memTable is flushed into an L0 SST once a write would grow it past
+    // this many bytes, counted like in an SST. Compactions still cut their
+    // SSTs at MAX_SSTABLE_SIZE.
+    uint64_t writeBufferSize = MAX_SSTABLE_SIZE;
+
+    // Required by `KVStore::merge`.
+    std::shared_ptr<MergeOperator> mergeOperator;
+
+    // Key-value separation: values of at least `minBlobSize` bytes are moved
+    // into blob files when memTable is flushed, and the SSTs keep only where
+    // they lie, so compactions no longer rewrite them.
+    bool enableBlobFiles = false;
+    uint64_t minBlobSize = 1024;
+
+    // After compactions, blob files whose live bytes fall below this fraction
+    // of their size are rewritten. 0 disables it.
+    double blobGarbageCollectionRatio = 0.5;
+
+    // Codec of the blocks of values of the SSTs written into each level, such
+    // as {NO_COMPRESSION, NO_COMPRESSION, LZ_COMPRESSION, ZLIB_COMPRESSION}.
+    // Deeper levels take the last codec; empty means no compression. SSTs
+    // moved down without being rewritten keep their codec.
+    std::vector<CompressionType> compressionPerLevel;
+
+    // Limits the bytes written by flushes and compactions if set. May be
+    // shared between stores to bound their writes together.
+    std::shared_ptr<RateLimiter> rateLimiter;
+
+    // Write stalls: a flush runs at most WRITE_STALL_COMPACTIONS_PER_FLUSH
+    // compactions instead of all it makes necessary, and the debt left is
+    // paid off by delaying writes past the soft limits, in compactions while
+    // any is pending, and by stopping them at the hard limits until the
+    // store is back below.
+    bool enableWriteStalls = false;
+    uint32_t level0SlowdownWritesTrigger = 20;
+    uint32_t level0StopWritesTrigger = 36;
+    uint64_t softPendingCompactionBytesLimit = 32 * MAX_SSTABLE_SIZE;
+    uint64_t hardPendingCompactionBytesLimit = 128 * MAX_SSTABLE_SIZE;
+    uint64_t delayedWriteRate = 16 * 1024 * 1024;    // Bytes per second at the soft limits.
+
+    // Flushes and compactions read and write SSTs and blob files bypassing
+    // the page cache, so that they do not evict the pages serving reads.
+    bool useDirectIOForFlushAndCompaction = false;
+
+    // New SSTs and blob files are written under a temporary name, with
+    // their space reserved up front, and renamed into place once complete.
+    // Their write-back is started every `bytesPerSync` bytes, so that the
+    // device is not flooded when the kernel flushes them, and with
+    // `syncNewFiles` they are on the device before they are renamed, so
+    // that they survive a crash.
+    uint64_t bytesPerSync = 1024 * 1024;
+    bool syncNewFiles = true;
+
+    ChecksumVerification verifyChecksumsOnOpen = VERIFY_METADATA;
+
+    // SSTs are opened by up to MAX_OPEN_THREADS threads. Loading the rest
+    // of their metadata later makes opening a store take about as long as
+    // reading the headers, and VERIFY_ALL still reads every SST in full.
+    MetadataLoading metadataLoading = LOAD_ON_OPEN;
+};
+
+
+#endif //LSM_TREE_OPTIONS_H
@@ -0,0 +1,41 @@
+#include "PinnableValue.h"
+
+/**
+ * Point at `value` inside `file`, holding the mapping until the next reset.
+ */
+void PinnableValue::pin(shared_ptr<const MappedFile> file, string_view value) {
+    pinnedFile = std::move(file);
+    ownedValue.clear();
+    view = value;
+}
+
+/**
+ * Take over `value`, for values that do not live in a mapped SST.
+ */
+void PinnableValue::assign(LsmValue&& value) {
+    pinnedFile.reset();
+    ownedValue = std::move(value);
+    view = ownedValue;
+}
+
+void PinnableValue::reset() {
+    pinnedFile.reset();
+    ownedValue.clear();
+    view = string_view();
+}
+
+bool PinnableValue::isPinned() const {
+    return pinnedFile != nullptr;
+}
+
+string_view PinnableValue::value() const {
+    return view;
+}
+
+size_t PinnableValue::size() const {
+    return view.size();
+}
+
+string PinnableValue::toString() const {
+    return string(view);
+}
@@ -0,0 +1,44 @@
+#ifndef LSM_TREE_PINNABLEVALUE_H
+#define LSM_TREE_PINNABLEVALUE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include "MappedFile.h"
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * The value returned by `KVStore::get` without copying it. A value read
+ * from an SST points straight into the mapping of the file, which is kept
+ * alive by the handle; any other value, e.g. one found in memTable or made
+ * by a merge, is held by the handle itself. The view stays valid until the
+ * handle is reset, reused or destroyed, whatever the store does meanwhile.
+ */
+class PinnableValue {
+
+private:
+    shared_ptr<const MappedFile> pinnedFile;
+    LsmValue ownedValue;
+    string_view view;
+
+public:
+    PinnableValue() = default;
+
+    // The view may point into `ownedValue`, so a handle is never copied or moved.
+    PinnableValue(const PinnableValue&) = delete;
+    PinnableValue& operator=(const PinnableValue&) = delete;
+
+    void pin(shared_ptr<const MappedFile> file, string_view value);
+    void assign(LsmValue&& value);
+    void reset();
+
+    bool isPinned() const;
+    string_view value() const;
+    size_t size() const;
+    string toString() const;
+};
+
+
+#endif //LSM_TREE_PINNABLEVALUE_H
@@ -0,0 +1,158 @@
+#include "RangeTombstone.h"
+
+void RangeTombstoneList::add(const RangeTombstone& tombstone) {
+    auto it = upper_bound(tombstones.begin(), tombstones.end(), tombstone.start,
+                          [](LsmKey start, const RangeTombstone& t) { return start < t.start; });
+    tombstones.insert(it, tombstone);
+    fragment();
+}
+
+void RangeTombstoneList::clear() {
+    tombstones.clear();
+    fragments.clear();
+}
+
+bool RangeTombstoneList::empty() const {
+    return tombstones.empty();
+}
+
+size_t RangeTombstoneList::size() const {
+    return tombstones.size();
+}
+
+const vector<RangeTombstone>& RangeTombstoneList::getTombstones() const {
+    return tombstones;
+}
+
+/**
+ * Split the tombstones at every start key and after every end key, so that
+ * each fragment is deleted by the same tombstones throughout. Keys are then
+ * looked up with a binary search instead of a scan of the whole list.
+ */
+void RangeTombstoneList::fragment() {
+    fragments.clear();
+
+    vector<LsmKey> bounds;      // The keys where a fragment may start.
+    for (const auto& tombstone : tombstones) {
+        bounds.push_back(tombstone.start);
+        if (tombstone.end != UINT64_MAX)
+            bounds.push_back(tombstone.end + 1);
+    }
+    sort(bounds.begin(), bounds.end());
+    bounds.erase(unique(bounds.begin(), bounds.end()), bounds.end());
+
+    vector<const RangeTombstone*> active;
+    size_t next = 0;
+    for (size_t i = 0; i < bounds.size(); ++i) {
+        LsmKey start = bounds[i];
+        for (; next < tombstones.size() && tombstones[next].start <= start; ++next)
+            active.push_back(&tombstones[next]);
+        active.erase(remove_if(active.begin(), active.end(),
+                               [&](const RangeTombstone* t) { return t->end < start; }), active.end());
+        if (active.empty())
+            continue;
+
+        // Every end key is followed by a bound, so only a fragment that
+        // reaches the largest key has no next bound.
+        Fragment piece{start, i + 1 < bounds.size() ? bounds[i + 1] - 1 : UINT64_MAX, {}};
+        for (const RangeTombstone* t : active)
+            piece.sequences.push_back(t->sequence);
+        sort(piece.sequences.begin(), piece.sequences.end(), greater<SequenceNumber>());
+        fragments.push_back(std::move(piece));
+    }
+}
+
+/**
+ * @return The fragment holding the key, or nullptr if no tombstone deletes it.
+ */
+const RangeTombstoneList::Fragment* RangeTombstoneList::findFragment(LsmKey key) const {
+    auto it = upper_bound(fragments.begin(), fragments.end(), key,
+                          [](LsmKey key, const Fragment& f) { return key < f.start; });
+    if (it == fragments.begin() || (--it)->end < key)
+        return nullptr;
+    return &*it;
+}
+
+/**
+ * @param sequence: Sequence number of an entry of the key.
+ * @param snapshot: Only tombstones written up to this sequence number are seen.
+ * @return true if a newer tombstone the snapshot sees deletes the entry.
+ */
+bool RangeTombstoneList::covers(LsmKey key, SequenceNumber sequence, SequenceNumber snapshot) const {
+    const Fragment* piece = findFragment(key);
+    if (!piece)
+        return false;
+    // The newest tombstone the snapshot sees.
+    auto it = lower_bound(piece->sequences.begin(), piece->sequences.end(), snapshot,
+                          greater<SequenceNumber>());
+    return it != piece->sequences.end() && sequence < *it;
+}
+
+/**
+ * Append the sequence numbers of the tombstones that delete the key and are
+ * newer than `sequence`.
+ */
+void RangeTombstoneList::getCoveringSequences(LsmKey key, SequenceNumber sequence,
+                                              vector<SequenceNumber>& sequences) const {
+    const Fragment* piece = findFragment(key);
+    if (!piece)
+        return;
+    for (SequenceNumber tombstoneSequence : piece->sequences) {
+        if (tombstoneSequence <= sequence)
+            break;
+        sequences.push_back(tombstoneSequence);
+    }
+}
+
+/**
+ * @return true if a tombstone newer than `sequence` deletes some key in [minKey, maxKey].
+ */
+bool RangeTombstoneList::overlaps(LsmKey minKey, LsmKey maxKey, SequenceNumber sequence) const {
+    auto it = lower_bound(fragments.begin(), fragments.end(), minKey,
+                          [](const Fragment& f, LsmKey key) { return f.end < key; });
+    for (; it != fragments.end() && it->start <= maxKey; ++it)
+        if (sequence < it->sequences.front())
+            return true;
+    return false;
+}
+
+SequenceNumber RangeTombstoneList::getMaxSequence() const {
+    SequenceNumber maxSequence = 0;
+    for (const auto& tombstone : tombstones)
+        maxSequence = max(maxSequence, tombstone.sequence);
+    return maxSequence;
+}
+
+/**
+ * Load the list written by `writeToFile`. A missing file is an empty list.
+ */
+void RangeTombstoneList::readFromFile(const string& filename) {
+    clear();
+
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in)
+        return;
+
+    uint64_t tombstoneNumber = 0;
+    in.read((char*)&tombstoneNumber, sizeof(tombstoneNumber));
+    tombstones.resize(tombstoneNumber);
+    in.read((char*)tombstones.data(), tombstoneNumber * sizeof(RangeTombstone));
+    if (!in) {
+        cerr << "Cannot read range tombstones from `" << filename << "`." << endl;
+        exit(-1);
+    }
+    fragment();
+}
+
+/**
+ * Write the number of tombstones followed by the tombstones. FileWriter
+ * renames the list over the old one once it is written, and syncs it first
+ * if asked to, so that a crash leaves either the old or the new list.
+ */
+void RangeTombstoneList::writeToFile(const string& filename, const FileWriteOptions& writeOptions) const {
+    uint64_t tombstoneNumber = tombstones.size();
+    FileWriter out(filename, writeOptions);
+    out.append(&tombstoneNumber, sizeof(tombstoneNumber));
+    out.append(tombstones.data(), tombstoneNumber * sizeof(RangeTombstone));
+    out.close();
+}
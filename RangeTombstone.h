@@ -0,0 +1,84 @@
+#ifndef LSM_TREE_RANGETOMBSTONE_H
+#define LSM_TREE_RANGETOMBSTONE_H
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "constants.h"
+#include "FileIO.h"
+
+using namespace std;
+
+/**
+ * Deletion of every key in [start, end] written before the tombstone: the
+ * entries whose sequence number is smaller than the one of the tombstone.
+ */
+struct RangeTombstone {
+    LsmKey start;
+    LsmKey end;
+    SequenceNumber sequence;
+
+    RangeTombstone() {}
+    RangeTombstone(LsmKey start, LsmKey end, SequenceNumber sequence)
+            : start(start), end(end), sequence(sequence) {}
+};
+
+/**
+ * All the range tombstones of a store, sorted by start key. The list is
+ * kept in one file and rewritten as a whole whenever it changes.
+ */
+class RangeTombstoneList {
+
+    /**
+     * A key range every key of which the same tombstones delete.
+     */
+    struct Fragment {
+        LsmKey start;
+        LsmKey end;
+        vector<SequenceNumber> sequences;   // From the newest to the oldest.
+    };
+
+private:
+    vector<RangeTombstone> tombstones;
+    vector<Fragment> fragments;     // Non-overlapping, sorted by start key.
+
+    void fragment();
+    const Fragment* findFragment(LsmKey key) const;
+
+public:
+    void add(const RangeTombstone& tombstone);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    const vector<RangeTombstone>& getTombstones() const;
+
+    bool covers(LsmKey key, SequenceNumber sequence, SequenceNumber snapshot = MAX_SEQUENCE_NUMBER) const;
+    void getCoveringSequences(LsmKey key, SequenceNumber sequence, vector<SequenceNumber>& sequences) const;
+    bool overlaps(LsmKey minKey, LsmKey maxKey, SequenceNumber sequence) const;
+    SequenceNumber getMaxSequence() const;
+
+    template<typename Predicate>
+    size_t removeIf(Predicate predicate);
+
+    void readFromFile(const string& filename);
+    void writeToFile(const string& filename, const FileWriteOptions& writeOptions = FileWriteOptions()) const;
+};
+
+/**
+ * Remove the tombstones that satisfy the predicate.
+ * @return The number of tombstones removed.
+ */
+template<typename Predicate>
+size_t RangeTombstoneList::removeIf(Predicate predicate) {
+    size_t size = tombstones.size();
+    tombstones.erase(remove_if(tombstones.begin(), tombstones.end(), predicate), tombstones.end());
+    if (tombstones.size() != size)
+        fragment();
+    return size - tombstones.size();
+}
+
+
+#endif //LSM_TREE_RANGETOMBSTONE_H
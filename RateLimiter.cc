@@ -0,0 +1,114 @@
+#include <algorithm>
+#include "RateLimiter.h"
+
+/**
+ * @param maxBytesPerSecond: Ceiling of the auto-tuned limit, or 0 for
+ * RATE_LIMITER_MAX_BOOST times `bytesPerSecond`.
+ */
+RateLimiter::RateLimiter(uint64_t bytesPerSecond, bool autoTune, uint64_t maxBytesPerSecond)
+        : bytesPerSecond(max<uint64_t>(bytesPerSecond, 1)), autoTune(autoTune),
+          maxBytesPerSecond(maxBytesPerSecond ? max(maxBytesPerSecond, this->bytesPerSecond)
+                                              : this->bytesPerSecond * RATE_LIMITER_MAX_BOOST),
+          currentBytesPerSecond(this->bytesPerSecond), availableBytes(0),
+          lastRefill(chrono::steady_clock::now()),
+          waiterNumbers{0, 0}, requestedBytes{0, 0}, throttledMicros{0, 0} {
+
+    availableBytes = getBurstBytes();
+}
+
+/**
+ * @return The tokens added every period, which is also the size of the bucket.
+ */
+uint64_t RateLimiter::getBurstBytes() const {
+    return max<uint64_t>(currentBytesPerSecond * RATE_LIMITER_REFILL_PERIOD_US / 1000000, 1);
+}
+
+void RateLimiter::refill() {
+    auto now = chrono::steady_clock::now();
+    double seconds = chrono::duration<double>(now - lastRefill).count();
+    lastRefill = now;
+    availableBytes = min(availableBytes + seconds * currentBytesPerSecond, (double)getBurstBytes());
+}
+
+/**
+ * Wait until `bytes` can be written, taking them from the bucket in pieces
+ * of at most one period of tokens. Call it around every background write.
+ * @return The microseconds spent waiting.
+ */
+uint64_t RateLimiter::request(uint64_t bytes, IOPriority priority) {
+
+    auto start = chrono::steady_clock::now();
+    unique_lock<mutex> guard(lock);
+    requestedBytes[priority] += bytes;
+
+    while (bytes > 0) {
+        uint64_t piece = min(bytes, getBurstBytes());
+        waiterNumbers[priority]++;
+        while (true) {
+            refill();
+            bool yield = priority == IO_LOW && waiterNumbers[IO_HIGH] > 0;
+            if (!yield && availableBytes >= piece)
+                break;
+
+            // Sleep until the bucket holds enough, or for a period if a flush goes first.
+            double missingBytes = yield ? getBurstBytes() : piece - availableBytes;
+            uint64_t micros = min<uint64_t>(missingBytes * 1000000 / currentBytesPerSecond + 1,
+                                            RATE_LIMITER_REFILL_PERIOD_US);
+            refilled.wait_for(guard, chrono::microseconds(micros));
+        }
+        waiterNumbers[priority]--;
+        availableBytes -= piece;
+        bytes -= piece;
+        refilled.notify_all();
+    }
+
+    uint64_t micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    throttledMicros[priority] += micros;
+    return micros;
+}
+
+/**
+ * Auto-tuned mode: add `bytesPerSecond` to the limit for every
+ * RATE_LIMITER_DEBT_STEP bytes that the compactions of all the stores are
+ * behind. No effect otherwise.
+ * @param store: Whose debt it is, replacing the debt it reported before.
+ * A store reports 0 once it is closed.
+ */
+void RateLimiter::setCompactionDebt(uint64_t pendingBytes, const void *store) {
+    if (!autoTune)
+        return;
+    lock_guard<mutex> guard(lock);
+    refill();
+    if (pendingBytes > 0)
+        compactionDebts[store] = pendingBytes;
+    else
+        compactionDebts.erase(store);
+
+    uint64_t totalBytes = 0;
+    for (const auto& debt : compactionDebts)
+        totalBytes += debt.second;
+    double boost = 1 + (double)totalBytes / RATE_LIMITER_DEBT_STEP;
+    currentBytesPerSecond = min<uint64_t>(bytesPerSecond * boost, maxBytesPerSecond);
+}
+
+uint64_t RateLimiter::getBytesPerSecond() const {
+    lock_guard<mutex> guard(lock);
+    return currentBytesPerSecond;
+}
+
+/**
+ * @return The bytes that background writes of the priority asked for.
+ */
+uint64_t RateLimiter::getRequestedBytes(IOPriority priority) const {
+    lock_guard<mutex> guard(lock);
+    return requestedBytes[priority];
+}
+
+/**
+ * @return The microseconds that background writes of the priority waited
+ * for tokens, summed over all the threads.
+ */
+uint64_t RateLimiter::getThrottledMicros(IOPriority priority) const {
+    lock_guard<mutex> guard(lock);
+    return throttledMicros[priority];
+}
@@ -0,0 +1,59 @@
+#ifndef LSM_TREE_RATELIMITER_H
+#define LSM_TREE_RATELIMITER_H
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include "constants.h"
+
+using namespace std;
+
+enum IOPriority {
+    IO_LOW = 0,     // Compactions and garbage collection of blob files.
+    IO_HIGH = 1     // memTable flushes, which writes may wait for.
+};
+
+/**
+ * A token bucket limiting the bytes written by the background work of one or
+ * more stores. Tokens are refilled every RATE_LIMITER_REFILL_PERIOD_US, and
+ * the bucket holds at most one period of tokens, so that idle time is not
+ * saved up into a burst. A waiting flush is served before any compaction.
+ *
+ * In the auto-tuned mode, the limit rises above `bytesPerSecond` with the
+ * compaction debt reported by the stores, summed over them, up to
+ * `maxBytesPerSecond`, so that compactions catch up instead of stalling writes.
+ */
+class RateLimiter {
+
+private:
+    const uint64_t bytesPerSecond;
+    const bool autoTune;
+    const uint64_t maxBytesPerSecond;
+    uint64_t currentBytesPerSecond;
+    unordered_map<const void*, uint64_t> compactionDebts;     // By store, none of them 0.
+    double availableBytes;
+    chrono::steady_clock::time_point lastRefill;
+    size_t waiterNumbers[2];
+    uint64_t requestedBytes[2];
+    uint64_t throttledMicros[2];
+    mutable mutex lock;
+    condition_variable refilled;
+
+    uint64_t getBurstBytes() const;
+    void refill();
+
+public:
+    explicit RateLimiter(uint64_t bytesPerSecond, bool autoTune = false, uint64_t maxBytesPerSecond = 0);
+
+    uint64_t request(uint64_t bytes, IOPriority priority);
+    void setCompactionDebt(uint64_t pendingBytes, const void *store = nullptr);
+
+    uint64_t getBytesPerSecond() const;
+    uint64_t getRequestedBytes(IOPriority priority) const;
+    uint64_t getThrottledMicros(IOPriority priority) const;
+};
+
+
+#endif //LSM_TREE_RATELIMITER_H
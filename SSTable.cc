@@ -1,132 +1,364 @@
+#include <cstring>
 #include "SSTable.h"
+#include "Checksum.h"
 
 
-SSTable::SSTable(size_t level, SSTHeader header, BloomFilter bloomFilter, vector<DataIndex> dataIndexes)
-        : level(level), header(header), bloomFilter(bloomFilter), dataIndexes(dataIndexes) {}
+SSTFooter::SSTFooter(const SSTHeader& header, const BloomFilter& bloomFilter,
+                     const vector<DataIndex>& dataIndexes, const vector<BlockHandle>& blockHandles)
+        : magicNumber(SST_MAGIC_NUMBER) {
+    bloomFilterChecksum = Checksum::crc32c(bloomFilter.byteArray, BLOOM_FILTER_SIZE);
+    indexChecksum = Checksum::crc32c(&header, HEADER_SIZE);
+    for (const auto& dataIndex : dataIndexes)
+        indexChecksum = Checksum::crc32c(&dataIndex, DATA_INDEX_SIZE, indexChecksum);
+    indexChecksum = Checksum::crc32c(blockHandles.data(), BLOCK_HANDLE_SIZE * blockHandles.size(), indexChecksum);
+}
 
-LsmValue SSTable::get(LsmKey k) const {
-    if (!bloomFilter.hasKey(k))
-        return "";
-    int64_t index = find(k, dataIndexes, 0, header.keyNumber - 1);
-    if (index < 0)
-        return "";
-    return getValueFromDisk(index);
+bool SSTFooter::operator==(const SSTFooter& footer) const {
+    return bloomFilterChecksum == footer.bloomFilterChecksum && indexChecksum == footer.indexChecksum
+           && magicNumber == footer.magicNumber;
 }
 
+
 /**
- * Do not exactly return the target data index.
- * If the key cannot be found, `find` returns whatever is at the end of the recursion.
+ * An SST whose metadata is all in memory.
+ * @param blockHandles: The handles of the blocks of values.
  */
-int64_t SSTable::find(LsmKey k, vector<DataIndex> arr, int64_t start, int64_t end) const {
+SSTable::SSTable(string dataDir, size_t level, SSTHeader header, BloomFilter bloomFilter,
+                 vector<DataIndex> dataIndexes, uint32_t fileSize, vector<BlockHandle> blockHandles)
+        : dataDir(std::move(dataDir)), level(level), header(header), fileSize(fileSize), verification(VERIFY_NOTHING),
+          bloomFilter(bloomFilter), dataIndexes(std::move(dataIndexes)), blockHandles(std::move(blockHandles)),
+          metadataLoaded(true) {
+    indexBlocks();
+}
 
-    if (start >= end && arr[start].key != k)
-        return -1;
+/**
+ * An SST of which only the header is read, the rest of its metadata being
+ * read from the file when first needed.
+ * @param verification: What to check the metadata against its checksums for.
+ */
+SSTable::SSTable(string dataDir, size_t level, SSTHeader header, uint32_t fileSize,
+                 ChecksumVerification verification)
+        : dataDir(std::move(dataDir)), level(level), header(header), fileSize(fileSize), verification(verification),
+          dataEnd(0), metadataLoaded(false) {}
 
-    uint64_t mid = start + (end - start) / 2;
-    if (k < arr[mid].key)
-        return find(k, arr, start, mid-1);
-    if (k > arr[mid].key)
-        return find(k, arr, mid+1, end);
+/**
+ * Read the metadata in two reads, one of the bloom filter and data indexes
+ * after the header, and one of the block handles and footer closing the
+ * file. Several threads may ask for it at once.
+ */
+void SSTable::readMetadata() const {
+    lock_guard<mutex> lock(metadataMutex);
+    if (metadataLoaded.load(memory_order_relaxed))
+        return;
 
-    return mid;  // found
+    string filename = getFilename();
+    ifstream sstFile(filename, ios::binary | ios::in);
+    if (!sstFile) {
+        cerr << "Cannot open file `" << filename << "`." << endl;
+        exit(-1);
+    }
 
+    string buffer(BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * header.keyNumber, '\0');
+    sstFile.seekg(HEADER_SIZE, ios::beg);
+    sstFile.read(&buffer[0], buffer.size());
+    memcpy(bloomFilter.byteArray, buffer.data(), BLOOM_FILTER_SIZE);
+    dataIndexes.resize(header.keyNumber);
+    for (size_t i = 0; i < header.keyNumber; ++i)
+        memcpy((char*)&dataIndexes[i], buffer.data() + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * i, DATA_INDEX_SIZE);
+
+    buffer.resize(BLOCK_HANDLE_SIZE * header.blockNumber + SST_FOOTER_SIZE);
+    sstFile.seekg(fileSize - buffer.size(), ios::beg);
+    sstFile.read(&buffer[0], buffer.size());
+    blockHandles.resize(header.blockNumber);
+    memcpy(blockHandles.data(), buffer.data(), BLOCK_HANDLE_SIZE * header.blockNumber);
+    SSTFooter footer;
+    memcpy(&footer, buffer.data() + BLOCK_HANDLE_SIZE * header.blockNumber, SST_FOOTER_SIZE);
+
+    if (!sstFile || (verification != VERIFY_NOTHING
+                     && !(footer == SSTFooter(header, bloomFilter, dataIndexes, blockHandles)))) {
+        cerr << "Corrupted metadata in file `" << filename << "`." << endl;
+        exit(-1);
+    }
+
+    indexBlocks();
+    metadataLoaded.store(true, memory_order_release);
 }
 
-LsmValue SSTable::getValueFromDisk(size_t index) const {
+/**
+ * Give an SST without blocks a single empty one, and find where its values end.
+ */
+void SSTable::indexBlocks() const {
+    uint32_t dataStart = HEADER_SIZE + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * header.keyNumber;
+    if (blockHandles.empty()) {
+        dataEnd = dataStart;
+        blockHandles.emplace_back(dataStart, dataStart, 0, 0, Checksum::crc32c(nullptr, 0));
+    } else {
+        const BlockHandle& lastBlock = blockHandles.back();
+        dataEnd = lastBlock.offset + lastBlock.rawSize;
+    }
+}
 
-    string filename = getFilename();
+bool SSTable::isMetadataLoaded() const {
+    return metadataLoaded.load(memory_order_acquire);
+}
 
-    // Open the SST file.
-    ifstream table(filename, ios::in | ios::binary);
-    if (!table) {
-        cerr << "Cannot open file `" << filename << "`." << endl;
+/**
+ * @param snapshot: Only versions written up to this sequence number are seen.
+ * @param entry: Set to the newest version of the key the snapshot sees, which
+ * may be a deletion.
+ * @return false if the SST holds no such version.
+ */
+bool SSTable::get(LsmKey k, SequenceNumber snapshot, LsmEntry& entry) const {
+    int64_t index = find(k, snapshot);
+    if (index < 0)
+        return false;
+    entry.type = dataIndexes[index].type;
+    entry.sequence = dataIndexes[index].sequence;
+    LsmValue buffer;
+    entry.value.assign(getValueView(index, buffer));
+    return true;
+}
+
+/**
+ * Like `get`, but pin the value in the mapping of the file instead of copying
+ * it into `entry`, unless it has to be uncompressed.
+ */
+bool SSTable::get(LsmKey k, SequenceNumber snapshot, LsmEntry& entry, PinnableValue& value) const {
+    int64_t index = find(k, snapshot);
+    if (index < 0)
+        return false;
+    entry.type = dataIndexes[index].type;
+    entry.sequence = dataIndexes[index].sequence;
+    LsmValue buffer;
+    string_view view = getValueView(index, buffer);
+    if (buffer.empty())
+        value.pin(getMappedFile(), view);
+    else
+        value.assign(LsmValue(view));
+    return true;
+}
+
+/**
+ * Check the key range and the bloom filter without reading the disk.
+ * @return false if the key is surely not in the SST.
+ */
+bool SSTable::mayContain(LsmKey k) const {
+    if (k < header.minKey || k > header.maxKey)
+        return false;
+    loadMetadata();
+    return bloomFilter.hasKey(k);
+}
+
+/**
+ * @return The index of the newest version of the key written up to the
+ * snapshot, or -1 if there is none.
+ */
+int64_t SSTable::find(LsmKey k, SequenceNumber snapshot) const {
+    if (!mayContain(k))
+        return -1;
+    size_t index = lowerBound(k);
+    while (index < dataIndexes.size() && dataIndexes[index].key == k) {
+        if (dataIndexes[index].sequence <= snapshot)
+            return index;
+        index++;
+    }
+    return -1;
+}
+
+/**
+ * Map the file on the first call. Several threads may read the SST at once.
+ */
+const shared_ptr<const MappedFile>& SSTable::getMappedFile() const {
+    call_once(mapOnce, [this] { mappedFile = MappedFile::open(getFilename()); });
+    return mappedFile;
+}
+
+/**
+ * @return Where the value at `index` ends, counted like DataIndex::offset.
+ */
+uint32_t SSTable::getValueEnd(size_t index) const {
+    return index + 1 < dataIndexes.size() ? dataIndexes[index + 1].offset : dataEnd;
+}
+
+/**
+ * @return The index of the block holding the value that starts at `offset`.
+ */
+size_t SSTable::findBlock(uint32_t offset) const {
+    auto it = upper_bound(blockHandles.cbegin(), blockHandles.cend(), offset,
+                          [](uint32_t offset, const BlockHandle& handle) { return offset < handle.offset; });
+    return it == blockHandles.cbegin() ? 0 : it - blockHandles.cbegin() - 1;
+}
+
+/**
+ * Stop if the bytes of the block read from the file are not the ones written.
+ */
+void SSTable::checkBlock(const BlockHandle& handle, string_view stored) const {
+    if (stored.size() != handle.size || Checksum::crc32c(stored) != handle.checksum) {
+        cerr << "Corrupted block in file `" << getFilename() << "`." << endl;
         exit(-1);
     }
+}
+
+/**
+ * @return The values of the block, pointing into the mapping of the file if
+ * the block is not compressed, or into `buffer` it is uncompressed into.
+ */
+string_view SSTable::getBlockView(size_t block, LsmValue& buffer) const {
+    const BlockHandle& handle = blockHandles[block];
+    string_view stored(getMappedFile()->getData() + handle.fileOffset, handle.size);
+    checkBlock(handle, stored);
+    if (!handle.isCompressed())
+        return stored;
+    Compression::uncompress(header.compression, stored, handle.rawSize, buffer);
+    return buffer;
+}
 
-    // Find the start and end of the value.
+/**
+ * @return The value at `index`, pointing into the mapping of the file, or
+ * into `buffer` if its block has to be uncompressed.
+ */
+string_view SSTable::getValueView(size_t index, LsmValue& buffer) const {
     uint32_t start = dataIndexes[index].offset;
-    uint32_t end;
-    if (index != dataIndexes.size() - 1)
-        end = dataIndexes[index + 1].offset;
-    else {      // If `key` is the last key, set `end` as the length of the file.
-        table.seekg(0, ios::end);
-        end = table.tellg();
-    }
+    uint32_t end = getValueEnd(index);
+    if (start == end)
+        return string_view();
+    size_t block = findBlock(start);
+    return getBlockView(block, buffer).substr(start - blockHandles[block].offset, end - start);
+}
 
-    // Read value from the file.
-    LsmValue value = readValueFromFile(table, start, end, false);
+/**
+ * Read all the key-value pairs of the SST from the disk without frequently altering
+ * file position. The result is appended to `entries` in key order, every
+ * version of a key from the newest to the oldest.
+ * @param directIO: Read bypassing the page cache, as compactions do.
+ */
+void SSTable::getValuesFromDisk(vector<pair<LsmKey, LsmEntry>>& entries, bool directIO) const {
+    loadMetadata();
+    readEntriesFromFile(0, dataIndexes.size(), entries, directIO);
+}
 
-    // Close the file.
-    table.close();
+/**
+ * Append where the values of the entries kept in blob files lie. Only those
+ * entries are read, from the mapping of the file.
+ */
+void SSTable::getBlobIndexes(vector<BlobIndex>& indexes) const {
+    loadMetadata();
+    LsmValue buffer;
+    size_t bufferedBlock = blockHandles.size();
+    string_view blockView;
+    for (size_t i = 0; i < dataIndexes.size(); ++i) {
+        if (dataIndexes[i].type != TYPE_BLOB_INDEX)
+            continue;
+        uint32_t start = dataIndexes[i].offset;
+        size_t block = findBlock(start);
+        if (block != bufferedBlock) {
+            blockView = getBlockView(block, buffer);
+            bufferedBlock = block;
+        }
+        indexes.push_back(BlobIndex::decode(blockView.substr(start - blockHandles[block].offset,
+                                                             getValueEnd(i) - start)));
+    }
+}
+
+/**
+ * Read every version of the keys in [start, end] from the disk in key order.
+ */
+void SSTable::scan(LsmKey start, LsmKey end, vector<pair<LsmKey, LsmEntry>>& entries) const {
 
-    return value;
+    size_t first = lowerBound(start);
+    size_t last = first;
+    while (last < dataIndexes.size() && dataIndexes[last].key <= end)
+        last++;
+    readEntriesFromFile(first, last, entries);
 }
 
 /**
- * Read all the key-value pairs of the SST from the disk without frequently altering
- * file position. The result is stored in sstData.
+ * Read the entries in [first, last) with their values from the file, block
+ * by block. Each block is read whole, checked, and uncompressed once if it
+ * is compressed.
  */
-void SSTable::getValuesFromDisk(KVPair& sstData) const {
+void SSTable::readEntriesFromFile(size_t first, size_t last, vector<pair<LsmKey, LsmEntry>>& entries,
+                                  bool directIO) const {
+
+    if (first == last)
+        return;
 
     string filename = getFilename();
-    ifstream table(filename, ios::in | ios::binary);
-    if (!table) {
-        cerr << "Cannot open file `" << filename << "`." << endl;
-        exit(-1);
+    FileReader table(filename, directIO);
+
+    LsmValue raw;
+    size_t i = first;
+    while (i < last) {
+
+        // The entries whose values lie in the block of the value at `i`.
+        size_t block = findBlock(dataIndexes[i].offset);
+        const BlockHandle& handle = blockHandles[block];
+        size_t j = i;
+        while (j < last && getValueEnd(j) <= handle.offset + handle.rawSize)
+            j++;
+        if (j == i) {
+            cerr << "Corrupted file `" << filename << "`." << endl;
+            exit(-1);
+        }
+
+        string_view data = table.read(handle.fileOffset, handle.size);
+        checkBlock(handle, data);
+        if (handle.isCompressed()) {
+            Compression::uncompress(header.compression, data, handle.rawSize, raw);
+            data = raw;
+        }
+
+        for (; i < j; ++i) {
+            const DataIndex& dataIndex = dataIndexes[i];
+            LsmValue value(data.substr(dataIndex.offset - handle.offset, getValueEnd(i) - dataIndex.offset));
+            entries.emplace_back(dataIndex.key, LsmEntry{dataIndex.type, std::move(value), dataIndex.sequence});
+        }
     }
+}
 
-    table.seekg(0, ios::end);
-    uint32_t fileLength = table.tellg();
-
-    uint32_t dataStart = HEADER_SIZE + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * header.keyNumber;
-    table.seekg(dataStart, ios::beg);
-
-    uint32_t start = dataStart;
-    uint32_t end;
-
-    auto it = dataIndexes.cbegin();
-    LsmKey key = (*it).key;
-    it++;
-    while (it != dataIndexes.cend()) {
-        end = (*it).offset;
-        LsmValue value = readValueFromFile(table, start, end, true);
-        sstData[key] = value;
-        start = end;
-        key = (*it).key;    // Get key for the next loop.
-        it++;
+/**
+ * Read the whole file and check the metadata and every block against their
+ * checksums, without stopping at the first one that does not match.
+ * @return false if the file is corrupted.
+ */
+bool SSTable::verifyChecksums(bool directIO) const {
+    loadMetadata();
+    FileReader table(getFilename(), directIO);
+
+    uint32_t indexChecksum = Checksum::crc32c(table.read(0, HEADER_SIZE));
+    uint32_t bloomFilterChecksum = Checksum::crc32c(table.read(HEADER_SIZE, BLOOM_FILTER_SIZE));
+    indexChecksum = Checksum::crc32c(table.read(HEADER_SIZE + BLOOM_FILTER_SIZE, DATA_INDEX_SIZE * header.keyNumber),
+                                     indexChecksum);
+    bool blocksMatch = true;
+    if (header.blockNumber > 0) {
+        for (const auto& handle : blockHandles)
+            blocksMatch = Checksum::crc32c(table.read(handle.fileOffset, handle.size)) == handle.checksum
+                          && blocksMatch;
     }
+    uint32_t handleStart = fileSize - SST_FOOTER_SIZE - BLOCK_HANDLE_SIZE * header.blockNumber;
+    indexChecksum = Checksum::crc32c(table.read(handleStart, BLOCK_HANDLE_SIZE * header.blockNumber), indexChecksum);
 
-    // Set the last k-v pair.
-    end = fileLength;
-    LsmValue value = readValueFromFile(table, start, end, true);
-    sstData[key] = value;
+    SSTFooter footer;
+    memcpy(&footer, table.read(fileSize - SST_FOOTER_SIZE, SST_FOOTER_SIZE).data(), SST_FOOTER_SIZE);
+    return blocksMatch && bloomFilterChecksum == footer.bloomFilterChecksum
+           && indexChecksum == footer.indexChecksum && footer.magicNumber == SST_MAGIC_NUMBER;
 }
 
 /**
- * Read a singleton value from an open SST file based on its offset.
- * @param file: An open SST file.
- * @param startOffset: The start offset of the value in the file.
- * @param endOffset: The end offset of the value in the file.
- * @param multiValue: Set true if reading a contiguous sequence of values. Set false otherwise.
- * Note that the start position must have been specified before if the param is set true.
- * @return The value read from the file.
+ * @return The same SST placed in another level. The file is not moved.
  */
-LsmValue SSTable::readValueFromFile(ifstream& table, uint32_t startOffset, uint32_t endOffset, bool multiValue) {
-    LsmValue value;
-    uint32_t length = endOffset - startOffset;
-    value.resize(length);
-    if (!multiValue)
-        table.seekg(startOffset, ios::beg);
-    table.read((char*)&value[0], length);
-    return value;
+shared_ptr<SSTable> SSTable::withLevel(size_t newLevel) const {
+    loadMetadata();
+    return make_shared<SSTable>(dataDir, newLevel, header, bloomFilter, dataIndexes, fileSize,
+                                header.blockNumber > 0 ? blockHandles : vector<BlockHandle>());
 }
 
-
 string SSTable::getFilename() const {
-    return "./data/level-" + to_string(level)
+    return dataDir + "level-" + to_string(level)
            + "/table-" + to_string(header.timeStamp)
            + "-" + to_string(header.minKey)
            + "-" + to_string(header.maxKey)
+           + "-" + to_string(header.fileNumber)
            + ".sst";
 }
 
@@ -138,6 +370,10 @@ TimeStamp SSTable::getTimeStamp() const {
     return header.timeStamp;
 }
 
+uint64_t SSTable::getFileNumber() const {
+    return header.fileNumber;
+}
+
 LsmKey SSTable::getMinKey() const {
     return header.minKey;
 }
@@ -150,11 +386,49 @@ size_t SSTable::getKeyNumber() const {
     return header.keyNumber;
 }
 
-vector<DataIndex> SSTable::getDataIndexes() const {
+uint64_t SSTable::getTombstoneNumber() const {
+    return header.tombstoneNumber;
+}
+
+SequenceNumber SSTable::getMinSequence() const {
+    return header.minSequence;
+}
+
+SequenceNumber SSTable::getMaxSequence() const {
+    return header.maxSequence;
+}
+
+CompressionType SSTable::getCompression() const {
+    return header.compression;
+}
+
+uint32_t SSTable::getFileSize() const {
+    return fileSize;
+}
+
+const vector<DataIndex>& SSTable::getDataIndexes() const {
+    loadMetadata();
     return dataIndexes;
 }
 
+LsmKey SSTable::getKey(size_t index) const {
+    loadMetadata();
+    return dataIndexes[index].key;
+}
+
+/**
+ * @return The index of the first key that is not smaller than k, or the
+ * number of keys if there is none.
+ */
+size_t SSTable::lowerBound(LsmKey k) const {
+    loadMetadata();
+    auto it = lower_bound(dataIndexes.cbegin(), dataIndexes.cend(), k,
+                          [](const DataIndex& dataIndex, LsmKey key) { return dataIndex.key < key; });
+    return it - dataIndexes.cbegin();
+}
+
 vector<LsmKey> SSTable::getKeys() const {
+    loadMetadata();
     vector<LsmKey> keys;
     for (const auto& dataIndex : dataIndexes) {
         keys.push_back(dataIndex.key);
@@ -5,66 +5,164 @@
 #include <fstream>
 #include <vector>
 #include <memory>
+#include <algorithm>
 #include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <string_view>
 #include "BloomFilter.h"
+#include "MappedFile.h"
+#include "PinnableValue.h"
+#include "BlobStore.h"
+#include "Block.h"
+#include "FileIO.h"
+#include "Options.h"
 #include "constants.h"
 
 using namespace std;
 
+// `keyNumber` counts the entries, so a key with several versions counts more than once.
+// `blockNumber` is 0 only if every value is empty.
 struct SSTHeader {
     TimeStamp timeStamp;
     size_t keyNumber;
     LsmKey minKey;
     LsmKey maxKey;
+    uint64_t tombstoneNumber;
+    SequenceNumber minSequence;
+    SequenceNumber maxSequence;
+    CompressionType compression;
+    uint8_t padding[3] = {};    // Zeroed, since the header is written and checksummed as it is.
+    uint32_t blockNumber;
+    uint64_t fileNumber;        // Unique in the store, so that a new SST never takes the name of a live one.
 
     SSTHeader() {}
-    SSTHeader(TimeStamp timeStamp, size_t keyNumber,
-              LsmKey minKey, LsmKey maxKey)
+    SSTHeader(TimeStamp timeStamp, size_t keyNumber, LsmKey minKey, LsmKey maxKey,
+              uint64_t tombstoneNumber, SequenceNumber minSequence, SequenceNumber maxSequence,
+              CompressionType compression, uint32_t blockNumber, uint64_t fileNumber)
             : timeStamp(timeStamp), keyNumber(keyNumber),
-              minKey(minKey), maxKey(maxKey) {}
+              minKey(minKey), maxKey(maxKey), tombstoneNumber(tombstoneNumber),
+              minSequence(minSequence), maxSequence(maxSequence),
+              compression(compression), blockNumber(blockNumber), fileNumber(fileNumber) {}
 };
 
+// Stored as the first DATA_INDEX_SIZE bytes of the struct. The versions of a
+// key are stored from the newest to the oldest.
 struct DataIndex {
     LsmKey key;
+    SequenceNumber sequence;
     uint32_t offset;
+    ValueType type;
 
     DataIndex() {}
-    DataIndex(LsmKey key, uint32_t offset)
-            : key(key), offset(offset) {}
+    DataIndex(LsmKey key, SequenceNumber sequence, uint32_t offset, ValueType type)
+            : key(key), sequence(sequence), offset(offset), type(type) {}
+};
+
+// Closes an SST, after the block handles, so that the metadata read when
+// the SST is opened can be checked without reading the values.
+struct SSTFooter {
+    uint32_t bloomFilterChecksum;
+    uint32_t indexChecksum;     // CRC32C of the header, data indexes and block handles.
+    uint64_t magicNumber;
+
+    SSTFooter() {}
+    SSTFooter(const SSTHeader& header, const BloomFilter& bloomFilter,
+              const vector<DataIndex>& dataIndexes, const vector<BlockHandle>& blockHandles);
+
+    bool operator==(const SSTFooter& footer) const;
 };
 
 typedef shared_ptr<unordered_map<LsmKey, LsmValue>> DataPtr;
 
+/**
+ * An SST opened from its file may only hold its header at first. The rest
+ * of its metadata, the bloom filter, data indexes and block handles, is then
+ * read on first use, or by another thread warming it up, whichever comes
+ * first. Outside the key range of the SST, nothing is read.
+ */
 class SSTable {
 
 private:
+    const string dataDir;       // Of the store, holding a directory for each level.
     const size_t level;
     const SSTHeader header;
-    const BloomFilter bloomFilter;
-    const vector<DataIndex> dataIndexes;
-
-    int64_t find(LsmKey k, vector<DataIndex> arr, int64_t start, int64_t end) const;
-    LsmValue getValueFromDisk(size_t index) const;
-    static LsmValue readValueFromFile(ifstream& table, uint32_t startOffset, uint32_t endOffset, bool multiValue) ;
+    const uint32_t fileSize;
+    const ChecksumVerification verification;    // Of the metadata, when it is read.
+
+    // Set once, by the constructor or by `readMetadata`.
+    mutable BloomFilter bloomFilter;
+    mutable vector<DataIndex> dataIndexes;
+    mutable vector<BlockHandle> blockHandles;   // An SST without blocks gets a single empty one.
+    mutable uint32_t dataEnd;                   // Where the last value ends, counted like DataIndex::offset.
+    mutable atomic<bool> metadataLoaded;
+    mutable mutex metadataMutex;
+
+    // Mapped on the first point read, and read by point reads only.
+    mutable shared_ptr<const MappedFile> mappedFile;
+    mutable once_flag mapOnce;
+
+    void readMetadata() const;
+    void indexBlocks() const;
+    int64_t find(LsmKey k, SequenceNumber snapshot) const;
+    const shared_ptr<const MappedFile>& getMappedFile() const;
+    uint32_t getValueEnd(size_t index) const;
+    size_t findBlock(uint32_t offset) const;
+    void checkBlock(const BlockHandle& handle, string_view stored) const;
+    string_view getBlockView(size_t block, LsmValue& buffer) const;
+    string_view getValueView(size_t index, LsmValue& buffer) const;
+    void readEntriesFromFile(size_t first, size_t last, vector<pair<LsmKey, LsmEntry>>& entries,
+                             bool directIO = false) const;
 
 public:
-    SSTable(size_t level,
+    SSTable(string dataDir,
+            size_t level,
             SSTHeader sstHeader,
             BloomFilter bloomFilter,
-            vector<DataIndex> dataIndexes);
-
-    LsmValue get(LsmKey k) const;
+            vector<DataIndex> dataIndexes,
+            uint32_t fileSize,
+            vector<BlockHandle> blockHandles = vector<BlockHandle>());
+    SSTable(string dataDir, size_t level, SSTHeader sstHeader, uint32_t fileSize,
+            ChecksumVerification verification);
+
+    void loadMetadata() const;
+    bool isMetadataLoaded() const;
+
+    bool get(LsmKey k, SequenceNumber snapshot, LsmEntry& entry) const;
+    bool get(LsmKey k, SequenceNumber snapshot, LsmEntry& entry, PinnableValue& value) const;
+    bool mayContain(LsmKey k) const;
     size_t getLevel() const;
     TimeStamp getTimeStamp() const;
+    uint64_t getFileNumber() const;
     LsmKey getMinKey() const;
     LsmKey getMaxKey() const;
     size_t getKeyNumber() const;
-    vector<DataIndex> getDataIndexes() const;
+    uint64_t getTombstoneNumber() const;
+    SequenceNumber getMinSequence() const;
+    SequenceNumber getMaxSequence() const;
+    CompressionType getCompression() const;
+    uint32_t getFileSize() const;
+    const vector<DataIndex>& getDataIndexes() const;
+    LsmKey getKey(size_t index) const;
+    size_t lowerBound(LsmKey k) const;
     string getFilename() const;
     vector<LsmKey> getKeys() const;
-    void getValuesFromDisk(KVPair& sstData) const;
+    void getValuesFromDisk(vector<pair<LsmKey, LsmEntry>>& entries, bool directIO = false) const;
+    void getBlobIndexes(vector<BlobIndex>& indexes) const;
+    bool verifyChecksums(bool directIO = false) const;
+    void scan(LsmKey start, LsmKey end, vector<pair<LsmKey, LsmEntry>>& entries) const;
+    shared_ptr<SSTable> withLevel(size_t newLevel) const;
 };
 
+/**
+ * Make sure the metadata is in memory, reading it from the file if the SST
+ * was opened lazily. Cheap once it is.
+ */
+inline void SSTable::loadMetadata() const {
+    if (!metadataLoaded.load(memory_order_acquire))
+        readMetadata();
+}
+
 typedef shared_ptr<SSTable> SSTPtr;
 typedef pair<SSTPtr, size_t> KeyRef;
 
@@ -88,16 +186,16 @@ struct SSTKeyPriorComparator {
 
 struct KeyRefGreaterThan {
     bool operator() (const KeyRef& ref1, const KeyRef& ref2) {
-        LsmKey key1 = (ref1.first)->getDataIndexes()[ref1.second].key;
-        LsmKey key2 = (ref2.first)->getDataIndexes()[ref2.second].key;
+        LsmKey key1 = (ref1.first)->getKey(ref1.second);
+        LsmKey key2 = (ref2.first)->getKey(ref2.second);
         return key1 > key2;
     }
 };
 
 struct KeyRefLessThan {
     bool operator() (const KeyRef& ref1, const KeyRef& ref2) {
-        LsmKey key1 = (ref1.first)->getDataIndexes()[ref1.second].key;
-        LsmKey key2 = (ref2.first)->getDataIndexes()[ref2.second].key;
+        LsmKey key1 = (ref1.first)->getKey(ref1.second);
+        LsmKey key2 = (ref2.first)->getKey(ref2.second);
         return key1 < key2;
     }
 };
@@ -0,0 +1,327 @@
+#include <fstream>
+#include "ShardedKVStore.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Open or create the shards under `dir`, each in `dir/shard-<n>`. A store
+ * must be reopened with the shard number and partitioning it was created
+ * with, which are kept in `dir/shards`.
+ * @param options: Given to every shard. A compaction strategy keeps state,
+ * so it cannot be set.
+ */
+ShardedKVStore::ShardedKVStore(const std::string &dir, size_t shardNumber, ShardPartitioning partitioning,
+                               const Options& options)
+        : KVStoreAPI(dir), dataDir(dir.empty() || dir.back() == '/' ? dir : dir + "/"),
+          partitioning(partitioning)
+{
+    if (shardNumber == 0) {
+        cerr << "A sharded store needs at least one shard." << endl;
+        exit(-1);
+    }
+    if (options.compactionStrategy) {
+        cerr << "A compaction strategy cannot be shared between shards." << endl;
+        exit(-1);
+    }
+
+    if (!utils::dirExists(dataDir))
+        utils::mkdir(dataDir.c_str());
+    checkLayout(shardNumber);
+
+    vector<size_t> shardIndexes;
+    for (size_t i = 0; i < shardNumber; ++i) {
+        shards.push_back(make_unique<Shard>());
+        shards[i]->worker = thread(&ShardedKVStore::runWorker, this, ref(*shards[i]), i);
+        shardIndexes.push_back(i);
+    }
+
+    // Open the shards in parallel.
+    forEachShard(shardIndexes, [&](size_t i) {
+        shards[i]->store = make_unique<KVStore>(dataDir + "shard-" + to_string(i), options);
+    });
+}
+
+/**
+ * Close the shards in parallel once their queued writes are applied, each
+ * flushing its memTable, then stop the workers.
+ */
+ShardedKVStore::~ShardedKVStore() {
+    vector<size_t> shardIndexes;
+    for (size_t i = 0; i < shards.size(); ++i)
+        shardIndexes.push_back(i);
+    forEachShard(shardIndexes, [&](size_t i) {
+        shards[i]->store.reset();
+    });
+
+    for (auto& shard : shards) {
+        {
+            lock_guard<mutex> lock(shard->taskMutex);
+            shard->stopping = true;
+        }
+        shard->taskAdded.notify_one();
+        shard->worker.join();
+    }
+}
+
+/**
+ * Record the shard number and partitioning of a new store, or check them
+ * against those of an existing one, whose keys would be looked up in the
+ * wrong shards otherwise.
+ */
+void ShardedKVStore::checkLayout(size_t shardNumber) const {
+    string filename = dataDir + "shards";
+    ifstream in(filename);
+    if (!in) {
+        ofstream out(filename);
+        out << shardNumber << " " << (int)partitioning << endl;
+        if (!out) {
+            cerr << "Cannot write file `" << filename << "`." << endl;
+            exit(-1);
+        }
+        return;
+    }
+
+    size_t storedNumber;
+    int storedPartitioning;
+    if (!(in >> storedNumber >> storedPartitioning)) {
+        cerr << "Corrupted file `" << filename << "`." << endl;
+        exit(-1);
+    }
+    if (storedNumber != shardNumber || storedPartitioning != (int)partitioning) {
+        cerr << "Store `" << dataDir << "` has " << storedNumber << " shards partitioned by "
+             << (storedPartitioning == HASH_PARTITIONING ? "hash" : "range") << "." << endl;
+        exit(-1);
+    }
+}
+
+/**
+ * Run the tasks posted to the shard, on the `index`-th core the process may
+ * run on, modulo their number.
+ */
+void ShardedKVStore::runWorker(Shard& shard, size_t index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0) {
+        size_t target = index % CPU_COUNT(&allowed);
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (!CPU_ISSET(cpu, &allowed) || target--)
+                continue;
+            cpu_set_t core;
+            CPU_ZERO(&core);
+            CPU_SET(cpu, &core);
+            pthread_setaffinity_np(pthread_self(), sizeof(core), &core);    // Unpinned if it fails.
+            break;
+        }
+    }
+#endif
+
+    while (true) {
+        packaged_task<void()> task;
+        unique_lock<mutex> storeLock(shard.storeMutex, defer_lock);
+        {
+            unique_lock<mutex> lock(shard.taskMutex);
+            shard.taskAdded.wait(lock, [&shard] { return shard.stopping || !shard.tasks.empty(); });
+            if (shard.tasks.empty())
+                return;
+            task = std::move(shard.tasks.front());
+            shard.tasks.pop_front();
+            storeLock.lock();   // Before the queue looks empty to `read`.
+        }
+        shard.taskTaken.notify_all();
+        task();
+    }
+}
+
+/**
+ * @return The shard holding the key.
+ */
+size_t ShardedKVStore::getShard(uint64_t key) const {
+    if (partitioning == RANGE_PARTITIONING)
+        return (unsigned __int128)key * shards.size() >> 64;
+
+    // Mix every bit of the key into the low bits, so that close keys spread.
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key % shards.size();
+}
+
+/**
+ * @return The shards that may hold keys in [start, end], in the order of their keys.
+ */
+vector<size_t> ShardedKVStore::getShards(uint64_t start, uint64_t end) const {
+    vector<size_t> shardIndexes;
+    size_t first = 0, last = shards.size() - 1;
+    if (partitioning == RANGE_PARTITIONING) {
+        first = getShard(start);
+        last = getShard(end);
+    }
+    for (size_t i = first; i <= last; ++i)
+        shardIndexes.push_back(i);
+    return shardIndexes;
+}
+
+/**
+ * Queue the task for the worker of the shard, first waiting while
+ * SHARD_MAX_QUEUED_TASKS tasks are queued on it.
+ * @return Ready once the task has run.
+ */
+future<void> ShardedKVStore::post(Shard& shard, function<void()> task) {
+    packaged_task<void()> shardTask(std::move(task));
+    future<void> result = shardTask.get_future();
+    {
+        unique_lock<mutex> lock(shard.taskMutex);
+        shard.taskTaken.wait(lock, [&shard] { return shard.tasks.size() < SHARD_MAX_QUEUED_TASKS; });
+        shard.tasks.push_back(std::move(shardTask));
+    }
+    shard.taskAdded.notify_one();
+    return result;
+}
+
+/**
+ * Run the task on the calling thread if nothing is queued on the shard,
+ * sparing the hand-off to its worker. Otherwise run it on the worker after
+ * the queued writes, which it must see. Either way, wait for it.
+ */
+void ShardedKVStore::read(Shard& shard, const function<void()>& task) {
+    {
+        unique_lock<mutex> lock(shard.taskMutex);
+        if (shard.tasks.empty()) {
+            lock_guard<mutex> storeLock(shard.storeMutex);
+            lock.unlock();
+            task();
+            return;
+        }
+    }
+    post(shard, task).get();
+}
+
+/**
+ * Run the task for each of the shards on their workers, and wait for all of them.
+ */
+void ShardedKVStore::forEachShard(const vector<size_t>& shardIndexes, const function<void(size_t)>& task) {
+    vector<future<void>> results;
+    for (size_t i : shardIndexes)
+        results.push_back(post(*shards[i], [&task, i] { task(i); }));
+    for (auto& result : results)
+        result.get();
+}
+
+void ShardedKVStore::put(uint64_t key, const std::string &s)
+{
+    Shard& shard = *shards[getShard(key)];
+    post(shard, [&shard, key, s]() mutable { shard.store->put(key, std::move(s)); });
+}
+
+std::string ShardedKVStore::get(uint64_t key)
+{
+    Shard& shard = *shards[getShard(key)];
+    std::string value;
+    read(shard, [&] { value = shard.store->get(key); });
+    return value;
+}
+
+bool ShardedKVStore::del(uint64_t key)
+{
+    Shard& shard = *shards[getShard(key)];
+    bool existed;
+    post(shard, [&] { existed = shard.store->del(key); }).get();
+    return existed;
+}
+
+void ShardedKVStore::merge(uint64_t key, const std::string &operand)
+{
+    Shard& shard = *shards[getShard(key)];
+    post(shard, [&shard, key, operand] { shard.store->merge(key, operand); });
+}
+
+/**
+ * Split the batch by shard, and apply the parts in parallel. Each part is
+ * applied atomically, but a reader may see some parts before the others.
+ */
+void ShardedKVStore::write(const WriteBatch &batch)
+{
+    vector<WriteBatch> shardBatches(shards.size());
+    for (const auto& entry : batch.getEntries()) {
+        WriteBatch& shardBatch = shardBatches[getShard(entry.first)];
+        switch (entry.second.type) {
+            case TYPE_DELETION:
+                shardBatch.del(entry.first);
+                break;
+            case TYPE_MERGE:
+                shardBatch.merge(entry.first, entry.second.value);
+                break;
+            default:
+                shardBatch.put(entry.first, entry.second.value);
+        }
+    }
+
+    vector<size_t> shardIndexes;
+    for (size_t i = 0; i < shards.size(); ++i)
+        if (!shardBatches[i].empty())
+            shardIndexes.push_back(i);
+    if (shardIndexes.empty())
+        return;
+    forEachShard(shardIndexes, [&](size_t i) {
+        shards[i]->store->write(shardBatches[i]);
+    });
+}
+
+void ShardedKVStore::reset()
+{
+    forEachShard(getShards(0, UINT64_MAX), [&](size_t i) {
+        shards[i]->store->reset();
+    });
+}
+
+void ShardedKVStore::deleteRange(uint64_t start, uint64_t end)
+{
+    if (start > end)
+        return;
+    forEachShard(getShards(start, end), [&](size_t i) {
+        shards[i]->store->deleteRange(start, end);
+    });
+}
+
+/**
+ * Append the key-value pairs whose keys are in [start, end] to the list in
+ * key order. The shards are scanned in parallel, each as of when its scan
+ * runs, so the result is not a snapshot of the whole store.
+ */
+void ShardedKVStore::scan(uint64_t start, uint64_t end, std::list<std::pair<uint64_t, std::string>> &list)
+{
+    if (start > end)
+        return;
+
+    vector<size_t> shardIndexes = getShards(start, end);
+    vector<std::list<std::pair<uint64_t, std::string>>> shardLists(shards.size());
+    forEachShard(shardIndexes, [&](size_t i) {
+        shards[i]->store->scan(start, end, shardLists[i]);
+    });
+
+    std::list<std::pair<uint64_t, std::string>> merged;
+    auto keyLess = [](const pair<uint64_t, string>& p1, const pair<uint64_t, string>& p2) {
+        return p1.first < p2.first;
+    };
+    for (size_t i : shardIndexes)
+        merged.merge(shardLists[i], keyLess);
+    list.splice(list.end(), merged);
+}
+
+size_t ShardedKVStore::getShardNumber() const {
+    return shards.size();
+}
+
+/**
+ * @return A copy of the counters of the shard.
+ */
+Statistics ShardedKVStore::getStatistics(size_t shard) {
+    Statistics statistics;
+    read(*shards[shard], [&] { statistics = shards[shard]->store->getStatistics(); });
+    return statistics;
+}
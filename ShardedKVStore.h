@@ -0,0 +1,85 @@
+#ifndef LSM_TREE_SHARDEDKVSTORE_H
+#define LSM_TREE_SHARDEDKVSTORE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include "kvstore.h"
+
+using namespace std;
+
+// How the keys are spread over the shards of a `ShardedKVStore`.
+enum ShardPartitioning {
+    HASH_PARTITIONING,      // Even under any key distribution, but scans ask every shard.
+    RANGE_PARTITIONING      // Equal slices of the key space, so scans ask only the shards they cover.
+};
+
+/**
+ * Independent stores, each in a directory of its own, among which the keys
+ * are partitioned. Each shard has a worker thread, pinned to a core of its
+ * own where possible, that runs every operation on the shard in the order
+ * they were issued, so that different shards flush and compact in parallel.
+ *
+ * Puts and merges are queued without waiting, so that the flushes and
+ * compactions they cause run in the background on the core of the shard.
+ * A caller waits for them only once SHARD_MAX_QUEUED_TASKS operations are
+ * queued on the shard. Other operations wait for their result, and see
+ * every write queued before them. A get runs on the calling thread instead
+ * while nothing is queued on its shard.
+ *
+ * A batch is applied atomically by each shard, but not across shards.
+ */
+class ShardedKVStore : public KVStoreAPI {
+
+    struct Shard {
+        unique_ptr<KVStore> store;
+        mutex storeMutex;               // Held by the worker while it runs a task.
+
+        deque<packaged_task<void()>> tasks;
+        bool stopping = false;
+        mutex taskMutex;
+        condition_variable taskAdded;
+        condition_variable taskTaken;
+        thread worker;
+    };
+
+private:
+    const string dataDir;       // Ends with a slash.
+    const ShardPartitioning partitioning;
+    vector<unique_ptr<Shard>> shards;
+
+    void checkLayout(size_t shardNumber) const;
+    void runWorker(Shard& shard, size_t index);
+    size_t getShard(uint64_t key) const;
+    vector<size_t> getShards(uint64_t start, uint64_t end) const;
+    future<void> post(Shard& shard, function<void()> task);
+    void read(Shard& shard, const function<void()>& task);
+    void forEachShard(const vector<size_t>& shardIndexes, const function<void(size_t)>& task);
+
+public:
+    ShardedKVStore(const std::string &dir, size_t shardNumber,
+                   ShardPartitioning partitioning = HASH_PARTITIONING, const Options& options = Options());
+    ~ShardedKVStore();
+
+    void put(uint64_t key, const std::string &s) override;
+    std::string get(uint64_t key) override;
+    bool del(uint64_t key) override;
+    void merge(uint64_t key, const std::string &operand);
+    void write(const WriteBatch &batch);
+    void reset() override;
+
+    void deleteRange(uint64_t start, uint64_t end);
+    void scan(uint64_t start, uint64_t end, std::list<std::pair<uint64_t, std::string>> &list);
+
+    size_t getShardNumber() const;
+    Statistics getStatistics(size_t shard);
+};
+
+
+#endif //LSM_TREE_SHARDEDKVSTORE_H
@@ -0,0 +1,28 @@
+#ifndef LSM_TREE_SNAPSHOT_H
+#define LSM_TREE_SNAPSHOT_H
+
+#include "constants.h"
+
+/**
+ * A consistent view of the store as of one write. Reads given the snapshot
+ * see the writes up to its sequence number only, whatever is written or
+ * compacted afterwards, and compactions keep the versions it sees until it
+ * is released by `KVStore::releaseSnapshot`.
+ */
+class Snapshot {
+
+    friend class KVStore;
+
+private:
+    const SequenceNumber sequence;
+
+    explicit Snapshot(SequenceNumber sequence) : sequence(sequence) {}
+
+public:
+    SequenceNumber getSequence() const {
+        return sequence;
+    }
+};
+
+
+#endif //LSM_TREE_SNAPSHOT_H
@@ -0,0 +1,52 @@
+#ifndef LSM_TREE_STATISTICS_H
+#define LSM_TREE_STATISTICS_H
+
+#include <cstdint>
+
+/**
+ * Counters of the work done by a store, used to compare write and read
+ * amplification between configurations.
+ */
+struct Statistics {
+    uint64_t userBytesWritten = 0;          // Keys and values passed to put/del.
+    uint64_t flushBytesWritten = 0;         // SST bytes written by memTable flushes.
+    uint64_t compactionBytesRead = 0;       // SST bytes read by compactions.
+    uint64_t compactionBytesWritten = 0;    // SST bytes written by compactions.
+    uint64_t compactionNumber = 0;
+    uint64_t compactionMicros = 0;          // Wall time of compactions, whose stages below overlap.
+    uint64_t compactionReadMicros = 0;      // Reading inputs, summed over the reader threads.
+    uint64_t compactionMergeMicros = 0;     // Merging inputs and building outputs, waits aside.
+    uint64_t compactionWriteMicros = 0;     // Writing outputs, summed over the writer threads.
+    uint64_t subcompactionNumber = 0;       // Key ranges merged in parallel by split compactions.
+    uint64_t trivialMoveNumber = 0;         // SSTs moved to the next level without a rewrite.
+    uint64_t coveredSSTNumber = 0;          // SSTs removed whole since a range deletion covers them.
+    uint64_t blobBytesWritten = 0;          // Blob file bytes written by memTable flushes.
+    uint64_t garbageCollectionBytesWritten = 0;     // Blob and SST bytes rewritten to collect blob files.
+    uint64_t blobFilesCollected = 0;        // Blob files rewritten by garbage collection.
+
+    uint64_t delayedWriteNumber = 0;        // Writes that paid a delay past the soft limits.
+    uint64_t writeDelayMicros = 0;
+    uint64_t stoppedWriteNumber = 0;        // Writes stopped at the hard limits.
+    uint64_t writeStopMicros = 0;
+    uint64_t L0FilesStallNumber = 0;        // Delayed or stopped writes, by cause.
+    uint64_t pendingBytesStallNumber = 0;
+
+    uint64_t getNumber = 0;
+    uint64_t sstProbeNumber = 0;            // SSTs whose filter or index was probed by gets.
+
+    double writeAmplification() const {
+        if (userBytesWritten == 0)
+            return 0;
+        return (double)(flushBytesWritten + compactionBytesWritten + blobBytesWritten
+                        + garbageCollectionBytesWritten) / userBytesWritten;
+    }
+
+    double readAmplification() const {
+        if (getNumber == 0)
+            return 0;
+        return (double)sstProbeNumber / getNumber;
+    }
+};
+
+
+#endif //LSM_TREE_STATISTICS_H
@@ -0,0 +1,48 @@
+#include "WriteBatch.h"
+
+void WriteBatch::add(LsmKey key, ValueType type, const LsmValue& value) {
+    entries.emplace_back(key, LsmEntry{type, value});
+    byteSize += DATA_INDEX_SIZE + value.size();
+    userByteSize += sizeof(key) + value.size();
+}
+
+void WriteBatch::put(LsmKey key, const LsmValue& value) {
+    add(key, TYPE_VALUE, value);
+}
+
+/**
+ * Deletions in a batch are blind: they do not tell whether the key existed.
+ */
+void WriteBatch::del(LsmKey key) {
+    add(key, TYPE_DELETION, "");
+}
+
+void WriteBatch::merge(LsmKey key, const LsmValue& operand) {
+    add(key, TYPE_MERGE, operand);
+}
+
+void WriteBatch::clear() {
+    entries.clear();
+    byteSize = 0;
+    userByteSize = 0;
+}
+
+bool WriteBatch::empty() const {
+    return entries.empty();
+}
+
+size_t WriteBatch::size() const {
+    return entries.size();
+}
+
+uint64_t WriteBatch::getByteSize() const {
+    return byteSize;
+}
+
+uint64_t WriteBatch::getUserByteSize() const {
+    return userByteSize;
+}
+
+const vector<pair<LsmKey, LsmEntry>>& WriteBatch::getEntries() const {
+    return entries;
+}
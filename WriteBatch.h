@@ -0,0 +1,39 @@
+#ifndef LSM_TREE_WRITEBATCH_H
+#define LSM_TREE_WRITEBATCH_H
+
+#include <vector>
+#include <utility>
+#include "constants.h"
+
+using namespace std;
+
+/**
+ * Puts, deletions and merges collected to be applied by `KVStore::write`
+ * at once: the whole batch lands in one memTable, so that readers and the
+ * files on disk see either none or all of it. Later writes of a key in the
+ * batch override earlier ones.
+ */
+class WriteBatch {
+
+private:
+    vector<pair<LsmKey, LsmEntry>> entries;
+    uint64_t byteSize = 0;          // Bytes the entries take in an SST.
+    uint64_t userByteSize = 0;      // Bytes of the keys and values passed in.
+
+    void add(LsmKey key, ValueType type, const LsmValue& value);
+
+public:
+    void put(LsmKey key, const LsmValue& value);
+    void del(LsmKey key);
+    void merge(LsmKey key, const LsmValue& operand);
+    void clear();
+
+    bool empty() const;
+    size_t size() const;
+    uint64_t getByteSize() const;
+    uint64_t getUserByteSize() const;
+    const vector<pair<LsmKey, LsmEntry>>& getEntries() const;
+};
+
+
+#endif //LSM_TREE_WRITEBATCH_H
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include "WriteController.h"
+
+WriteController::WriteController(const Options& options)
+        : enabled(options.enableWriteStalls),
+          level0SlowdownWritesTrigger(options.level0SlowdownWritesTrigger),
+          level0StopWritesTrigger(max(options.level0StopWritesTrigger, options.level0SlowdownWritesTrigger + 1)),
+          softPendingCompactionBytesLimit(options.softPendingCompactionBytesLimit),
+          hardPendingCompactionBytesLimit(max(options.hardPendingCompactionBytesLimit,
+                                              options.softPendingCompactionBytesLimit + 1)),
+          delayedWriteRate(max<uint64_t>(options.delayedWriteRate, 1)),
+          condition(WRITE_NORMAL), cause(NO_STALL), currentWriteRate(delayedWriteRate),
+          nextWriteTime(chrono::steady_clock::now()) {}
+
+bool WriteController::isEnabled() const {
+    return enabled;
+}
+
+/**
+ * Recompute the condition after the shape of the store changed.
+ * @param pendingBytes: Estimated bytes compactions have to write.
+ */
+void WriteController::update(size_t L0FileNumber, uint64_t pendingBytes) {
+
+    if (!enabled)
+        return;
+
+    WriteStallCondition oldCondition = condition;
+    if (L0FileNumber >= level0StopWritesTrigger) {
+        condition = WRITE_STOPPED;
+        cause = L0_FILES_STALL;
+    } else if (pendingBytes >= hardPendingCompactionBytesLimit) {
+        condition = WRITE_STOPPED;
+        cause = PENDING_BYTES_STALL;
+    } else {
+        // How far past its soft limit each cause is, from 0 to 1.
+        double L0Progress = L0FileNumber < level0SlowdownWritesTrigger ? -1
+                : (double)(L0FileNumber - level0SlowdownWritesTrigger)
+                  / (level0StopWritesTrigger - level0SlowdownWritesTrigger);
+        double bytesProgress = pendingBytes < softPendingCompactionBytesLimit ? -1
+                : (double)(pendingBytes - softPendingCompactionBytesLimit)
+                  / (hardPendingCompactionBytesLimit - softPendingCompactionBytesLimit);
+        double progress = max(L0Progress, bytesProgress);
+        if (progress < 0) {
+            condition = WRITE_NORMAL;
+            cause = NO_STALL;
+        } else {
+            condition = WRITE_DELAYED;
+            cause = L0Progress >= bytesProgress ? L0_FILES_STALL : PENDING_BYTES_STALL;
+            currentWriteRate = max<uint64_t>(delayedWriteRate * (1 - progress),
+                                             delayedWriteRate / WRITE_DELAY_MAX_SLOWDOWN);
+        }
+    }
+
+    if (condition == WRITE_DELAYED && oldCondition != WRITE_DELAYED)
+        nextWriteTime = chrono::steady_clock::now();
+}
+
+/**
+ * Let `bytes` through at the current write rate if writes are delayed.
+ */
+void WriteController::charge(uint64_t bytes) {
+    if (condition != WRITE_DELAYED)
+        return;
+    nextWriteTime = max(nextWriteTime, chrono::steady_clock::now())
+                    + chrono::microseconds(bytes * 1000000 / currentWriteRate);
+}
+
+/**
+ * @return How long writes have to wait for the bytes charged so far.
+ */
+uint64_t WriteController::getDelayMicros() const {
+    auto now = chrono::steady_clock::now();
+    if (condition != WRITE_DELAYED || nextWriteTime <= now)
+        return 0;
+    return chrono::duration_cast<chrono::microseconds>(nextWriteTime - now).count();
+}
+
+WriteStallCondition WriteController::getCondition() const {
+    return condition;
+}
+
+WriteStallCause WriteController::getCause() const {
+    return cause;
+}
+
+/**
+ * @return Bytes per second let through while writes are delayed.
+ */
+uint64_t WriteController::getWriteRate() const {
+    return currentWriteRate;
+}
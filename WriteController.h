@@ -0,0 +1,58 @@
+#ifndef LSM_TREE_WRITECONTROLLER_H
+#define LSM_TREE_WRITECONTROLLER_H
+
+#include <cstdint>
+#include <chrono>
+#include "Options.h"
+#include "constants.h"
+
+using namespace std;
+
+enum WriteStallCondition {
+    WRITE_NORMAL,
+    WRITE_DELAYED,      // Writes are slowed down to the delayed write rate.
+    WRITE_STOPPED       // Writes wait until compactions bring the store below the hard limits.
+};
+
+enum WriteStallCause {
+    NO_STALL,
+    L0_FILES_STALL,             // Too many SSTs in L0.
+    PENDING_BYTES_STALL         // Too many bytes waiting for compaction.
+};
+
+/**
+ * Decides whether writes go on, are delayed or are stopped, from how far
+ * compactions are behind. Between the soft and the hard limits, the rate
+ * writes are let through falls linearly from `delayedWriteRate` down to
+ * 1/WRITE_DELAY_MAX_SLOWDOWN of it, so that writes slow down gradually
+ * instead of hitting a wall at the hard limits.
+ */
+class WriteController {
+
+private:
+    const bool enabled;
+    const uint32_t level0SlowdownWritesTrigger;
+    const uint32_t level0StopWritesTrigger;
+    const uint64_t softPendingCompactionBytesLimit;
+    const uint64_t hardPendingCompactionBytesLimit;
+    const uint64_t delayedWriteRate;
+    WriteStallCondition condition;
+    WriteStallCause cause;
+    uint64_t currentWriteRate;
+    chrono::steady_clock::time_point nextWriteTime;     // When the bytes let through so far are paid for.
+
+public:
+    explicit WriteController(const Options& options);
+
+    bool isEnabled() const;
+    void update(size_t L0FileNumber, uint64_t pendingBytes);
+    void charge(uint64_t bytes);
+    uint64_t getDelayMicros() const;
+
+    WriteStallCondition getCondition() const;
+    WriteStallCause getCause() const;
+    uint64_t getWriteRate() const;
+};
+
+
+#endif //LSM_TREE_WRITECONTROLLER_H
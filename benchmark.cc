@@ -0,0 +1,766 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
+#include "kvstore.h"
+#include "ShardedKVStore.h"
+#include "ColumnFamilyStore.h"
+
+class Benchmark {
+private:
+	const uint64_t KEY_SPACE;
+	const uint64_t WRITE_NUMBER;
+	const uint64_t READ_NUMBER;
+	const uint64_t VALUE_SIZE = 1024;
+
+	static double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count();
+	}
+
+	// Text-like values, so that the codecs have something to find.
+	static std::string textValue(uint64_t i, uint64_t size)
+	{
+		static const char *words[] = {"the ", "log ", "structured ", "merge ", "tree ", "writes ",
+					      "sorted ", "runs ", "into ", "levels ", "of ", "blocks "};
+		std::string value;
+		for (uint64_t j = i; value.size() < size; j = j * 6364136223846793005 + 1442695040888963407)
+			value += words[(j >> 33) % 12];
+		value.resize(size);
+		return value;
+	}
+
+	static double megabytesOnDisk(const std::string &dir)
+	{
+		uint64_t bytes = 0;
+		for (const auto &file : std::filesystem::recursive_directory_iterator(dir))
+			if (file.is_regular_file())
+				bytes += file.file_size();
+		return bytes / 1048576.0;
+	}
+
+public:
+	Benchmark(uint64_t writeNumber, uint64_t readNumber)
+		: KEY_SPACE(writeNumber / 2), WRITE_NUMBER(writeNumber), READ_NUMBER(readNumber)
+	{
+	}
+
+	/**
+	 * Random overwrites, or appends of increasing keys if `sequential` is
+	 * set, followed by random point reads on a fresh store.
+	 */
+	void compaction_test(const std::string &name, const Options &options, bool sequential = false)
+	{
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i)
+			store.put(sequential ? i : rng() % KEY_SPACE, std::string(VALUE_SIZE, 'a' + i % 26));
+		double writeSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng() % KEY_SPACE);
+		double readSeconds = secondsSince(start);
+
+		const Statistics &stats = store.getStatistics();
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(10) << READ_NUMBER / readSeconds
+			  << std::setw(8) << stats.writeAmplification()
+			  << std::setw(8) << stats.readAmplification()
+			  << std::setw(8) << stats.compactionNumber << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random deletes of present and missing keys on a loaded store. Keys
+	 * reported as found may exceed the exact count in the cheaper modes.
+	 */
+	void delete_test(const std::string &name, DeleteMode mode)
+	{
+		Options options;
+		options.deleteMode = mode;
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i)
+			store.put(rng() % KEY_SPACE, std::string(VALUE_SIZE, 'a' + i % 26));
+
+		uint64_t found = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			found += store.del(rng() % (KEY_SPACE * 2));
+		double deleteSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(12) << READ_NUMBER / deleteSeconds
+			  << std::setw(10) << found << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random point reads of values of `valueSize` bytes, returned by value,
+	 * copied into a reused buffer, or pinned in the SST files.
+	 */
+	void value_test(uint64_t valueSize)
+	{
+		KVStore store("./data");
+		store.reset();
+
+		uint64_t keySpace = std::max<uint64_t>(WRITE_NUMBER * VALUE_SIZE / valueSize / 2, 1);
+		for (uint64_t i = 0; i < keySpace; ++i)
+			store.put(i, std::string(valueSize, 'a' + i % 26));
+
+		std::mt19937_64 rng(2021);
+		uint64_t bytes = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			bytes += store.get(rng() % keySpace).size();
+		double copySeconds = secondsSince(start);
+
+		std::string buffer;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			if (store.get(rng() % keySpace, buffer))
+				bytes += buffer.size();
+		double bufferSeconds = secondsSince(start);
+
+		PinnableValue pinned;
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			if (store.get(rng() % keySpace, pinned))
+				bytes += pinned.size();
+		double pinnedSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << std::to_string(valueSize) + " B" << std::right
+			  << std::fixed << std::setprecision(2)
+			  << std::setw(12) << READ_NUMBER / copySeconds
+			  << std::setw(12) << READ_NUMBER / bufferSeconds
+			  << std::setw(12) << READ_NUMBER / pinnedSeconds << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites of values of `valueSize` bytes, kept in the SSTs or
+	 * moved into blob files, followed by random point reads. The same bytes
+	 * are written whatever the value size.
+	 */
+	void blob_test(uint64_t valueSize, bool enableBlobFiles)
+	{
+		Options options;
+		options.enableBlobFiles = enableBlobFiles;
+		KVStore store("./data", options);
+		store.reset();
+
+		uint64_t writeNumber = std::max<uint64_t>(WRITE_NUMBER * VALUE_SIZE / valueSize, 1);
+		uint64_t keySpace = std::max<uint64_t>(writeNumber / 2, 1);
+		std::mt19937_64 rng(2021);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < writeNumber; ++i)
+			store.put(rng() % keySpace, std::string(valueSize, 'a' + i % 26));
+		double writeSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng() % keySpace);
+		double readSeconds = secondsSince(start);
+
+		const Statistics &stats = store.getStatistics();
+		std::string name = std::to_string(valueSize) + " B " + (enableBlobFiles ? "blob" : "inline");
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << writeNumber / writeSeconds
+			  << std::setw(10) << READ_NUMBER / readSeconds
+			  << std::setw(8) << stats.writeAmplification()
+			  << std::setw(12) << (stats.compactionBytesRead + stats.compactionBytesWritten) / 1048576.0
+			  << std::setw(8) << stats.garbageCollectionBytesWritten / 1048576.0 << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites of text-like values, followed by random point reads,
+	 * with the codecs of `compressionPerLevel`.
+	 */
+	void compression_test(const std::string &name, const std::vector<CompressionType> &compressionPerLevel)
+	{
+		if (std::any_of(compressionPerLevel.begin(), compressionPerLevel.end(),
+				[](CompressionType type) { return !Compression::isSupported(type); })) {
+			std::cout << std::left << std::setw(14) << name << "  not supported by this build" << std::endl;
+			return;
+		}
+
+		Options options;
+		options.compressionPerLevel = compressionPerLevel;
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i)
+			store.put(rng() % KEY_SPACE, textValue(i, VALUE_SIZE));
+		double writeSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng() % KEY_SPACE);
+		double readSeconds = secondsSince(start);
+
+		const Statistics &stats = store.getStatistics();
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(12) << READ_NUMBER / readSeconds
+			  << std::setw(10) << megabytesOnDisk("./data")
+			  << std::setw(12) << (stats.compactionBytesRead + stats.compactionBytesWritten) / 1048576.0
+			  << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites with flushes and compactions limited by `limiter`,
+	 * timing every put to show the stalls the compactions cause.
+	 */
+	void rate_limit_test(const std::string &name, const std::shared_ptr<RateLimiter> &limiter)
+	{
+		Options options;
+		options.rateLimiter = limiter;
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+		std::vector<double> latencies;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i) {
+			auto putStart = std::chrono::steady_clock::now();
+			store.put(rng() % KEY_SPACE, std::string(VALUE_SIZE, 'a' + i % 26));
+			latencies.push_back(secondsSince(putStart));
+		}
+		double writeSeconds = secondsSince(start);
+		std::sort(latencies.begin(), latencies.end());
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(10) << latencies[latencies.size() * 99 / 100] * 1000
+			  << std::setw(10) << latencies.back() * 1000
+			  << std::setw(12) << (limiter ? limiter->getThrottledMicros(IO_HIGH) / 1000.0 : 0)
+			  << std::setw(12) << (limiter ? limiter->getThrottledMicros(IO_LOW) / 1000.0 : 0)
+			  << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites, timing every put, with compactions run as each
+	 * flush needs them or paced by write stalls.
+	 */
+	void stall_test(const std::string &name, const Options &options)
+	{
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+		std::vector<double> latencies;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i) {
+			auto putStart = std::chrono::steady_clock::now();
+			store.put(rng() % (KEY_SPACE * 4), std::string(VALUE_SIZE, 'a' + i % 26));
+			latencies.push_back(secondsSince(putStart));
+		}
+		double writeSeconds = secondsSince(start);
+		std::sort(latencies.begin(), latencies.end());
+
+		const Statistics &stats = store.getStatistics();
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(10) << latencies[latencies.size() * 999 / 1000] * 1000
+			  << std::setw(10) << latencies.back() * 1000
+			  << std::setw(10) << stats.delayedWriteNumber
+			  << std::setw(10) << stats.stoppedWriteNumber << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Point reads of a small hot set of keys, timed one by one, between
+	 * random puts over a large key space that keep flushes and compactions
+	 * busy.
+	 */
+	void direct_io_test(const std::string &name, bool directIO)
+	{
+		Options options;
+		options.useDirectIOForFlushAndCompaction = directIO;
+		KVStore store("./data", options);
+		store.reset();
+
+		const uint64_t hotKeys = std::max<uint64_t>(KEY_SPACE / 64, 1);
+		for (uint64_t i = 0; i < hotKeys; ++i)
+			store.put(i, std::string(VALUE_SIZE, 'h'));
+
+		std::mt19937_64 rng(2021);
+		std::vector<double> latencies;
+		uint64_t writes = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < READ_NUMBER; ++i) {
+			for (uint64_t j = 0; j < WRITE_NUMBER / READ_NUMBER; ++j, ++writes)
+				store.put(hotKeys + rng() % (KEY_SPACE * 4), std::string(VALUE_SIZE, 'a' + j % 26));
+			auto getStart = std::chrono::steady_clock::now();
+			store.get(rng() % hotKeys);
+			latencies.push_back(secondsSince(getStart));
+		}
+		double seconds = secondsSince(start);
+		std::sort(latencies.begin(), latencies.end());
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << writes / seconds
+			  << std::setw(10) << latencies[latencies.size() / 2] * 1000000
+			  << std::setw(10) << latencies[latencies.size() * 99 / 100] * 1000000
+			  << std::setw(10) << latencies[latencies.size() * 999 / 1000] * 1000000 << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites, timing every put, with new files written back
+	 * while being written and synced before being renamed into place, or not.
+	 */
+	void sync_test(const std::string &name, uint64_t bytesPerSync, bool syncNewFiles)
+	{
+		Options options;
+		options.bytesPerSync = bytesPerSync;
+		options.syncNewFiles = syncNewFiles;
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+		std::vector<double> latencies;
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i) {
+			auto putStart = std::chrono::steady_clock::now();
+			store.put(rng() % (KEY_SPACE * 4), std::string(VALUE_SIZE, 'a' + i % 26));
+			latencies.push_back(secondsSince(putStart));
+		}
+		double writeSeconds = secondsSince(start);
+		std::sort(latencies.begin(), latencies.end());
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(10) << latencies[latencies.size() * 999 / 1000] * 1000
+			  << std::setw(10) << latencies.back() * 1000 << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Time opening a store of random puts, checking each SST against its
+	 * checksums as far as `verification` asks.
+	 */
+	void checksum_test(const std::string &name, ChecksumVerification verification)
+	{
+		{
+			KVStore store("./data");
+			store.reset();
+			std::mt19937_64 rng(2021);
+			for (uint64_t i = 0; i < WRITE_NUMBER; ++i)
+				store.put(rng() % KEY_SPACE, std::string(VALUE_SIZE, 'a' + i % 26));
+		}
+
+		Options options;
+		options.verifyChecksumsOnOpen = verification;
+		auto start = std::chrono::steady_clock::now();
+		KVStore store("./data", options);
+		double openSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		std::mt19937_64 rng(2022);
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng() % KEY_SPACE);
+		double readSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << openSeconds * 1000
+			  << std::setw(12) << READ_NUMBER / readSeconds << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Time opening a store of small values, and reading it right after,
+	 * with the metadata of its SSTs loaded at different times.
+	 */
+	void open_test(const std::string &name, MetadataLoading loading)
+	{
+		const uint64_t valueSize = 64;
+		{
+			KVStore store("./data");
+			store.reset();
+			std::mt19937_64 rng(2021);
+			for (uint64_t i = 0; i < WRITE_NUMBER * 8; ++i)
+				store.put(rng(), std::string(valueSize, 'a' + i % 26));
+		}
+
+		Options options;
+		options.metadataLoading = loading;
+		auto start = std::chrono::steady_clock::now();
+		KVStore store("./data", options);
+		double openSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		std::mt19937_64 rng(2022);
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng());
+		double readSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << openSeconds * 1000
+			  << std::setw(12) << READ_NUMBER / readSeconds << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random overwrites, reporting the throughput of every compaction stage
+	 * over the time it was busy, and of whole compactions over their wall time.
+	 */
+	void pipeline_test(const std::string &name, const Options &options)
+	{
+		KVStore store("./data", options);
+		store.reset();
+
+		std::mt19937_64 rng(2021);
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i)
+			store.put(rng() % (KEY_SPACE * 4), std::string(VALUE_SIZE, 'a' + i % 26));
+
+		const Statistics &statistics = store.getStatistics();
+		auto MBps = [](uint64_t bytes, uint64_t micros) {
+			return micros ? (double)bytes / micros * 1000000 / 1048576 : 0;
+		};
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << MBps(statistics.compactionBytesRead, statistics.compactionReadMicros)
+			  << std::setw(10) << MBps(statistics.compactionBytesRead, statistics.compactionMergeMicros)
+			  << std::setw(10) << MBps(statistics.compactionBytesWritten, statistics.compactionWriteMicros)
+			  << std::setw(10) << MBps(statistics.compactionBytesRead + statistics.compactionBytesWritten,
+						   statistics.compactionMicros)
+			  << std::setw(10) << statistics.compactionMicros / 1000 << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random puts from one thread per shard, each writing keys of any shard,
+	 * then random gets.
+	 */
+	void shard_test(const std::string &name, size_t shardNumber, ShardPartitioning partitioning)
+	{
+		std::filesystem::remove_all("./data/shards");
+		ShardedKVStore store("./data/shards", shardNumber, partitioning);
+
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> writers;
+		for (size_t t = 0; t < shardNumber; ++t) {
+			writers.emplace_back([&, t]() {
+				std::mt19937_64 rng(2021 + t);
+				for (uint64_t i = t; i < WRITE_NUMBER; i += shardNumber)
+					store.put(rng(), std::string(VALUE_SIZE, 'a' + i % 26));
+			});
+		}
+		for (auto &writer : writers)
+			writer.join();
+		// Wait for the writes still queued on the shards.
+		for (size_t i = 0; i < shardNumber; ++i)
+			store.getStatistics(i);
+		double writeSeconds = secondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		std::mt19937_64 rng(2022);
+		for (uint64_t i = 0; i < READ_NUMBER; ++i)
+			store.get(rng());
+		double readSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(12) << READ_NUMBER / readSeconds << std::endl;
+
+		store.reset();
+	}
+
+	/**
+	 * Random puts spread over three column families, small hot values,
+	 * large values and an append-only log, with the memTable of the hot
+	 * family sized `hotBufferSize`.
+	 */
+	void column_family_test(const std::string &name, uint64_t hotBufferSize)
+	{
+		Options hotOptions;
+		hotOptions.writeBufferSize = hotBufferSize;
+		Options blobOptions;
+		blobOptions.enableBlobFiles = true;
+		std::filesystem::remove_all("./data/families");
+		ColumnFamilyStore store("./data/families",
+					{{"hot", hotOptions}, {"blobs", blobOptions}, {"log", Options()}});
+		ColumnFamily hot = store.getColumnFamily("hot");
+		ColumnFamily blobs = store.getColumnFamily("blobs");
+		ColumnFamily log = store.getColumnFamily("log");
+
+		std::mt19937_64 rng(2021);
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < WRITE_NUMBER; ++i) {
+			switch (i % 4) {
+			case 0:
+				store.put(blobs, rng() % KEY_SPACE, std::string(VALUE_SIZE * 4, 'a' + i % 26));
+				break;
+			case 1:
+				store.put(log, i, std::string(VALUE_SIZE / 4, 'a' + i % 26));
+				break;
+			default:
+				store.put(hot, rng() % (KEY_SPACE / 16), std::string(VALUE_SIZE / 4, 'a' + i % 26));
+			}
+		}
+		double writeSeconds = secondsSince(start);
+
+		std::cout << std::left << std::setw(14) << name << std::right << std::fixed
+			  << std::setprecision(2)
+			  << std::setw(10) << WRITE_NUMBER / writeSeconds
+			  << std::setw(10) << store.getStatistics(hot).writeAmplification()
+			  << std::setw(10) << store.getStatistics(blobs).writeAmplification()
+			  << std::setw(10) << store.getStatistics(log).writeAmplification() << std::endl;
+
+		store.reset();
+	}
+
+	void start_test()
+	{
+		std::cout << "KVStore Compaction Benchmark" << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B over "
+			  << KEY_SPACE << " keys, then " << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "strategy" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "get/s"
+			  << std::setw(8) << "W-amp" << std::setw(8) << "R-amp"
+			  << std::setw(8) << "compact" << std::endl;
+
+		Options leveled;
+		leveled.compactionStyle = LEVELED_COMPACTION;
+		compaction_test("leveled", leveled);
+
+		Options dynamicLeveled;
+		dynamicLeveled.dynamicLevelBytes = true;
+		compaction_test("leveled-dyn", dynamicLeveled);
+
+		Options minOverlapping;
+		minOverlapping.compactionPicker = MIN_OVERLAPPING_RATIO_PICKER;
+		compaction_test("min-overlap", minOverlapping);
+
+		Options roundRobin;
+		roundRobin.compactionPicker = ROUND_ROBIN_PICKER;
+		compaction_test("round-robin", roundRobin);
+
+		Options tiered;
+		tiered.compactionStyle = TIERED_COMPACTION;
+		compaction_test("tiered", tiered);
+
+		Options lazyLeveled;
+		lazyLeveled.compactionStyle = LAZY_LEVELED_COMPACTION;
+		compaction_test("lazy-leveled", lazyLeveled);
+
+		compaction_test("append", leveled, true);
+
+		std::cout << std::endl;
+		std::cout << "  " << READ_NUMBER << " dels over " << KEY_SPACE * 2
+			  << " keys after the puts" << std::endl;
+		std::cout << std::left << std::setw(14) << "delete mode" << std::right
+			  << std::setw(12) << "del/s" << std::setw(10) << "found" << std::endl;
+
+		delete_test("checked", CHECKED_DELETE);
+		delete_test("probable", PROBABLE_DELETE);
+		delete_test("blind", BLIND_DELETE);
+
+		std::cout << std::endl;
+		std::cout << "  " << READ_NUMBER << " gets of each value size" << std::endl;
+		std::cout << std::left << std::setw(14) << "value size" << std::right
+			  << std::setw(12) << "string/s" << std::setw(12) << "buffer/s"
+			  << std::setw(12) << "pinned/s" << std::endl;
+
+		value_test(1024);
+		value_test(1024 * 16);
+		value_test(1024 * 64);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER * VALUE_SIZE / 1048576 << " MB of puts of each value size, then "
+			  << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "values" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "get/s"
+			  << std::setw(8) << "W-amp" << std::setw(12) << "compact MB"
+			  << std::setw(8) << "GC MB" << std::endl;
+
+		blob_test(1024 * 4, false);
+		blob_test(1024 * 4, true);
+		blob_test(1024 * 16, false);
+		blob_test(1024 * 16, true);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B of text, then "
+			  << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "compression" << std::right
+			  << std::setw(10) << "put/s" << std::setw(12) << "get/s"
+			  << std::setw(10) << "disk MB" << std::setw(12) << "compact MB" << std::endl;
+
+		compression_test("none", {});
+		compression_test("lz", {LZ_COMPRESSION});
+		compression_test("zlib", {ZLIB_COMPRESSION});
+		compression_test("per-level", {NO_COMPRESSION, NO_COMPRESSION, LZ_COMPRESSION, ZLIB_COMPRESSION});
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE
+			  << " B under each limit of background writes" << std::endl;
+		std::cout << std::left << std::setw(14) << "rate limit" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms"
+			  << std::setw(12) << "flush ms" << std::setw(12) << "compact ms" << std::endl;
+
+		rate_limit_test("none", nullptr);
+		rate_limit_test("64 MB/s", std::make_shared<RateLimiter>(64 * 1048576));
+		rate_limit_test("16 MB/s", std::make_shared<RateLimiter>(16 * 1048576));
+		rate_limit_test("16 MB/s auto", std::make_shared<RateLimiter>(16 * 1048576, true));
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B over "
+			  << KEY_SPACE * 4 << " keys" << std::endl;
+		std::cout << std::left << std::setw(14) << "write stalls" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "p999 ms" << std::setw(10) << "max ms"
+			  << std::setw(10) << "delayed" << std::setw(10) << "stopped" << std::endl;
+
+		Options stalls;
+		stalls.enableWriteStalls = true;
+		stall_test("off", Options());
+		stall_test("on", stalls);
+		stalls.softPendingCompactionBytesLimit = 4 * MAX_SSTABLE_SIZE;
+		stalls.hardPendingCompactionBytesLimit = 16 * MAX_SSTABLE_SIZE;
+		stall_test("on, tight", stalls);
+
+		std::cout << std::endl;
+		std::cout << "  " << READ_NUMBER << " gets of " << std::max<uint64_t>(KEY_SPACE / 64, 1)
+			  << " hot keys among " << WRITE_NUMBER << " puts" << std::endl;
+		std::cout << std::left << std::setw(14) << "flush/compact" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "p50 us"
+			  << std::setw(10) << "p99 us" << std::setw(10) << "p999 us" << std::endl;
+
+		direct_io_test("page cache", false);
+		direct_io_test("direct I/O", true);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B over "
+			  << KEY_SPACE * 4 << " keys" << std::endl;
+		std::cout << std::left << std::setw(14) << "new files" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "p999 ms" << std::setw(10) << "max ms" << std::endl;
+
+		sync_test("no sync", 0, false);
+		sync_test("sync at end", 0, true);
+		sync_test("sync 1 MB", 1024 * 1024, true);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B, then "
+			  << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "verify" << std::right
+			  << std::setw(10) << "open ms" << std::setw(12) << "get/s" << std::endl;
+
+		checksum_test("nothing", VERIFY_NOTHING);
+		checksum_test("metadata", VERIFY_METADATA);
+		checksum_test("all", VERIFY_ALL);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER * 8 << " puts of 64 B, then "
+			  << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "metadata" << std::right
+			  << std::setw(10) << "open ms" << std::setw(12) << "get/s" << std::endl;
+
+		open_test("on open", LOAD_ON_OPEN);
+		open_test("on first use", LOAD_ON_FIRST_USE);
+		open_test("background", LOAD_IN_BACKGROUND);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B over "
+			  << KEY_SPACE * 4 << " keys, compaction MB/s by stage" << std::endl;
+		std::cout << std::left << std::setw(14) << "compaction" << std::right
+			  << std::setw(10) << "read" << std::setw(10) << "merge" << std::setw(10) << "write"
+			  << std::setw(10) << "total" << std::setw(10) << "wall ms" << std::endl;
+
+		Options pipelined;
+		pipeline_test("default", pipelined);
+		pipelined.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION};
+		pipeline_test("compressed", pipelined);
+		pipelined.useDirectIOForFlushAndCompaction = true;
+		pipeline_test("direct I/O", pipelined);
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts of " << VALUE_SIZE << " B by a thread per shard, then "
+			  << READ_NUMBER << " gets" << std::endl;
+		std::cout << std::left << std::setw(14) << "shards" << std::right
+			  << std::setw(10) << "put/s" << std::setw(12) << "get/s" << std::endl;
+
+		shard_test("1", 1, HASH_PARTITIONING);
+		shard_test("2, hash", 2, HASH_PARTITIONING);
+		shard_test("4, hash", 4, HASH_PARTITIONING);
+		shard_test("4, range", 4, RANGE_PARTITIONING);
+		std::filesystem::remove_all("./data/shards");
+
+		std::cout << std::endl;
+		std::cout << "  " << WRITE_NUMBER << " puts over three column families, W-amp by family" << std::endl;
+		std::cout << std::left << std::setw(14) << "hot memTable" << std::right
+			  << std::setw(10) << "put/s" << std::setw(10) << "hot" << std::setw(10) << "blobs"
+			  << std::setw(10) << "log" << std::endl;
+
+		column_family_test("512 KB", 512 * 1024);
+		column_family_test("2 MB", 2 * 1024 * 1024);
+		column_family_test("8 MB", 8 * 1024 * 1024);
+		std::filesystem::remove_all("./data/families");
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	uint64_t writeNumber = argc >= 2 ? std::stoull(argv[1]) : 1024 * 32;
+	uint64_t readNumber = argc >= 3 ? std::stoull(argv[2]) : 1024 * 8;
+
+	std::cout << "Usage: " << argv[0] << " [writes] [reads]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	Benchmark benchmark(writeNumber, readNumber);
+
+	benchmark.start_test();
+
+	return 0;
+}
@@ -2,19 +2,83 @@
 #define LSM_TREE_CONSTANTS_H
 
 #include <string>
+#include <vector>
 #include <unordered_map>
 
 typedef uint64_t LsmKey;
 typedef std::string LsmValue;
 typedef uint64_t TimeStamp;
-typedef std::unordered_map<LsmKey, LsmValue> KVPair;
+typedef uint64_t SequenceNumber;     // Order of the writes, starting from 1.
 
-#define DELETE_SIGN "~DELETED~"
+enum ValueType : uint8_t {
+    TYPE_VALUE = 0,
+    TYPE_DELETION = 1,
+    TYPE_MERGE = 2,     // A merge operand not yet applied to the older value.
+    TYPE_BLOB_INDEX = 3 // A value kept in a blob file. The entry holds where it lies.
+};
 
-#define HEADER_SIZE 32
+// Codec of the value blocks of an SST.
+enum CompressionType : uint8_t {
+    NO_COMPRESSION = 0,
+    LZ_COMPRESSION = 1,     // The LZ77 codec of the tree: fast, and always built.
+    ZLIB_COMPRESSION = 2    // zlib deflate, if the build found the library: slower, smaller.
+};
+
+struct LsmEntry {
+    ValueType type;
+    LsmValue value;
+    SequenceNumber sequence = 0;
+};
+
+// Versions of one key, from the newest to the oldest.
+typedef std::vector<LsmEntry> LsmVersions;
+typedef std::unordered_map<LsmKey, LsmVersions> KVPair;
+
+// Reads without a snapshot see every write.
+#define MAX_SEQUENCE_NUMBER UINT64_MAX
+
+#define HEADER_SIZE 72
 #define BLOOM_FILTER_SIZE 10240
-#define DATA_INDEX_SIZE 12
+#define DATA_INDEX_SIZE 21
 #define MAX_SSTABLE_SIZE 2097152
+#define BLOCK_SIZE 4096
+#define BLOCK_HANDLE_SIZE 20
+#define SST_FOOTER_SIZE 16
+#define SST_MAGIC_NUMBER 0x4c534d5353544631ull
+
+#define L0_SUBLEVEL_TRIGGER 3
+#define L0_MAX_SST_NUMBER 12
+
+#define TIERED_RUN_TRIGGER 4
+#define TIERED_SIZE_RATIO 1
+#define TIERED_MIN_MERGE_WIDTH 2
+#define TIERED_MAX_SIZE_AMPLIFICATION 200
+#define TIERED_LEVEL_NUMBER 8
+#define LAZY_LEVELING_FANOUT 4
+
+#define BLOB_INDEX_SIZE 16
+#define BLOB_RECORD_HEADER_SIZE 12
+#define MAX_BLOB_FILE_SIZE 67108864
+
+#define MAX_SUBCOMPACTIONS 4
+#define SUBCOMPACTION_MIN_SST_NUMBER 4
+#define MAX_OPEN_THREADS 16
+#define SHARD_MAX_QUEUED_TASKS 256
+
+#define RATE_LIMITER_REFILL_PERIOD_US 100000
+#define RATE_LIMITER_MAX_BOOST 8
+#define RATE_LIMITER_DEBT_STEP (4 * MAX_SSTABLE_SIZE)
+
+#define DIRECT_IO_ALIGNMENT 4096
+#define FILE_WRITER_BUFFER_SIZE 1048576
+#define FILE_WRITER_WRITE_SIZE 262144       // Most bytes written at once under a rate limiter.
+#define COMPACTION_READAHEAD_SIZE 2097152
+#define COMPACTION_PREFETCH_SSTS 2
+#define COMPACTION_PENDING_OUTPUTS 2
+
+#define WRITE_STALL_COMPACTIONS_PER_FLUSH 1
+#define WRITE_DELAY_MIN_US 1000
+#define WRITE_DELAY_MAX_SLOWDOWN 16
 
 #define DATA_DIR "data/"
 
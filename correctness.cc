@@ -2,7 +2,15 @@
 #include <cstdint>
 #include <random>
 #include <string>
+#include <list>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <map>
 #include "test.h"
+#include "ShardedKVStore.h"
+#include "ColumnFamilyStore.h"
 
 class CorrectnessTest : public Test {
 private:
@@ -21,6 +29,18 @@ private:
 		EXPECT(not_found, store.get(1));
 		EXPECT(false, store.del(1));
 
+		// Values are never mistaken for deletions
+		store.put(2, "~DELETED~");
+		EXPECT("~DELETED~", store.get(2));
+		EXPECT(true, store.del(2));
+
+		// Test deletions without a full read
+		store.put(3, "SE");
+		EXPECT(true, store.del(3, PROBABLE_DELETE));
+		EXPECT(false, store.del(3, PROBABLE_DELETE));
+		EXPECT(true, store.del(3, BLIND_DELETE));
+		EXPECT(not_found, store.get(3));
+
 		phase();
 
 		vector<uint64_t> testKeys;
@@ -84,8 +104,1382 @@ private:
 		report();
 	}
 
+	void level0_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 16;
+		const std::string dir = "./data/level0";
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 64 + 1, c); };
+		auto current = [&](uint64_t i) {
+			if (i >= number / 2 && i < number * 5 / 2)
+				return i % 3 == 0 ? not_found : value(i, 'b');
+			if (i < number * 3)
+				return value(i, i < number ? 'a' : 'c');
+			return not_found;
+		};
+
+		store.reset();
+		{
+			// Two disjoint SSTs share the oldest sub-level, and an SST
+			// overlapping both lies in a newer one
+			KVStore level0Store(dir);
+			for (i = 0; i < number; ++i)
+				level0Store.put(i, value(i, 'a'));
+			level0Store.flush();
+			for (i = number * 2; i < number * 3; ++i)
+				level0Store.put(i, value(i, 'c'));
+			level0Store.flush();
+			for (i = number / 2; i < number * 5 / 2; ++i) {
+				if (i % 3 == 0)
+					level0Store.del(i, BLIND_DELETE);
+				else
+					level0Store.put(i, value(i, 'b'));
+			}
+			level0Store.flush();
+
+			// Test that the newest sub-level is read first, and that a get
+			// probes only the one SST of each sub-level covering the key
+			const Statistics &stats = level0Store.getStatistics();
+			uint64_t probes = stats.sstProbeNumber;
+			for (i = 0; i < number * 4; ++i)
+				EXPECT(current(i), level0Store.get(i));
+			EXPECT(number * 3, stats.sstProbeNumber - probes);
+			EXPECT((uint64_t)0, stats.compactionNumber);
+			phase();
+		}
+		{
+			// Test the sub-levels rebuilt after reopening the store, and
+			// compacted once a third one is added
+			KVStore level0Store(dir);
+			for (i = 0; i < number * 4; ++i)
+				EXPECT(current(i), level0Store.get(i));
+			phase();
+
+			for (i = 0; i < number * 3; ++i)
+				level0Store.put(i, value(i, 'd'));
+			level0Store.flush();
+			EXPECT(true, level0Store.getStatistics().compactionNumber > 0);
+			for (i = 0; i < number * 4; ++i)
+				EXPECT(i < number * 3 ? value(i, 'd') : not_found, level0Store.get(i));
+			phase();
+
+			level0Store.reset();
+		}
+		std::filesystem::remove_all(dir);
+
+		report();
+	}
+
+	void subcompaction_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 2;
+		const std::string serialDir = "./data/serial";
+		const std::string splitDir = "./data/split";
+		Options serialOptions;
+		serialOptions.maxSubcompactions = 1;
+		Options splitOptions;
+		std::map<uint64_t, std::string> expected;
+		std::list<std::pair<uint64_t, std::string>> serialList, splitList;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 1024 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			// Test that compactions split by key range leave the same
+			// contents as compactions merged on one thread
+			KVStore serialStore(serialDir, serialOptions);
+			KVStore splitStore(splitDir, splitOptions);
+			std::mt19937_64 rng(2028);
+			for (i = 0; i < number * 2; ++i) {
+				uint64_t key = rng() % number;
+				if (i % 5 == 0) {
+					serialStore.del(key, BLIND_DELETE);
+					splitStore.del(key, BLIND_DELETE);
+					expected.erase(key);
+				} else {
+					serialStore.put(key, value(i, 'a'));
+					splitStore.put(key, value(i, 'a'));
+					expected[key] = value(i, 'a');
+				}
+			}
+			EXPECT((uint64_t)0, serialStore.getStatistics().subcompactionNumber);
+			EXPECT(true, splitStore.getStatistics().subcompactionNumber > 0);
+			for (i = 0; i < number; ++i)
+				EXPECT(expected.count(i) ? expected[i] : not_found, splitStore.get(i));
+
+			serialStore.scan(0, number, serialList);
+			splitStore.scan(0, number, splitList);
+			EXPECT(expected.size(), splitList.size());
+			EXPECT(true, serialList == splitList);
+			phase();
+		}
+		{
+			// Test the split outputs after reopening the store
+			KVStore splitStore(splitDir, splitOptions);
+			for (i = 0; i < number; ++i)
+				EXPECT(expected.count(i) ? expected[i] : not_found, splitStore.get(i));
+			splitList.clear();
+			splitStore.scan(0, number, splitList);
+			EXPECT(true, serialList == splitList);
+			phase();
+		}
+		std::filesystem::remove_all(serialDir);
+		std::filesystem::remove_all(splitDir);
+
+		report();
+	}
+
+	void compaction_style_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 1024 + 1, c + i % 26); };
+
+		store.reset();
+		for (CompactionStyle style : {TIERED_COMPACTION, LAZY_LEVELED_COMPACTION}) {
+			std::string dir = style == TIERED_COMPACTION ? "./data/tiered" : "./data/lazy-leveled";
+			Options options;
+			options.compactionStyle = style;
+			std::map<uint64_t, std::string> expected;
+			std::list<std::pair<uint64_t, std::string>> list;
+
+			auto check = [&](KVStore &styledStore) {
+				for (i = 0; i < number; ++i)
+					EXPECT(expected.count(i) ? expected[i] : not_found, styledStore.get(i));
+				list.clear();
+				styledStore.scan(0, number, list);
+				EXPECT(true, list == decltype(list)(expected.begin(), expected.end()));
+			};
+
+			{
+				// Test overwrites and deletions merged by the compactions
+				// of the style
+				KVStore styledStore(dir, options);
+				std::mt19937_64 rng(2029);
+				for (i = 0; i < number * 4; ++i) {
+					uint64_t key = rng() % number;
+					if (i % 4 == 0) {
+						EXPECT(expected.erase(key) > 0, styledStore.del(key));
+					} else {
+						styledStore.put(key, value(i, 'a'));
+						expected[key] = value(i, 'a');
+					}
+				}
+				EXPECT(true, styledStore.getStatistics().compactionNumber > 0);
+				check(styledStore);
+				phase();
+			}
+			{
+				// Test the sorted runs after reopening the store
+				KVStore styledStore(dir, options);
+				check(styledStore);
+				phase();
+
+				styledStore.reset();
+			}
+			std::filesystem::remove_all(dir);
+		}
+
+		report();
+	}
+
+	void level_bytes_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 2;
+		const uint32_t multiplier = 3;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 1024 + 1, c + i % 26); };
+
+		// Bytes of the SSTs of every level
+		auto getLevelBytes = [](const std::string &dir) {
+			std::vector<uint64_t> levelBytes;
+			std::string levelDir;
+			while (std::filesystem::exists(levelDir = dir + "/level-" + std::to_string(levelBytes.size()))) {
+				levelBytes.push_back(0);
+				for (const auto &file : std::filesystem::directory_iterator(levelDir))
+					levelBytes.back() += file.file_size();
+			}
+			return levelBytes;
+		};
+
+		store.reset();
+		for (bool dynamic : {false, true}) {
+			std::string dir = dynamic ? "./data/dynamic-levels" : "./data/static-levels";
+			Options options;
+			options.levelBaseBytes = MAX_SSTABLE_SIZE;
+			options.levelSizeMultiplier = multiplier;
+			options.dynamicLevelBytes = dynamic;
+			std::map<uint64_t, std::string> expected;
+			std::list<std::pair<uint64_t, std::string>> list;
+
+			auto check = [&](KVStore &leveledStore) {
+				for (i = 0; i < number; ++i)
+					EXPECT(expected.count(i) ? expected[i] : not_found, leveledStore.get(i));
+				list.clear();
+				leveledStore.scan(0, number, list);
+				EXPECT(true, list == decltype(list)(expected.begin(), expected.end()));
+
+				// Every level below L0 is within its target once the
+				// compactions are done: levelBaseBytes times the multiplier
+				// per level, or in the dynamic mode, the last level divided
+				// by the multiplier per level above it
+				std::vector<uint64_t> levelBytes = getLevelBytes(dir);
+				size_t lastLevel = levelBytes.size() - 1;
+				while (lastLevel > 1 && levelBytes[lastLevel] == 0)
+					lastLevel--;
+				EXPECT(true, lastLevel > 2);
+				std::vector<uint64_t> targets(levelBytes.size(), MAX_SSTABLE_SIZE);
+				for (size_t level = 2; level < levelBytes.size(); ++level)
+					targets[level] = targets[level - 1] * multiplier;
+				uint64_t target = levelBytes[lastLevel];
+				for (size_t level = lastLevel - 1; dynamic && level >= 1; --level)
+					targets[level] = std::max<uint64_t>(target /= multiplier, MAX_SSTABLE_SIZE);
+				for (size_t level = 1; level < (dynamic ? lastLevel : levelBytes.size()); ++level)
+					EXPECT(true, levelBytes[level] <= targets[level]);
+			};
+
+			{
+				// Test overwrites and deletions merged into levels sized
+				// in bytes
+				KVStore leveledStore(dir, options);
+				std::mt19937_64 rng(2030);
+				for (i = 0; i < number * 4; ++i) {
+					uint64_t key = rng() % number;
+					if (i % 4 == 0) {
+						EXPECT(expected.erase(key) > 0, leveledStore.del(key));
+					} else {
+						leveledStore.put(key, value(i, 'a'));
+						expected[key] = value(i, 'a');
+					}
+				}
+				check(leveledStore);
+				phase();
+			}
+			{
+				// Test the levels after reopening the store
+				KVStore leveledStore(dir, options);
+				check(leveledStore);
+				phase();
+
+				leveledStore.reset();
+			}
+			std::filesystem::remove_all(dir);
+		}
+
+		report();
+	}
+
+	void picker_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 2;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 1024 + 1, c + i % 26); };
+
+		// Leveled compaction that checks every SST it pushes down against
+		// the SST the picker should start with
+		class CheckedCompaction : public LeveledCompaction {
+		public:
+			const CompactionPicker picker;
+			std::unordered_map<size_t, LsmKey> cursors;
+			uint64_t pickNumber = 0;
+			uint64_t wrongPickNumber = 0;
+			uint64_t wrapNumber = 0;    // Round-robin picks back at the start of the level.
+
+			explicit CheckedCompaction(const Options &options)
+				: LeveledCompaction(options), picker(options.compactionPicker) {}
+
+			static double getOverlappingRatio(const SSTPtr &sst, const Levels &levels)
+			{
+				uint64_t bytes = 0;
+				if (levels.count(sst->getLevel() + 1))
+					for (const auto &lowerSST : *levels.at(sst->getLevel() + 1))
+						if (lowerSST->getMinKey() <= sst->getMaxKey() && lowerSST->getMaxKey() >= sst->getMinKey())
+							bytes += lowerSST->getFileSize();
+				return (double)bytes / sst->getFileSize();
+			}
+
+			bool pickCompaction(const Levels &levels, const std::vector<SubLevel> &L0SubLevels,
+			                    CompactionTask &task) override
+			{
+				if (!LeveledCompaction::pickCompaction(levels, L0SubLevels, task))
+					return false;
+				if (task.kind != PUSH_DOWN)
+					return true;
+
+				const std::vector<SSTPtr> &levelSSTs = *levels.at(task.level);
+				SSTPtr expectedSST = levelSSTs.front();
+				if (picker == MIN_OVERLAPPING_RATIO_PICKER) {
+					for (const auto &sst : levelSSTs)
+						if (getOverlappingRatio(sst, levels) < getOverlappingRatio(expectedSST, levels))
+							expectedSST = sst;
+					if (getOverlappingRatio(task.SSTs.front(), levels) != getOverlappingRatio(expectedSST, levels))
+						wrongPickNumber++;
+				} else if (cursors.count(task.level)) {
+					// The first SST past the last pick, or the first SST
+					// once the picks reach the end of the level
+					for (const auto &sst : levelSSTs) {
+						if (sst->getMinKey() > cursors[task.level]) {
+							expectedSST = sst;
+							break;
+						}
+					}
+					if (expectedSST == levelSSTs.front())
+						wrapNumber++;
+					if (task.SSTs.front() != expectedSST)
+						wrongPickNumber++;
+				}
+				if (picker == ROUND_ROBIN_PICKER)
+					cursors[task.level] = task.SSTs.back()->getMaxKey();
+				pickNumber++;
+				return true;
+			}
+		};
+
+		store.reset();
+		for (CompactionPicker picker : {MIN_OVERLAPPING_RATIO_PICKER, ROUND_ROBIN_PICKER}) {
+			std::string dir = picker == ROUND_ROBIN_PICKER ? "./data/round-robin" : "./data/min-overlapping-ratio";
+			Options options;
+			options.compactionPicker = picker;
+			options.levelBaseBytes = MAX_SSTABLE_SIZE;  // Push down often.
+			options.tombstoneCompactionRatio = 0;   // Push down only the SSTs the picker orders.
+			std::map<uint64_t, std::string> expected;
+			std::list<std::pair<uint64_t, std::string>> list;
+
+			auto check = [&](KVStore &pickedStore) {
+				for (i = 0; i < number; ++i)
+					EXPECT(expected.count(i) ? expected[i] : not_found, pickedStore.get(i));
+				list.clear();
+				pickedStore.scan(0, number, list);
+				EXPECT(true, list == decltype(list)(expected.begin(), expected.end()));
+			};
+
+			{
+				// Test overwrites and deletions merged by the SSTs the
+				// picker pushes down, and for round-robin, that the picks
+				// go through the key space of a level and start over
+				auto strategy = std::make_shared<CheckedCompaction>(options);
+				options.compactionStrategy = strategy;
+				KVStore pickedStore(dir, options);
+				std::mt19937_64 rng(2032);
+				for (i = 0; i < number * 4; ++i) {
+					uint64_t key = rng() % number;
+					if (i % 4 == 0) {
+						EXPECT(expected.erase(key) > 0, pickedStore.del(key));
+					} else {
+						pickedStore.put(key, value(i, 'a'));
+						expected[key] = value(i, 'a');
+					}
+				}
+				EXPECT(true, strategy->pickNumber > 0);
+				EXPECT((uint64_t)0, strategy->wrongPickNumber);
+				if (picker == ROUND_ROBIN_PICKER)
+					EXPECT(true, strategy->wrapNumber > 0 && strategy->wrapNumber < strategy->pickNumber);
+				check(pickedStore);
+				phase();
+			}
+			{
+				// Test the levels after reopening the store
+				options.compactionStrategy = std::make_shared<CheckedCompaction>(options);
+				KVStore pickedStore(dir, options);
+				check(pickedStore);
+				phase();
+
+				pickedStore.reset();
+			}
+			std::filesystem::remove_all(dir);
+		}
+
+		report();
+	}
+
+	void trivial_move_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 2;
+		const std::string dir = "./data/trivial-move";
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 2048 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			// Test that SSTs of keys written in order are moved down the
+			// levels as they are, never rewritten
+			KVStore movedStore(dir);
+			for (i = 0; i < number; ++i)
+				movedStore.put(i, value(i, 'a'));
+			const Statistics &stats = movedStore.getStatistics();
+			EXPECT(true, stats.trivialMoveNumber > 0);
+			EXPECT((uint64_t)0, stats.compactionBytesWritten);
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, 'a'), movedStore.get(i));
+			phase();
+
+			// Test overwrites merged into the moved SSTs
+			for (i = 0; i < number; i += 3)
+				movedStore.put(i, value(i, 'b'));
+			EXPECT(true, stats.compactionBytesWritten > 0);
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, i % 3 ? 'a' : 'b'), movedStore.get(i));
+		}
+		{
+			// Test the moved SSTs after reopening the store
+			KVStore movedStore(dir);
+			EXPECT(true, movedStore.verifyChecksums());
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, i % 3 ? 'a' : 'b'), movedStore.get(i));
+			phase();
+
+			movedStore.reset();
+		}
+		std::filesystem::remove_all(dir);
+
+		report();
+	}
+
+	static std::string range_value(uint64_t key, char c)
+	{
+		return std::string(key % 512 + 1, c);
+	}
+
+	void range_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t start = max / 4;
+		uint64_t end = max / 2 - 1;
+		std::list<std::pair<uint64_t, std::string>> list;
+
+		store.reset();
+		for (i = 0; i < max; ++i)
+			store.put(i, range_value(i, 's'));
+
+		// Test scans
+		store.scan(start, end, list);
+		EXPECT(end - start + 1, (uint64_t)list.size());
+		i = start;
+		for (const auto &pair : list) {
+			EXPECT(i, pair.first);
+			EXPECT(range_value(i, 's'), pair.second);
+			++i;
+		}
+		phase();
+
+		// Test range deletions
+		store.deleteRange(start, end);
+		for (i = 0; i < max; ++i)
+			EXPECT((i >= start && i <= end) ? not_found : range_value(i, 's'),
+			       store.get(i));
+
+		list.clear();
+		store.scan(0, max - 1, list);
+		EXPECT(max - (end - start + 1), (uint64_t)list.size());
+		phase();
+
+		// Test writes after the range deletion, through compactions
+		for (i = start; i <= end; i += 2)
+			store.put(i, range_value(i, 't'));
+		for (i = max; i < max * 2; ++i)
+			store.put(i, range_value(i, 'x'));
+
+		for (i = start; i <= end; ++i)
+			EXPECT((i & 1) ? not_found : range_value(i, 't'), store.get(i));
+
+		list.clear();
+		store.scan(start, end, list);
+		EXPECT((end - start + 2) / 2, (uint64_t)list.size());
+		phase();
+
+		report();
+	}
+
+	static Options merge_options()
+	{
+		Options options;
+		options.mergeOperator = std::make_shared<UInt64AddOperator>();
+		return options;
+	}
+
+	void merge_test(uint64_t max)
+	{
+		uint64_t i, round;
+
+		store.reset();
+		for (i = 0; i < max; i += 2)
+			store.put(i, std::to_string(i));
+
+		// Test merges onto values and onto missing keys
+		for (round = 1; round <= 4; ++round)
+			for (i = 0; i < max; ++i)
+				store.merge(i, std::to_string(round));
+
+		for (i = 0; i < max; ++i)
+			EXPECT(std::to_string((i & 1) ? 10 : i + 10), store.get(i));
+		phase();
+
+		// Test merges onto deletions
+		for (i = 0; i < max; i += 3)
+			store.del(i);
+		for (i = 0; i < max; ++i)
+			store.merge(i, "5");
+
+		for (i = 0; i < max; ++i) {
+			uint64_t expected = (i % 3 == 0) ? 5 : ((i & 1) ? 15 : i + 15);
+			EXPECT(std::to_string(expected), store.get(i));
+		}
+
+		std::list<std::pair<uint64_t, std::string>> list;
+		store.scan(0, max - 1, list);
+		EXPECT(max, (uint64_t)list.size());
+		phase();
+
+		// Test merges alone filling memTable until it flushes
+		store.reset();
+		uint64_t flushed = store.getStatistics().flushBytesWritten;
+		std::string padding(1024, '0');
+		for (i = 0; i < MAX_SSTABLE_SIZE / padding.size(); ++i)
+			store.merge(i, padding + std::to_string(i));
+		EXPECT(true, store.getStatistics().flushBytesWritten > flushed);
+		for (i = 0; i < MAX_SSTABLE_SIZE / padding.size(); ++i)
+			EXPECT(std::to_string(i), store.get(i));
+		phase();
+
+		report();
+	}
+
+	void batch_test(uint64_t max)
+	{
+		uint64_t i;
+		WriteBatch batch;
+
+		store.reset();
+
+		// Test sorted batches
+		for (i = 0; i < max; ++i) {
+			batch.put(i, std::string(i % 512 + 1, 's'));
+			if (batch.size() == 1024) {
+				store.write(batch);
+				batch.clear();
+			}
+		}
+		store.write(batch);
+		batch.clear();
+
+		for (i = 0; i < max; ++i)
+			EXPECT(std::string(i % 512 + 1, 's'), store.get(i));
+		phase();
+
+		// Test unsorted batches that write a key more than once
+		for (i = max; i > 0; --i) {
+			uint64_t key = i - 1;
+			if (key & 1) {
+				batch.put(key, "t");
+				batch.del(key);
+			} else {
+				batch.del(key);
+				batch.merge(key, "1");
+				batch.merge(key, "2");
+			}
+			if (batch.size() >= 1024) {
+				store.write(batch);
+				batch.clear();
+			}
+		}
+		store.write(batch);
+
+		for (i = 0; i < max; ++i)
+			EXPECT((i & 1) ? not_found : std::string("3"), store.get(i));
+		phase();
+
+		report();
+	}
+
+	void pin_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 16;
+		PinnableValue pinned;
+		std::string buffer;
+
+		store.reset();
+
+		// Test large values moved in and viewed in, then pinned in SSTs
+		for (i = 0; i < number; ++i) {
+			std::string value((i % 8 + 1) * 1024, 'a' + i % 26);
+			if (i & 1)
+				store.put(i, std::string_view(value));
+			else
+				store.put(i, std::move(value));
+		}
+
+		for (i = 0; i < number; ++i) {
+			EXPECT(true, store.get(i, pinned));
+			EXPECT(std::string((i % 8 + 1) * 1024, 'a' + i % 26), pinned.toString());
+		}
+		EXPECT(true, store.get(0, pinned) && pinned.isPinned());
+		EXPECT(false, store.get(number, pinned));
+		EXPECT(0, pinned.size());
+		phase();
+
+		// Test that a pinned value outlives the compaction of its SST
+		store.get(0, pinned);
+		for (i = 0; i < number; ++i)
+			store.put(i, std::string(i % 16 + 1, 'p'));
+		for (i = 0; i < number; ++i)
+			store.put(i + number, std::string(1024, 'q'));
+		EXPECT(std::string(1024, 'a'), pinned.toString());
+
+		for (i = 0; i < number * 2; ++i) {
+			EXPECT(true, store.get(i, buffer));
+			EXPECT(i < number ? std::string(i % 16 + 1, 'p') : std::string(1024, 'q'), buffer);
+		}
+		phase();
+
+		report();
+	}
+
+	void snapshot_test(uint64_t max)
+	{
+		uint64_t i;
+
+		store.reset();
+
+		// Test reads and scans of snapshots taken between overwrites,
+		// deletions, merges and range deletions that go through compactions
+		for (i = 0; i < max; ++i)
+			store.put(i, std::string(i % 256 + 1, 'a'));
+		const Snapshot *first = store.getSnapshot();
+
+		for (i = 0; i < max; ++i) {
+			if (i % 3 == 0)
+				store.put(i, std::string(i % 256 + 1, 'b'));
+			else if (i % 3 == 1)
+				store.del(i);
+		}
+		store.deleteRange(max / 4, max / 2 - 1);
+		const Snapshot *second = store.getSnapshot();
+
+		for (i = 0; i < max; ++i)
+			store.put(i, "1");
+		for (i = 0; i < max; ++i)
+			store.merge(i, "2");
+
+		for (i = 0; i < max; ++i) {
+			EXPECT(std::string(i % 256 + 1, 'a'), store.get(i, first));
+			std::string expected = i % 3 == 0 ? std::string(i % 256 + 1, 'b')
+				: i % 3 == 1 ? not_found : std::string(i % 256 + 1, 'a');
+			if (i >= max / 4 && i < max / 2)
+				expected = not_found;
+			EXPECT(expected, store.get(i, second));
+			EXPECT("3", store.get(i));
+		}
+		phase();
+
+		std::list<std::pair<uint64_t, std::string>> list;
+		store.scan(0, max - 1, list, first);
+		EXPECT(max, list.size());
+		list.clear();
+		store.scan(0, max - 1, list, second);
+		uint64_t visible = 0;
+		for (i = 0; i < max; ++i)
+			if (i % 3 != 1 && (i < max / 4 || i >= max / 2))
+				visible++;
+		EXPECT(visible, list.size());
+		phase();
+
+		// Test that released snapshots no longer hold versions
+		store.releaseSnapshot(first);
+		store.releaseSnapshot(second);
+		for (i = 0; i < max; ++i)
+			store.put(i, std::string(i % 256 + 1, 'c'));
+		for (i = 0; i < max; ++i)
+			EXPECT(std::string(i % 256 + 1, 'c'), store.get(i));
+		phase();
+
+		report();
+	}
+
+	void blob_test(uint64_t max)
+	{
+		uint64_t i, round;
+		uint64_t number = max / 16;
+		PinnableValue pinned;
+		std::list<std::pair<uint64_t, std::string>> list;
+		Options options;
+		options.mergeOperator = std::make_shared<StringAppendOperator>();
+		options.enableBlobFiles = true;
+		options.minBlobSize = 1024;
+
+		// Large values go into blob files, small ones stay in the SSTs
+		auto initial = [](uint64_t i) { return std::string(i & 1 ? 4096 : 16, 'a' + i % 26); };
+		auto current = [&](uint64_t i, char c) {
+			if (i % 4 == 0)
+				return i % 5 == 0 ? std::string("m") : not_found;
+			std::string value = i & 1 && i % 3 != 0 ? std::string(4096, c) : initial(i);
+			return i % 5 == 0 ? value + ",m" : value;
+		};
+
+		store.reset();
+		{
+			KVStore blobStore("./data", options);
+
+			// Test values in blob files next to values in the SSTs
+			for (i = 0; i < number; ++i)
+				blobStore.put(i, initial(i));
+			for (i = 0; i < number; ++i)
+				EXPECT(initial(i), blobStore.get(i));
+			EXPECT(true, blobStore.get(1, pinned) && pinned.isPinned());
+			blobStore.scan(0, number - 1, list);
+			EXPECT(number, list.size());
+			EXPECT(initial(number - 1), list.back().second);
+			phase();
+
+			// Test overwrites, deletions and merges of values in blob files,
+			// read as of now and as of a snapshot taken before them
+			const Snapshot *snapshot = blobStore.getSnapshot();
+			for (i = 0; i < number; ++i) {
+				if (i % 4 == 0)
+					blobStore.del(i);
+				else if (i & 1 && i % 3 != 0)
+					blobStore.put(i, std::string(4096, 'z'));
+				if (i % 5 == 0)
+					blobStore.merge(i, "m");
+			}
+			for (i = 0; i < number; ++i) {
+				EXPECT(initial(i), blobStore.get(i, snapshot));
+				EXPECT(current(i, 'z'), blobStore.get(i));
+			}
+			blobStore.releaseSnapshot(snapshot);
+			phase();
+
+			// Test that garbage collection of the blob files keeps the
+			// values, also after reopening the store
+			for (round = 0; round < 2; ++round) {
+				for (i = 0; i < number; ++i) {
+					if (!(i & 1 && i % 3 != 0))
+						continue;
+					blobStore.put(i, std::string(4096, 'y'));
+					if (i % 5 == 0)
+						blobStore.merge(i, "m");
+				}
+			}
+			EXPECT(true, blobStore.getStatistics().blobFilesCollected > 0);
+			for (i = 0; i < number; ++i)
+				EXPECT(current(i, 'y'), blobStore.get(i));
+		}
+		{
+			KVStore blobStore("./data", options);
+			for (i = 0; i < number; ++i)
+				EXPECT(current(i, 'y'), blobStore.get(i));
+			phase();
+
+			blobStore.reset();
+		}
+
+		report();
+	}
+
+	static std::string text(uint64_t i, uint64_t size)
+	{
+		static const char *words[] = {"log ", "structured ", "merge ", "tree ", "level ", "block "};
+		std::string value;
+		for (uint64_t j = i; value.size() < size; j = j * 7 + 3)
+			value += words[j % 6];
+		value.resize(size);
+		return value;
+	}
+
+	void compression_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+		PinnableValue pinned;
+		std::list<std::pair<uint64_t, std::string>> list;
+		Options options;
+		options.mergeOperator = std::make_shared<StringAppendOperator>();
+		options.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION,
+			Compression::isSupported(ZLIB_COMPRESSION) ? ZLIB_COMPRESSION : LZ_COMPRESSION};
+
+		// Values of every size, some larger than a block, all compressible
+		auto initial = [this](uint64_t i) { return text(i, i % 7 == 0 ? 5000 : 1 + i % 600); };
+		auto current = [&](uint64_t i) {
+			if (i % 4 == 0)
+				return not_found;
+			return i % 3 == 0 ? text(i + 1, 300) : initial(i);
+		};
+
+		store.reset();
+		{
+			KVStore compressedStore("./data", options);
+
+			// Test values in compressed blocks
+			for (i = 0; i < number; ++i)
+				compressedStore.put(i, initial(i));
+			for (i = 0; i < number; ++i)
+				EXPECT(initial(i), compressedStore.get(i));
+			EXPECT(true, compressedStore.get(7, pinned));
+			EXPECT(initial(7), pinned.toString());
+			compressedStore.scan(0, number - 1, list);
+			EXPECT(number, list.size());
+			EXPECT(initial(number - 1), list.back().second);
+			phase();
+
+			// Test overwrites and deletions merged into compressed blocks
+			for (i = 0; i < number; ++i) {
+				if (i % 4 == 0)
+					compressedStore.del(i);
+				else if (i % 3 == 0)
+					compressedStore.put(i, text(i + 1, 300));
+			}
+			for (i = 0; i < number; ++i)
+				EXPECT(current(i), compressedStore.get(i));
+			list.clear();
+			compressedStore.scan(0, number - 1, list);
+			EXPECT(number - (number + 3) / 4, list.size());
+		}
+		{
+			// Test reading the blocks back after reopening the store
+			KVStore compressedStore("./data", options);
+			for (i = 0; i < number; ++i)
+				EXPECT(current(i), compressedStore.get(i));
+			phase();
+
+			compressedStore.reset();
+		}
+
+		report();
+	}
+
+	void rate_limit_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 16;
+		const uint64_t rate = 16 * 1024 * 1024;
+		auto limiter = std::make_shared<RateLimiter>(rate);
+		auto tuned = std::make_shared<RateLimiter>(rate, true);
+		Options options;
+		options.rateLimiter = limiter;
+
+		store.reset();
+		{
+			KVStore limitedStore("./data", options);
+
+			// Test that flushes and compactions take their bytes from the
+			// limiter, and are not faster than the limit
+			auto start = std::chrono::steady_clock::now();
+			for (i = 0; i < number * 4; ++i)
+				limitedStore.put(i % number, std::string(1024, 'a' + i % 26));
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			const Statistics &stats = limitedStore.getStatistics();
+			uint64_t written = limiter->getRequestedBytes(IO_HIGH) + limiter->getRequestedBytes(IO_LOW);
+			EXPECT(stats.flushBytesWritten, limiter->getRequestedBytes(IO_HIGH));
+			EXPECT(stats.compactionBytesWritten, limiter->getRequestedBytes(IO_LOW));
+			EXPECT(true, stats.compactionBytesWritten > 0);
+			EXPECT(true, elapsed.count() * rate + 2 * rate / 10 >= written);
+			for (i = 0; i < number; ++i)
+				EXPECT(std::string(1024, 'a' + (i + number * 3) % 26), limitedStore.get(i));
+			phase();
+
+			limitedStore.reset();
+		}
+
+		// Test that the auto-tuned limit follows the compaction debt
+		EXPECT(rate, tuned->getBytesPerSecond());
+		tuned->setCompactionDebt(RATE_LIMITER_DEBT_STEP);
+		EXPECT(rate * 2, tuned->getBytesPerSecond());
+		tuned->setCompactionDebt(RATE_LIMITER_DEBT_STEP * 100);
+		EXPECT(rate * RATE_LIMITER_MAX_BOOST, tuned->getBytesPerSecond());
+		tuned->setCompactionDebt(0);
+		EXPECT(rate, tuned->getBytesPerSecond());
+
+		// Test the debts of stores sharing the limiter summed, so that
+		// one store catching up does not drop the boost of another
+		int first, second;
+		tuned->setCompactionDebt(RATE_LIMITER_DEBT_STEP, &first);
+		tuned->setCompactionDebt(RATE_LIMITER_DEBT_STEP, &second);
+		EXPECT(rate * 3, tuned->getBytesPerSecond());
+		tuned->setCompactionDebt(0, &first);
+		EXPECT(rate * 2, tuned->getBytesPerSecond());
+		tuned->setCompactionDebt(0, &second);
+		EXPECT(rate, tuned->getBytesPerSecond());
+		limiter->setCompactionDebt(RATE_LIMITER_DEBT_STEP);
+		EXPECT(rate, limiter->getBytesPerSecond());
+		phase();
+
+		report();
+	}
+
+	void stall_test(uint64_t max)
+	{
+		uint64_t i, round;
+		uint64_t number = max / 16;
+		std::mt19937_64 rng(2021);
+		Options options;
+		options.enableWriteStalls = true;
+		options.softPendingCompactionBytesLimit = 1;
+		options.delayedWriteRate = 64 * 1024 * 1024;
+
+		auto fill = [&](KVStore &stalledStore) {
+			for (i = 0; i < number * 4; ++i)
+				stalledStore.put(rng() % (number * 4), std::string(1024, 'a' + i % 26));
+			for (i = 0; i < number; ++i)
+				stalledStore.put(i, std::string(1024, 'a' + i % 26));
+			for (i = 0; i < number; ++i)
+				EXPECT(std::string(1024, 'a' + i % 26), stalledStore.get(i));
+		};
+
+		// Test writes delayed past a soft limit of pending bytes any debt
+		// reaches, and stopped at such a hard limit
+		for (round = 0; round < 2; ++round) {
+			store.reset();
+			options.hardPendingCompactionBytesLimit = round == 0 ? 64 * MAX_SSTABLE_SIZE : 2;
+			KVStore stalledStore("./data", options);
+			fill(stalledStore);
+
+			const Statistics &stats = stalledStore.getStatistics();
+			EXPECT(true, (round == 0 ? stats.delayedWriteNumber : stats.stoppedWriteNumber) > 0);
+			EXPECT(stats.delayedWriteNumber + stats.stoppedWriteNumber,
+			       stats.L0FilesStallNumber + stats.pendingBytesStallNumber);
+			EXPECT(true, stats.compactionNumber > 0);
+			phase();
+
+			stalledStore.reset();
+		}
+
+		report();
+	}
+
+	void direct_io_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 8;
+		Options options;
+		options.useDirectIOForFlushAndCompaction = true;
+		options.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION};
+		options.enableBlobFiles = true;
+		options.minBlobSize = 2048;
+
+		// Sizes that are not multiples of the alignment, some in blob files
+		auto value = [](uint64_t i, char c) { return std::string(i % 3000 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			// Test flushes and compactions writing and reading past the page cache
+			KVStore directStore("./data", options);
+			for (i = 0; i < number; ++i)
+				directStore.put(i, value(i, 'a'));
+			for (i = 0; i < number; i += 2)
+				directStore.put(i, value(i, 'A'));
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, i & 1 ? 'a' : 'A'), directStore.get(i));
+			EXPECT(true, directStore.getStatistics().compactionNumber > 0);
+		}
+		{
+			KVStore directStore("./data", options);
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, i & 1 ? 'a' : 'A'), directStore.get(i));
+			phase();
+
+			directStore.reset();
+		}
+
+		report();
+	}
+
+	void sync_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 8;
+		Options options;
+		options.bytesPerSync = 64 * 1024;
+		options.syncNewFiles = true;
+		options.enableBlobFiles = true;
+		options.minBlobSize = 2048;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 3000 + 1, c + i % 26); };
+		auto count_temporary_files = []() {
+			uint64_t count = 0;
+			for (const auto& entry : std::filesystem::recursive_directory_iterator("./data"))
+				if (entry.path().extension() == ".tmp")
+					count++;
+			return count;
+		};
+
+		store.reset();
+		{
+			// Test flushes and compactions renaming every file into place
+			KVStore syncStore("./data", options);
+			for (i = 0; i < number; ++i)
+				syncStore.put(i, value(i, 'a'));
+			for (i = 0; i < number; i += 2)
+				syncStore.put(i, value(i, 'A'));
+			EXPECT(true, syncStore.getStatistics().compactionNumber > 0);
+		}
+		EXPECT(0, count_temporary_files());
+
+		// Test files left by writes that did not finish
+		std::ofstream("./data/level-0/table-999999-0-0.sst.tmp") << "partial";
+		std::ofstream("./data/blobs/999999.blob.tmp") << "partial";
+		{
+			KVStore syncStore("./data", options);
+			EXPECT(0, count_temporary_files());
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i, i & 1 ? 'a' : 'A'), syncStore.get(i));
+			phase();
+
+			syncStore.reset();
+		}
+
+		report();
+	}
+
+	void checksum_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 8;
+		Options options;
+		options.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION};
+
+		auto value = [](uint64_t i) { return std::string(i % 1024 + 512, 'a' + i % 26); };
+
+		store.reset();
+		{
+			KVStore checkedStore("./data", options);
+			for (i = 0; i < number; ++i)
+				checkedStore.put(i, value(i));
+		}
+
+		// Test reading every SST in full when opening
+		options.verifyChecksumsOnOpen = VERIFY_ALL;
+		{
+			KVStore checkedStore("./data", options);
+			for (i = 0; i < number; ++i)
+				EXPECT(value(i), checkedStore.get(i));
+			EXPECT(true, checkedStore.verifyChecksums());
+		}
+		phase();
+
+		// Test a value corrupted in the middle of an SST, which opening with
+		// the metadata checked only does not read
+		std::string corrupted;
+		for (const auto& entry : std::filesystem::recursive_directory_iterator("./data"))
+			if (entry.path().extension() == ".sst")
+				corrupted = entry.path().string();
+		{
+			std::fstream file(corrupted, std::ios::in | std::ios::out | std::ios::binary);
+			file.seekg(std::filesystem::file_size(corrupted) / 2);
+			char byte = file.get() ^ 0x5a;
+			file.seekp(std::filesystem::file_size(corrupted) / 2);
+			file.put(byte);
+		}
+		options.verifyChecksumsOnOpen = VERIFY_METADATA;
+		{
+			KVStore checkedStore("./data", options);
+			EXPECT(false, checkedStore.verifyChecksums());
+			checkedStore.reset();
+		}
+		phase();
+
+		report();
+	}
+
+	void open_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 512 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			KVStore openedStore("./data");
+			for (i = 0; i < number; ++i)
+				openedStore.put(i, value(i, 'a'));
+		}
+
+		// Test reading, writing and compacting SSTs whose metadata is
+		// loaded when the store is opened, when first used, or meanwhile
+		for (MetadataLoading loading : {LOAD_ON_OPEN, LOAD_ON_FIRST_USE, LOAD_IN_BACKGROUND}) {
+			Options options;
+			options.metadataLoading = loading;
+			char c = 'a' + loading;
+			char previous = loading == LOAD_ON_OPEN ? 'a' : c - 1;
+			{
+				KVStore openedStore("./data", options);
+				EXPECT(not_found, openedStore.get(number * 2));
+				for (i = 0; i < number; i += 2)
+					EXPECT(value(i, previous), openedStore.get(i));
+				std::list<std::pair<uint64_t, std::string>> list;
+				openedStore.scan(1, number / 2, list);
+				EXPECT(number / 2, list.size());
+				for (i = 0; i < number; ++i)
+					openedStore.put(i, value(i, c));
+			}
+			{
+				KVStore openedStore("./data", options);
+				for (i = 0; i < number; ++i)
+					EXPECT(value(i, c), openedStore.get(i));
+			}
+			phase();
+		}
+
+		KVStore("./data").reset();
+		report();
+	}
+
+	void pipeline_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+		Options options;
+		options.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION};
+		options.enableBlobFiles = true;
+		options.minBlobSize = 1024;
+		options.blobGarbageCollectionRatio = 0.9;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 2048 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			// Test compactions reading inputs ahead of the merge and writing
+			// outputs behind it, some collecting blob files meanwhile
+			KVStore pipelinedStore("./data", options);
+			for (i = 0; i < number; ++i)
+				pipelinedStore.put(i, value(i, 'a'));
+			for (i = 0; i < number; i += 2)
+				pipelinedStore.put(i, value(i, 'A'));
+			for (i = 0; i < number; i += 3)
+				pipelinedStore.del(i);
+			for (i = 0; i < number; ++i)
+				EXPECT(i % 3 ? value(i, i & 1 ? 'a' : 'A') : not_found, pipelinedStore.get(i));
+
+			const Statistics& statistics = pipelinedStore.getStatistics();
+			EXPECT(true, statistics.compactionNumber > 0);
+			EXPECT(true, statistics.compactionMicros > 0);
+			EXPECT(true, statistics.compactionReadMicros > 0);
+			EXPECT(true, statistics.compactionMergeMicros > 0);
+			EXPECT(true, statistics.compactionWriteMicros > 0);
+		}
+		{
+			KVStore pipelinedStore("./data", options);
+			for (i = 0; i < number; ++i)
+				EXPECT(i % 3 ? value(i, i & 1 ? 'a' : 'A') : not_found, pipelinedStore.get(i));
+			phase();
+
+			pipelinedStore.reset();
+		}
+
+		report();
+	}
+
+	void shard_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+		const size_t shardNumber = 4;
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 512 + 1, c + i % 26); };
+
+		store.reset();
+		for (ShardPartitioning partitioning : {HASH_PARTITIONING, RANGE_PARTITIONING}) {
+			std::string dir = partitioning == HASH_PARTITIONING ? "./data/hash-shards" : "./data/range-shards";
+			// Spread the keys over the whole key space, so that range
+			// partitioning uses every shard
+			auto key = [number](uint64_t i) { return i * (UINT64_MAX / number); };
+			std::map<uint64_t, std::string> expected;
+			{
+				// Test threads writing the shards at once
+				ShardedKVStore shardedStore(dir, shardNumber, partitioning);
+				std::vector<std::thread> writers;
+				for (size_t t = 0; t < shardNumber; ++t) {
+					writers.emplace_back([&, t]() {
+						for (uint64_t i = t; i < number; i += shardNumber)
+							shardedStore.put(key(i), value(i, 'a'));
+					});
+				}
+				for (auto& writer : writers)
+					writer.join();
+				for (i = 0; i < number; ++i)
+					expected[key(i)] = value(i, 'a');
+
+				// Test a batch split over the shards
+				WriteBatch batch;
+				for (i = 0; i < number; i += 5) {
+					batch.del(key(i));
+					expected.erase(key(i));
+				}
+				for (i = 0; i < number; i += 7) {
+					batch.put(key(i), value(i, 'A'));
+					expected[key(i)] = value(i, 'A');
+				}
+				shardedStore.write(batch);
+
+				shardedStore.deleteRange(key(number / 4), key(number / 2));
+				expected.erase(expected.lower_bound(key(number / 4)), expected.upper_bound(key(number / 2)));
+
+				for (i = 0; i < number; ++i)
+					EXPECT(expected.count(key(i)) ? expected[key(i)] : not_found, shardedStore.get(key(i)));
+				for (size_t shard = 0; shard < shardNumber; ++shard)
+					EXPECT(true, shardedStore.getStatistics(shard).userBytesWritten > 0);
+			}
+			phase();
+
+			{
+				// Test scans merging the shards in key order after reopening
+				ShardedKVStore shardedStore(dir, shardNumber, partitioning);
+				for (i = 0; i < number; ++i)
+					EXPECT(expected.count(key(i)) ? expected[key(i)] : not_found, shardedStore.get(key(i)));
+				std::list<std::pair<uint64_t, std::string>> list;
+				shardedStore.scan(key(1), key(number - 1), list);
+				EXPECT(expected.size() - expected.count(0), list.size());
+				auto it = expected.lower_bound(key(1));
+				bool ordered = true;
+				for (const auto& pair : list) {
+					ordered = ordered && it != expected.end() && pair.first == it->first
+						  && pair.second == it->second;
+					++it;
+				}
+				EXPECT(true, ordered);
+				phase();
+
+				shardedStore.reset();
+			}
+			std::filesystem::remove_all(dir);
+		}
+
+		report();
+	}
+
+	void column_family_test(uint64_t max)
+	{
+		uint64_t i;
+		uint64_t number = max / 4;
+		const std::string dir = "./data/families";
+
+		Options counterOptions;
+		counterOptions.writeBufferSize = 64 * 1024;
+		counterOptions.mergeOperator = std::make_shared<UInt64AddOperator>();
+		Options blobOptions;
+		blobOptions.enableBlobFiles = true;
+		blobOptions.minBlobSize = 1024;
+		Options logOptions;
+		logOptions.compactionStyle = TIERED_COMPACTION;
+		logOptions.compressionPerLevel = {NO_COMPRESSION, LZ_COMPRESSION};
+		logOptions.mergeOperator = std::make_shared<StringAppendOperator>();
+		std::vector<std::pair<std::string, Options>> families = {
+			{"counters", counterOptions}, {"blobs", blobOptions}, {"log", logOptions}};
+		auto rateLimiter = std::make_shared<RateLimiter>(1024 * 1048576);
+
+		auto value = [](uint64_t i, char c) { return std::string(i % 2048 + 1, c + i % 26); };
+
+		store.reset();
+		{
+			ColumnFamilyStore familyStore(dir, families, rateLimiter);
+			ColumnFamily counters = familyStore.getColumnFamily("counters");
+			ColumnFamily blobs = familyStore.getColumnFamily("blobs");
+			ColumnFamily log = familyStore.getColumnFamily("log");
+
+			// Test the same keys in every family
+			for (i = 0; i < number; ++i) {
+				familyStore.put(counters, i, std::to_string(i));
+				familyStore.put(blobs, i, value(i, 'a'));
+				familyStore.put(log, i, "x");
+			}
+			for (i = 0; i < number; i += 2) {
+				familyStore.merge(counters, i, "1");
+				familyStore.merge(log, i, "y");
+			}
+			for (i = 0; i < number; ++i) {
+				EXPECT(std::to_string(i + (i & 1 ? 0 : 1)), familyStore.get(counters, i));
+				EXPECT(value(i, 'a'), familyStore.get(blobs, i));
+				EXPECT(std::string(i & 1 ? "x" : "x,y"), familyStore.get(log, i));
+			}
+			EXPECT(true, familyStore.getStatistics(counters).flushBytesWritten
+				     > familyStore.getStatistics(log).flushBytesWritten);
+			EXPECT(true, familyStore.getStatistics(blobs).blobBytesWritten > 0);
+			EXPECT(true, rateLimiter->getRequestedBytes(IO_HIGH) > 0);
+			phase();
+
+			// Test the parts of a batch across families flushed together:
+			// the log flushes its part along with the counters
+			ColumnFamilyWriteBatch batch;
+			batch.put(counters, number, "0");
+			batch.put(log, number, "z");
+			familyStore.write(batch);
+			uint64_t counterFlushed = familyStore.getStatistics(counters).flushBytesWritten;
+			uint64_t logFlushed = familyStore.getStatistics(log).flushBytesWritten;
+			for (i = 0; familyStore.getStatistics(counters).flushBytesWritten == counterFlushed; ++i)
+				familyStore.merge(counters, number, "1");
+			EXPECT(true, familyStore.getStatistics(log).flushBytesWritten > logFlushed);
+			EXPECT(std::to_string(i), familyStore.get(counters, number));
+			EXPECT(std::string("z"), familyStore.get(log, number));
+			phase();
+
+			// Test a thread writing each family at once, while batches
+			// across all of them are written
+			std::vector<std::thread> writers;
+			for (ColumnFamily family : {counters, blobs, log}) {
+				writers.emplace_back([&, family]() {
+					for (uint64_t i = number + 1; i < number * 2; ++i)
+						familyStore.put(family, i, value(i, 'b'));
+				});
+			}
+			writers.emplace_back([&]() {
+				for (uint64_t i = number * 3; i < number * 4; i += 16) {
+					ColumnFamilyWriteBatch crossBatch;
+					for (ColumnFamily family : {counters, blobs, log})
+						crossBatch.put(family, i, "c");
+					familyStore.write(crossBatch);
+				}
+			});
+			for (auto& writer : writers)
+				writer.join();
+			for (ColumnFamily family : {counters, blobs, log}) {
+				for (i = number + 1; i < number * 2; ++i)
+					EXPECT(value(i, 'b'), familyStore.get(family, i));
+				for (i = number * 3; i < number * 4; i += 16)
+					EXPECT(std::string("c"), familyStore.get(family, i));
+			}
+			phase();
+		}
+		{
+			// Test reopening with the families in another order
+			std::reverse(families.begin(), families.end());
+			ColumnFamilyStore familyStore(dir, families);
+			ColumnFamily counters = familyStore.getColumnFamily("counters");
+			ColumnFamily blobs = familyStore.getColumnFamily("blobs");
+			ColumnFamily log = familyStore.getColumnFamily("log");
+			EXPECT((size_t)3, familyStore.getColumnFamilyNumber());
+			EXPECT((size_t)2, counters);
+			for (i = 0; i < number; ++i) {
+				EXPECT(std::to_string(i + (i & 1 ? 0 : 1)), familyStore.get(counters, i));
+				EXPECT(value(i, 'a'), familyStore.get(blobs, i));
+				EXPECT(std::string(i & 1 ? "x" : "x,y"), familyStore.get(log, i));
+			}
+			std::list<std::pair<uint64_t, std::string>> list;
+			familyStore.scan(log, 0, number, list);
+			EXPECT(number + 1, list.size());
+
+			// Test a family created in the open store
+			ColumnFamily extra = familyStore.createColumnFamily("extra");
+			familyStore.put(extra, 1, "extra");
+			EXPECT(std::string("extra"), familyStore.get(extra, 1));
+			EXPECT(not_found, familyStore.get(extra, 2));
+			phase();
+
+			familyStore.reset();
+		}
+		std::filesystem::remove_all(dir);
+
+		report();
+	}
+
 public:
-	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v)
+	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v, merge_options())
 	{
 	}
 
@@ -98,6 +1492,72 @@ public:
 
 		std::cout << "[Large Test]" << std::endl;
 		regular_test(LARGE_TEST_MAX);
+
+		std::cout << "[Level 0 Test]" << std::endl;
+		level0_test(LARGE_TEST_MAX);
+
+		std::cout << "[Subcompaction Test]" << std::endl;
+		subcompaction_test(LARGE_TEST_MAX);
+
+		std::cout << "[Compaction Style Test]" << std::endl;
+		compaction_style_test(LARGE_TEST_MAX);
+
+		std::cout << "[Level Bytes Test]" << std::endl;
+		level_bytes_test(LARGE_TEST_MAX);
+
+		std::cout << "[Picker Test]" << std::endl;
+		picker_test(LARGE_TEST_MAX);
+
+		std::cout << "[Trivial Move Test]" << std::endl;
+		trivial_move_test(LARGE_TEST_MAX);
+
+		std::cout << "[Range Test]" << std::endl;
+		range_test(LARGE_TEST_MAX);
+
+		std::cout << "[Merge Test]" << std::endl;
+		merge_test(LARGE_TEST_MAX);
+
+		std::cout << "[Batch Test]" << std::endl;
+		batch_test(LARGE_TEST_MAX);
+
+		std::cout << "[Pin Test]" << std::endl;
+		pin_test(LARGE_TEST_MAX);
+
+		std::cout << "[Snapshot Test]" << std::endl;
+		snapshot_test(LARGE_TEST_MAX);
+
+		std::cout << "[Blob Test]" << std::endl;
+		blob_test(LARGE_TEST_MAX);
+
+		std::cout << "[Compression Test]" << std::endl;
+		compression_test(LARGE_TEST_MAX);
+
+		std::cout << "[Rate Limit Test]" << std::endl;
+		rate_limit_test(LARGE_TEST_MAX);
+
+		std::cout << "[Stall Test]" << std::endl;
+		stall_test(LARGE_TEST_MAX);
+
+		std::cout << "[Direct I/O Test]" << std::endl;
+		direct_io_test(LARGE_TEST_MAX);
+
+		std::cout << "[Sync Test]" << std::endl;
+		sync_test(LARGE_TEST_MAX);
+
+		std::cout << "[Checksum Test]" << std::endl;
+		checksum_test(LARGE_TEST_MAX);
+
+		std::cout << "[Open Test]" << std::endl;
+		open_test(LARGE_TEST_MAX);
+
+		std::cout << "[Pipeline Test]" << std::endl;
+		pipeline_test(LARGE_TEST_MAX);
+
+		std::cout << "[Shard Test]" << std::endl;
+		shard_test(LARGE_TEST_MAX);
+
+		std::cout << "[Column Family Test]" << std::endl;
+		column_family_test(LARGE_TEST_MAX);
 	}
 };
 
@@ -1,26 +1,60 @@
 #include "kvstore.h"
 
-KVStore::KVStore(const std::string &dir): KVStoreAPI(dir)
+static uint64_t microsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+KVStore::KVStore(const std::string &dir, const Options& options)
+        : KVStoreAPI(dir), dataDir(dir.empty() || dir.back() == '/' ? dir : dir + "/"),
+          deleteMode(options.deleteMode), mergeOperator(options.mergeOperator), blobStore(dataDir),
+          enableBlobFiles(options.enableBlobFiles), minBlobSize(options.minBlobSize),
+          blobGarbageCollectionRatio(options.blobGarbageCollectionRatio),
+          compressionPerLevel(options.compressionPerLevel), rateLimiter(options.rateLimiter),
+          writeController(options), useDirectIO(options.useDirectIOForFlushAndCompaction),
+          fileWriteOptions{options.useDirectIOForFlushAndCompaction, options.bytesPerSync, options.syncNewFiles,
+                           options.rateLimiter, IO_LOW},
+          flushWriteOptions{options.useDirectIOForFlushAndCompaction, options.bytesPerSync, options.syncNewFiles,
+                            options.rateLimiter, IO_HIGH},
+          verifyChecksumsOnOpen(options.verifyChecksumsOnOpen), metadataLoading(options.metadataLoading),
+          stopMetadataWarmUp(false), writeBufferSize(options.writeBufferSize),
+          maxSubcompactions(max(options.maxSubcompactions, 1u)), nextFileNumber(1)
 {
-    if (!utils::dirExists(dir))
-        utils::mkdir(dir.c_str());
+    for (CompressionType compression : compressionPerLevel) {
+        if (!Compression::isSupported(compression)) {
+            cerr << "Compression type " << (int)compression << " is not supported by this build." << endl;
+            exit(-1);
+        }
+    }
+
+    if (!utils::dirExists(dataDir))
+        utils::mkdir(dataDir.c_str());
 
     memTable = make_shared<MemTable>();
     memTableSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
     ssTables = unordered_map<size_t, shared_ptr<vector<SSTPtr>>>();
     ssTables[0] = make_shared<vector<SSTPtr>>();
+    fences = unordered_map<size_t, FencePointers>();
     timeStamp = 1;
+    lastSequence = 0;
+    compactionStrategy = options.compactionStrategy ? options.compactionStrategy
+                                                    : CompactionStrategy::create(options);
 
     readAllSSTsFromDisk();
+    readBlobFilesFromDisk();
     detectAndHandleOverflow();
+    if (metadataLoading == LOAD_IN_BACKGROUND)
+        startMetadataWarmUp();
 
 }
 
 KVStore::~KVStore() {
+    joinMetadataWarmUp();
     if (!memTable->empty()) {
         memToDisk();
         detectAndHandleOverflow();
     }
+    if (rateLimiter)
+        rateLimiter->setCompactionDebt(0, this);
 }
 
 /**
@@ -29,18 +63,29 @@ KVStore::~KVStore() {
  */
 void KVStore::put(uint64_t key, const std::string &s)
 {
-    if (memTableOverflow(s)) {
-        memToDisk();
+    put(key, std::string(s));
+}
 
-        // Update states
-        memTable->reset();
-        memTableSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+void KVStore::put(uint64_t key, std::string_view s)
+{
+    put(key, std::string(s));
+}
 
-        detectAndHandleOverflow();
-    }
+void KVStore::put(uint64_t key, const char *s)
+{
+    put(key, std::string(s));
+}
 
-    memTable->put(key, s);
-    memTableSize += (DATA_INDEX_SIZE + s.size());
+/**
+ * Move the value into memTable without copying it.
+ */
+void KVStore::put(uint64_t key, std::string &&s)
+{
+    uint64_t size = s.size();
+    makeRoomForWrite(DATA_INDEX_SIZE + size);
+    memTable->put(key, std::move(s), TYPE_VALUE, ++lastSequence, getNewestSnapshot());
+    memTableSize += (DATA_INDEX_SIZE + size);
+    statistics.userBytesWritten += sizeof(key) + size;
 }
 /**
  * Returns the (string) value of the given key.
@@ -48,16 +93,127 @@ void KVStore::put(uint64_t key, const std::string &s)
  */
 std::string KVStore::get(uint64_t key)
 {
-    LsmValue memValue = memTable->get(key);
-    if (memValue == DELETE_SIGN)
-        return "";
-    if (memValue.length() != 0)
-        return memValue;
+    return get(key, nullptr);
+}
+
+/**
+ * Returns the value of the key as of the snapshot, or as of now if the
+ * snapshot is nullptr. An empty string indicates not found.
+ */
+std::string KVStore::get(uint64_t key, const Snapshot *snapshot)
+{
+    statistics.getNumber++;
 
-    LsmValue sstValue = getValueFromDisk(key);
-    if (sstValue == DELETE_SIGN)
+    LsmEntry entry;
+    if (!getEntry(key, getSnapshotSequence(snapshot), entry) || entry.type == TYPE_DELETION)
         return "";
-    return sstValue;
+    return std::move(entry.value);
+}
+
+/**
+ * Get the value without copying it: a value read from an SST stays in the
+ * mapping of the file and is pinned by `value`.
+ * @return false if the key is not found, in which case `value` is reset.
+ * Unlike `get(key)`, an empty value is told apart from a missing key.
+ */
+bool KVStore::get(uint64_t key, PinnableValue &value, const Snapshot *snapshot)
+{
+    statistics.getNumber++;
+
+    LsmEntry entry;
+    if (getEntry(key, getSnapshotSequence(snapshot), entry, &value) && entry.type != TYPE_DELETION)
+        return true;
+    value.reset();
+    return false;
+}
+
+/**
+ * Copy the value into the caller's buffer, reusing its capacity.
+ * @return false if the key is not found, in which case `value` is unchanged.
+ */
+bool KVStore::get(uint64_t key, std::string &value, const Snapshot *snapshot)
+{
+    PinnableValue pinned;
+    if (!get(key, pinned, snapshot))
+        return false;
+    value.assign(pinned.value());
+    return true;
+}
+/**
+ * Combine the operand with the value of the key using the merge operator
+ * of the store, without reading the value: the operand is stored and
+ * applied by later gets and compactions.
+ */
+void KVStore::merge(uint64_t key, const std::string &operand)
+{
+    if (!mergeOperator) {
+        cerr << "No merge operator is set." << endl;
+        exit(-1);
+    }
+
+    makeRoomForWrite(DATA_INDEX_SIZE + operand.size());
+
+    // Fold the operand into the entry already in memTable, unless a snapshot
+    // sees that entry.
+    LsmEntry entry{TYPE_MERGE, operand, ++lastSequence};
+    LsmEntry olderEntry;
+    SequenceNumber newestSnapshot = getNewestSnapshot();
+    if (memTable->get(key, olderEntry) && olderEntry.sequence > newestSnapshot) {
+        if (rangeTombstones.covers(key, olderEntry.sequence))
+            olderEntry.type = TYPE_DELETION;
+        foldMerge(key, entry, &olderEntry);
+    }
+
+    uint64_t size = entry.value.size();
+    memTable->put(key, std::move(entry.value), entry.type, entry.sequence, newestSnapshot);
+    memTableSize += (DATA_INDEX_SIZE + size);
+    statistics.userBytesWritten += sizeof(key) + operand.size();
+}
+/**
+ * Apply all the writes of the batch with a single overflow check, so that
+ * they land in the same memTable and the same L0 SST. A batch larger than
+ * an SST is still applied whole.
+ */
+void KVStore::write(const WriteBatch& batch)
+{
+    if (batch.empty())
+        return;
+
+    makeRoomForWrite(batch.getByteSize());
+
+    // Order the writes by key, keeping the batch order of each key.
+    vector<pair<LsmKey, LsmEntry>> entries(batch.getEntries());
+    for (auto& entry : entries)
+        entry.second.sequence = ++lastSequence;
+    auto keyLess = [](const pair<LsmKey, LsmEntry>& e1, const pair<LsmKey, LsmEntry>& e2) {
+        return e1.first < e2.first;
+    };
+    if (!is_sorted(entries.begin(), entries.end(), keyLess))
+        stable_sort(entries.begin(), entries.end(), keyLess);
+
+    // Combine the writes of each key, and merges with the entries in memTable
+    // that no snapshot sees. No snapshot can see a part of the batch.
+    vector<pair<LsmKey, LsmEntry>> combinedEntries;
+    SequenceNumber newestSnapshot = getNewestSnapshot();
+    for (auto& entry : entries) {
+        if (!combinedEntries.empty() && combinedEntries.back().first == entry.first) {
+            foldMerge(entry.first, entry.second, &combinedEntries.back().second);
+            combinedEntries.back().second = std::move(entry.second);
+            continue;
+        }
+        LsmEntry olderEntry;
+        if (entry.second.type == TYPE_MERGE && memTable->get(entry.first, olderEntry)
+            && olderEntry.sequence > newestSnapshot) {
+            if (rangeTombstones.covers(entry.first, olderEntry.sequence))
+                olderEntry.type = TYPE_DELETION;
+            foldMerge(entry.first, entry.second, &olderEntry);
+        }
+        combinedEntries.push_back(std::move(entry));
+    }
+
+    memTable->putSorted(combinedEntries, newestSnapshot);
+    memTableSize += batch.getByteSize();
+    statistics.userBytesWritten += batch.getUserByteSize();
 }
 /**
  * Delete the given key-value pair if it exists.
@@ -65,71 +221,284 @@ std::string KVStore::get(uint64_t key)
  */
 bool KVStore::del(uint64_t key)
 {
-    LsmValue value = get(key);
-    bool find = (value.length() != 0) && (value != DELETE_SIGN);
-    memTable->put(key, DELETE_SIGN);
+    return del(key, deleteMode);
+}
+/**
+ * Delete the given key-value pair, telling whether it existed as precisely
+ * as the mode allows. Only CHECKED_DELETE may read the disk.
+ */
+bool KVStore::del(uint64_t key, DeleteMode mode)
+{
+    bool find;
+    switch (mode) {
+        case BLIND_DELETE:
+            find = true;
+            break;
+        case PROBABLE_DELETE:
+            find = keyProbablyExists(key);
+            break;
+        default:
+            find = get(key).length() != 0;
+    }
+
+    makeRoomForWrite(DATA_INDEX_SIZE);
+    memTable->put(key, "", TYPE_DELETION, ++lastSequence, getNewestSnapshot());
+    memTableSize += DATA_INDEX_SIZE;
+    statistics.userBytesWritten += sizeof(key);
     return find;
 }
 
+/**
+ * Delete every key in [start, end] with one range tombstone instead of one
+ * deletion per key. The keys in memTable are removed at once unless a
+ * snapshot may see them, and SSTs that lie wholly inside the range are
+ * removed from the disk.
+ */
+void KVStore::deleteRange(uint64_t start, uint64_t end)
+{
+    if (start > end)
+        return;
+
+    makeRoomForWrite(sizeof(start) + sizeof(end));
+    if (snapshots.empty()) {
+        // A merged value may outgrow the bytes counted for its operands.
+        uint64_t removedBytes = memTable->delRange(start, end);
+        memTableSize -= min(removedBytes, memTableSize - (HEADER_SIZE + BLOOM_FILTER_SIZE));
+    }
+    rangeTombstones.add(RangeTombstone(start, end, ++lastSequence));
+    statistics.userBytesWritten += sizeof(start) + sizeof(end);
+
+    dropCoveredSSTs();
+    removeObsoleteRangeTombstones();
+    rangeTombstones.writeToFile(getRangeTombstoneFilename(), flushWriteOptions);
+    collectBlobGarbage();
+}
+
+/**
+ * Append the key-value pairs whose keys are in [start, end] to the list in
+ * key order, as of the snapshot, or as of now if the snapshot is nullptr.
+ */
+void KVStore::scan(uint64_t start, uint64_t end, std::list<std::pair<uint64_t, std::string>> &list,
+                   const Snapshot *snapshot)
+{
+    if (start > end)
+        return;
+
+    // Collect the SSTs that overlap the range.
+    vector<SSTPtr> SSTs;
+    for (const auto& sst : *ssTables[0])
+        if (sst->getMaxKey() >= start && sst->getMinKey() <= end)
+            SSTs.push_back(sst);
+    size_t levelNumber = ssTables.size();
+    for (size_t n = 1; n < levelNumber; ++n) {
+        size_t first, last;
+        if (!fences[n].overlap(start, end, first, last))
+            continue;
+        const vector<SSTPtr>& levelSSTs = *ssTables[n];
+        for (size_t i = first; i < last; ++i)
+            SSTs.push_back(levelSSTs[i]);
+    }
+
+    // Gather every version of the keys in the range from the SSTs and memTable.
+    KVPair data;
+    for (const auto& sst : SSTs) {
+        vector<pair<LsmKey, LsmEntry>> sstEntries;
+        sst->scan(start, end, sstEntries);
+        for (auto& sstEntry : sstEntries)
+            data[sstEntry.first].push_back(std::move(sstEntry.second));
+    }
+    vector<pair<LsmKey, LsmEntry>> memEntries;
+    memTable->scan(start, end, memEntries);
+    for (auto& memEntry : memEntries)
+        data[memEntry.first].push_back(std::move(memEntry.second));
+
+    vector<LsmKey> keys;
+    for (const auto& pair : data)
+        keys.push_back(pair.first);
+    sort(keys.begin(), keys.end());
+
+    SequenceNumber sequence = getSnapshotSequence(snapshot);
+    for (const auto& key : keys) {
+        LsmEntry entry;
+        if (!resolveVersions(key, data[key], sequence, entry) || entry.type == TYPE_DELETION)
+            continue;
+        readBlobValue(entry);
+        list.emplace_back(key, std::move(entry.value));
+    }
+}
+
+/**
+ * Take a snapshot of the store as it is now. The snapshot must be released
+ * by `releaseSnapshot` before the store is destroyed.
+ */
+const Snapshot* KVStore::getSnapshot()
+{
+    snapshots.insert(lastSequence);
+    return new Snapshot(lastSequence);
+}
+
+/**
+ * Release a snapshot, so that compactions may discard the versions only it sees.
+ */
+void KVStore::releaseSnapshot(const Snapshot *snapshot)
+{
+    snapshots.erase(snapshots.find(snapshot->getSequence()));
+    delete snapshot;
+}
+
 /**
  * Reset the LSM Tree. All key-value pairs should be removed, including
- * memtable and all SST files.
+ * memtable and all SST files. Every snapshot must be released first, since
+ * sequence numbers start over.
  */
 void KVStore::reset()
 {
+    if (!snapshots.empty()) {
+        cerr << "Cannot reset the store while snapshots are live." << endl;
+        exit(-1);
+    }
+
+    joinMetadataWarmUp();
     clearDisk();
     memTable->reset();
     memTableSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
     ssTables.clear();
     ssTables[0] = make_shared<vector<SSTPtr>>();
+    fences.clear();
+    rebuildFences(0);
+    rangeTombstones.clear();
     timeStamp = 1;
+    lastSequence = 0;
+    nextFileNumber = 1;
+}
+
+/**
+ * Read every SST in full and check it against its checksums.
+ * @return false if any SST is corrupted.
+ */
+bool KVStore::verifyChecksums() const {
+    for (const auto& level : ssTables)
+        for (const auto& sst : *level.second)
+            if (!sst->verifyChecksums(useDirectIO))
+                return false;
+    return true;
+}
+
+const Statistics& KVStore::getStatistics() const {
+    return statistics;
 }
 
+/**
+ * Read the metadata of the SSTs not yet read on a thread of its own, from
+ * the upper levels down, which reads search first. The thread keeps the SSTs
+ * it was started with, and compactions may remove their files meanwhile, so
+ * an SST must be loaded before its file goes.
+ */
+void KVStore::startMetadataWarmUp() {
+    vector<SSTPtr> SSTs;
+    for (size_t level = 0; level < ssTables.size(); ++level)
+        SSTs.insert(SSTs.end(), ssTables[level]->begin(), ssTables[level]->end());
+    metadataWarmUp = thread([this, SSTs = std::move(SSTs)]() {
+        for (const auto& sst : SSTs) {
+            if (stopMetadataWarmUp.load(memory_order_relaxed))
+                return;
+            sst->loadMetadata();
+        }
+    });
+}
+
+/**
+ * Stop warming up the metadata, and wait for the SST being loaded.
+ */
+void KVStore::joinMetadataWarmUp() {
+    stopMetadataWarmUp = true;
+    if (metadataWarmUp.joinable())
+        metadataWarmUp.join();
+}
+
+/**
+ * Open the SSTs of every level, on up to MAX_OPEN_THREADS threads.
+ */
 void KVStore::readAllSSTsFromDisk() {
-    size_t level = 0;
-    string levelDir = "./data/level-" + to_string(level) + "/";
-    vector<string> filenames;
-    bool emptyL0;
 
+    // Find the files of every level first.
+    vector<pair<string, size_t>> files;     // Name and level.
+    size_t levelNumber = 0;
+    string levelDir = getLevelDir(0);
+    vector<string> filenames;
     while (utils::dirExists(levelDir)) {
         utils::scanDir(levelDir, filenames);
-        vector<SSTPtr> levelSSTs;
         for (const auto& filename : filenames) {
             string sstName = levelDir + filename;
-            SSTPtr sst = readSSTFromDisk(sstName, level);
-            levelSSTs.push_back(sst);
+            if (FileWriter::isTemporaryFile(filename)) {
+                utils::rmfile(sstName.c_str());     // Left by a write that did not finish.
+                continue;
+            }
+            files.emplace_back(sstName, levelNumber);
+        }
+        ++levelNumber;
+        levelDir = getLevelDir(levelNumber);
+        filenames.clear();
+    }
+
+    // The threads take the next file left until there is none.
+    vector<SSTPtr> SSTs(files.size());
+    atomic<size_t> nextFile(0);
+    auto openFiles = [&]() {
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++)
+            SSTs[i] = readSSTFromDisk(files[i].first, files[i].second);
+    };
+    size_t threadNumber = min<size_t>({files.size(), MAX_OPEN_THREADS, max(thread::hardware_concurrency(), 1u)});
+    vector<thread> workers;
+    for (size_t i = 1; i < threadNumber; ++i)
+        workers.emplace_back(openFiles);
+    openFiles();
+    for (auto& worker : workers)
+        worker.join();
+
+    vector<vector<SSTPtr>> SSTsOfLevels(levelNumber);
+    for (size_t i = 0; i < files.size(); ++i)
+        SSTsOfLevels[files[i].second].push_back(SSTs[i]);
+
+    for (size_t level = 0; level < levelNumber; ++level) {
+        vector<SSTPtr>& levelSSTs = SSTsOfLevels[level];
+
+        // Continue after the newest SST of any level, which may not be in
+        // L0 or L1 if compactions moved it further down.
+        timeStamp = max(timeStamp, getMaxTimeStamp(levelSSTs) + 1);
+        for (const auto& sst : levelSSTs) {
+            lastSequence = max(lastSequence, sst->getMaxSequence());
+            nextFileNumber = max<uint64_t>(nextFileNumber, sst->getFileNumber() + 1);
         }
 
         if (level == 0) {
-            if (levelSSTs.empty())
-                emptyL0 = true;
-            else if (levelSSTs.size() == 1)
-                timeStamp = levelSSTs.front()->getTimeStamp() + 1;
-            else {
-                SSTTimeStampPriorComparator timeStampLessThan;
-                SSTPtr firstSST = levelSSTs[0];
-                SSTPtr secondSST = levelSSTs[1];
-                timeStamp = timeStampLessThan(firstSST, secondSST) ?
-                            secondSST->getTimeStamp() + 1 : firstSST->getTimeStamp() + 1;
-            }
+            SSTTimeStampPriorComparator sstComparator;
+            sort(levelSSTs.begin(), levelSSTs.end(), sstComparator);
         } else {
-            if (level == 1 && emptyL0)
-                timeStamp = getMaxTimeStamp(levelSSTs) + 1;
             SSTKeyPriorComparator sstComparator;
             sort(levelSSTs.begin(), levelSSTs.end(), sstComparator);
         }
         ssTables[level] = make_shared<vector<SSTPtr>>(levelSSTs);
-
-        ++level;
-        levelDir = "./data/level-" + to_string(level) + "/";
-        filenames.clear();
+        rebuildFences(level);
     }
+
+    // Later writes must not be covered by the range tombstones.
+    rangeTombstones.readFromFile(getRangeTombstoneFilename());
+    lastSequence = max(lastSequence, rangeTombstones.getMaxSequence());
+}
+
+/**
+ * @return The codec of the SSTs written into the level. Levels past the end
+ * of `compressionPerLevel` take its last codec.
+ */
+CompressionType KVStore::getCompression(size_t level) const {
+    if (compressionPerLevel.empty())
+        return NO_COMPRESSION;
+    return compressionPerLevel[min(level, compressionPerLevel.size() - 1)];
 }
 
-SSTPtr KVStore::readSSTFromDisk(const string& filename, size_t level) {
+SSTPtr KVStore::readSSTFromDisk(const string& filename, size_t level) const {
     SSTHeader sstHeader;
-    bool* byteArray = new bool[BLOOM_FILTER_SIZE];
-    vector<DataIndex> dataIndexes;
 
     ifstream sstFile(filename, ios::binary | ios::in);
     if (!sstFile) {
@@ -137,18 +506,26 @@ SSTPtr KVStore::readSSTFromDisk(const string& filename, size_t level) {
         exit(-1);
     }
 
-    sstFile.read((char*)&sstHeader, HEADER_SIZE);
-    sstFile.read((char*)byteArray, BLOOM_FILTER_SIZE);
+    sstFile.seekg(0, ios::end);
+    uint32_t fileSize = sstFile.tellg();
+    sstFile.seekg(0, ios::beg);
 
-    uint64_t keyNumber = sstHeader.keyNumber;
-    for (uint32_t i = 0; i < keyNumber; ++i) {
-        DataIndex dataIndex;
-        sstFile.read((char*)&dataIndex, DATA_INDEX_SIZE);
-        dataIndexes.push_back(dataIndex);
+    // A file cut short must not be read past its end.
+    sstFile.read((char*)&sstHeader, HEADER_SIZE);
+    if (!sstFile || sstHeader.keyNumber > fileSize / DATA_INDEX_SIZE || HEADER_SIZE + BLOOM_FILTER_SIZE
+                    + DATA_INDEX_SIZE * sstHeader.keyNumber
+                    + BLOCK_HANDLE_SIZE * (uint64_t)sstHeader.blockNumber + SST_FOOTER_SIZE > fileSize) {
+        cerr << "Corrupted file `" << filename << "`." << endl;
+        exit(-1);
     }
 
-    BloomFilter bloomFilter(byteArray);
-    SSTPtr sst = make_shared<SSTable>(level, sstHeader, bloomFilter, dataIndexes);
+    SSTPtr sst = make_shared<SSTable>(dataDir, level, sstHeader, fileSize, verifyChecksumsOnOpen);
+    if (metadataLoading == LOAD_ON_OPEN)
+        sst->loadMetadata();
+    if (verifyChecksumsOnOpen == VERIFY_ALL && !sst->verifyChecksums()) {
+        cerr << "Corrupted block in file `" << filename << "`." << endl;
+        exit(-1);
+    }
     return sst;
 }
 
@@ -161,111 +538,710 @@ void KVStore::clearDisk() {
         vector<SSTPtr> levelSSTs = *ssTables[level];
         for (const auto& sst : levelSSTs)
             utils::rmfile(sst->getFilename().c_str());
-        string dir = "./data/level-" + to_string(level);
-        utils::rmdir(dir.c_str());
+        utils::rmdir(getLevelDir(level).c_str());
+    }
+    utils::rmfile(getRangeTombstoneFilename().c_str());
+    blobStore.clear();
+}
+
+/**
+ * Refresh the fence pointers of a level from its SSTs. Must be called
+ * whenever the SSTs of the level change.
+ */
+void KVStore::rebuildFences(size_t level) {
+    fences[level].rebuild(*ssTables[level]);
+    if (level == 0)
+        rebuildL0SubLevels();
+}
+
+/**
+ * Organize L0 into sub-levels of non-overlapping SSTs. Each SST is placed
+ * one sub-level above the highest sub-level holding an older SST that
+ * overlaps it, so for any key, a newer SST always lies in a higher
+ * sub-level than an older one. L0 must be sorted by time stamp.
+ */
+void KVStore::rebuildL0SubLevels() {
+
+    const vector<SSTPtr>& L0SSTs = *ssTables[0];
+    size_t SSTNumber = L0SSTs.size();
+    vector<size_t> subLevelOf(SSTNumber, 0);
+    size_t subLevelNumber = 0;
+
+    for (size_t i = 0; i < SSTNumber; ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (L0SSTs[j]->getMaxKey() >= L0SSTs[i]->getMinKey()
+                && L0SSTs[j]->getMinKey() <= L0SSTs[i]->getMaxKey())
+                subLevelOf[i] = max(subLevelOf[i], subLevelOf[j] + 1);
+        }
+        subLevelNumber = max(subLevelNumber, subLevelOf[i] + 1);
+    }
+
+    L0SubLevels.assign(subLevelNumber, SubLevel());
+    for (size_t i = 0; i < SSTNumber; ++i)
+        L0SubLevels[subLevelOf[i]].SSTs.push_back(L0SSTs[i]);
+
+    SSTKeyPriorComparator sstComparator;
+    for (auto& subLevel : L0SubLevels) {
+        sort(subLevel.SSTs.begin(), subLevel.SSTs.end(), sstComparator);
+        subLevel.fences.rebuild(subLevel.SSTs);
     }
 }
 
-bool KVStore::memTableOverflow(const LsmValue& v) const {
-    return memTableSize + DATA_INDEX_SIZE + v.size() > MAX_SSTABLE_SIZE;
+string KVStore::getLevelDir(size_t level) const {
+    return dataDir + "level-" + to_string(level) + "/";
 }
 
-void KVStore::detectAndHandleOverflow() {
-    if (levelOverflow(0))
-        compact0();
+string KVStore::getRangeTombstoneFilename() const {
+    return dataDir + "range-tombstones";
+}
 
+/**
+ * Remove the SSTs whose whole key range is deleted by a single range
+ * tombstone newer than all their entries, unless a snapshot older than the
+ * tombstone sees some of the entries.
+ */
+void KVStore::dropCoveredSSTs() {
+    const vector<RangeTombstone>& tombstones = rangeTombstones.getTombstones();
     size_t levelNumber = ssTables.size();
-    for (size_t level = 1; level < levelNumber; ++level) {
-        uint32_t overflowNumber = levelOverflow(level);
-        if (!overflowNumber)
-            break;
-        compact(level, overflowNumber);
+    for (size_t level = 0; level < levelNumber; ++level) {
+        vector<SSTPtr>& levelSSTs = *ssTables[level];
+        auto covered = [&](const SSTPtr& sst) {
+            for (const auto& tombstone : tombstones) {
+                if (tombstone.start > sst->getMinKey())
+                    return false;
+                if (sst->getMaxKey() <= tombstone.end && sst->getMaxSequence() < tombstone.sequence
+                    && !snapshotBetween(sst->getMinSequence(), tombstone.sequence)) {
+                    releaseBlobs(sst);
+                    removeSSTFromDisk(sst);
+                    statistics.coveredSSTNumber++;
+                    return true;
+                }
+            }
+            return false;
+        };
+        size_t SSTNumber = levelSSTs.size();
+        levelSSTs.erase(remove_if(levelSSTs.begin(), levelSSTs.end(), covered), levelSSTs.end());
+        if (levelSSTs.size() != SSTNumber)
+            rebuildFences(level);
+    }
+}
+
+/**
+ * Remove the range tombstones that no longer delete anything: neither
+ * memTable nor any SST holds an entry in the range older than the tombstone,
+ * since compactions have discarded the entries it covered.
+ * @return The number of tombstones removed.
+ */
+size_t KVStore::removeObsoleteRangeTombstones() {
+    size_t levelNumber = ssTables.size();
+    return rangeTombstones.removeIf([&](const RangeTombstone& tombstone) {
+        if (memTable->hasEntryBefore(tombstone.start, tombstone.end, tombstone.sequence))
+            return false;
+        for (const auto& sst : *ssTables[0])
+            if (sst->getMaxKey() >= tombstone.start && sst->getMinKey() <= tombstone.end
+                && sst->getMinSequence() < tombstone.sequence)
+                return false;
+        for (size_t n = 1; n < levelNumber; ++n) {
+            size_t first, last;
+            if (!fences[n].overlap(tombstone.start, tombstone.end, first, last))
+                continue;
+            const vector<SSTPtr>& levelSSTs = *ssTables[n];
+            for (size_t i = first; i < last; ++i)
+                if (levelSSTs[i]->getMinSequence() < tombstone.sequence)
+                    return false;
+        }
+        return true;
+    });
+}
+
+/**
+ * Find the blob files and count the bytes of each that the SSTs point at.
+ * Remove the files no SST points at, which an interrupted flush or garbage
+ * collection may leave behind.
+ */
+void KVStore::readBlobFilesFromDisk() {
+    blobStore.readFilesFromDisk();
+    if (blobStore.empty())
+        return;
+
+    for (const auto& level : ssTables) {
+        for (const auto& sst : *level.second) {
+            vector<BlobIndex> indexes;
+            sst->getBlobIndexes(indexes);
+            for (const auto& index : indexes)
+                blobStore.retain(index);
+        }
+    }
+    blobStore.removeUnreferencedFiles();
+}
+
+/**
+ * Move the large values of memTable into a new blob file before it is flushed.
+ */
+void KVStore::separateValues() {
+    BlobFileBuilder blobFile = blobStore.newFile(flushWriteOptions);
+    memTable->separateValues(minBlobSize, blobFile);
+    statistics.blobBytesWritten += blobFile.finish();
+    blobStore.addFile(blobFile);
+}
+
+/**
+ * Replace a blob index with the value it points at. Other entries are left as they are.
+ */
+void KVStore::readBlobValue(LsmEntry& entry) const {
+    if (entry.type != TYPE_BLOB_INDEX)
+        return;
+    blobStore.get(BlobIndex::decode(entry.value), entry.value);
+    entry.type = TYPE_VALUE;
+}
+
+/**
+ * Count the values the SST points at as garbage, before the SST is removed
+ * without being merged.
+ */
+void KVStore::releaseBlobs(const SSTPtr& sst) {
+    vector<BlobIndex> indexes;
+    sst->getBlobIndexes(indexes);
+    for (const auto& index : indexes)
+        blobStore.release(index);
+}
+
+/**
+ * Rewrite the blob files whose live bytes fall below
+ * `blobGarbageCollectionRatio` of their size. Their live values are copied
+ * into new blob files, and the SSTs pointing at them are rewritten under the
+ * same names with the new locations. Sequence numbers are kept, so every
+ * snapshot reads the same versions as before. Blob files no SST points at
+ * any more are removed.
+ */
+void KVStore::collectBlobGarbage() {
+
+    vector<uint64_t> fileNumbers;
+    if (blobGarbageCollectionRatio > 0)
+        fileNumbers = blobStore.getFilesToCollect(blobGarbageCollectionRatio);
+
+    if (!fileNumbers.empty()) {
+        auto isCollected = [&](const BlobIndex& index) {
+            return binary_search(fileNumbers.begin(), fileNumbers.end(), index.fileNumber);
+        };
+
+        // Copy the live values into new blob files, and the entries of the
+        // SSTs pointing at them, with the new locations, into memory.
+        BlobFileBuilder blobFile = blobStore.newFile(fileWriteOptions);
+        vector<SSTPtr> oldSSTs;
+        vector<pair<vector<LsmKey>, KVPair>> newData;
+        size_t levelNumber = ssTables.size();
+        for (size_t level = 0; level < levelNumber; ++level) {
+            for (const auto& sst : *ssTables[level]) {
+                vector<BlobIndex> indexes;
+                sst->getBlobIndexes(indexes);
+                if (none_of(indexes.begin(), indexes.end(), isCollected))
+                    continue;
+
+                vector<pair<LsmKey, LsmEntry>> entries;
+                sst->getValuesFromDisk(entries, useDirectIO);
+                vector<LsmKey> keys;
+                KVPair data;
+                for (auto& entry : entries) {
+                    if (entry.second.type == TYPE_BLOB_INDEX) {
+                        BlobIndex index = BlobIndex::decode(entry.second.value);
+                        if (isCollected(index)) {
+                            if (blobFile.getFileSize() >= MAX_BLOB_FILE_SIZE) {
+                                uint64_t bytes = blobFile.finish();
+                                statistics.garbageCollectionBytesWritten += bytes;
+                                blobStore.addFile(blobFile);
+                                blobFile = blobStore.newFile(fileWriteOptions);
+                            }
+                            entry.second.value = blobFile.add(entry.first, blobStore.getValueView(index)).encode();
+                            blobStore.release(index);
+                        }
+                    }
+                    if (keys.empty() || keys.back() != entry.first)
+                        keys.push_back(entry.first);
+                    data[entry.first].push_back(std::move(entry.second));
+                }
+                oldSSTs.push_back(sst);
+                newData.emplace_back(std::move(keys), std::move(data));
+            }
+        }
+        uint64_t bytes = blobFile.finish();
+        statistics.garbageCollectionBytesWritten += bytes;
+        blobStore.addFile(blobFile);
+
+        // Replace the SSTs once the values they point at are written. A new
+        // SST holds the same keys under the same file name and number, and is
+        // renamed over the old file once complete, so either is always on the disk.
+        BackgroundFileWriter writer(fileWriteOptions, COMPACTION_PENDING_OUTPUTS);
+        vector<bool> changedLevels(levelNumber, false);
+        for (size_t i = 0; i < oldSSTs.size(); ++i) {
+            const SSTPtr& sst = oldSSTs[i];
+            size_t level = sst->getLevel();
+            sst->loadMetadata();    // Or the metadata warm-up may read the new file.
+            SSTPtr newSST = generateNewSST(newData[i].first, newData[i].second, level, sst->getTimeStamp(),
+                                           getCompression(level), writer, sst->getFileNumber());
+            statistics.garbageCollectionBytesWritten += newSST->getFileSize();
+            vector<SSTPtr>& levelSSTs = *ssTables[level];
+            *find(levelSSTs.begin(), levelSSTs.end(), sst) = newSST;
+            changedLevels[level] = true;
+        }
+        writer.finish();
+        for (size_t level = 0; level < levelNumber; ++level)
+            if (changedLevels[level])
+                rebuildFences(level);
+        statistics.blobFilesCollected += fileNumbers.size();
+    }
+
+    blobStore.removeUnreferencedFiles();
+}
+
+/**
+ * @param writeBytes: Bytes that the entries to write take in an SST.
+ */
+bool KVStore::memTableOverflow(uint64_t writeBytes) const {
+    return memTableSize + writeBytes > writeBufferSize;
+}
+
+/**
+ * Flush memTable into L0 and run the compactions needed if writing the
+ * entries would make it overflow.
+ */
+void KVStore::flushOnOverflow(uint64_t writeBytes) {
+    if (memTableOverflow(writeBytes))
+        flush();
+}
+
+/**
+ * @param writeBytes: Bytes that the entries to write take in an SST, which
+ * is DATA_INDEX_SIZE more than its value for each entry.
+ * @return true if a write of the entries would flush memTable first.
+ */
+bool KVStore::needsFlush(uint64_t writeBytes) const {
+    return memTableOverflow(writeBytes) && !memTable->empty();
+}
+
+/**
+ * Flush memTable into L0 now, whatever its size, and run the compactions needed.
+ */
+void KVStore::flush() {
+    // A range deletion may have emptied memTable.
+    if (memTable->empty()) {
+        memTableSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+        return;
+    }
+
+    memToDisk();
+
+    // Update states
+    memTable->reset();
+    memTableSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+
+    detectAndHandleOverflow(writeController.isEnabled() ? WRITE_STALL_COMPACTIONS_PER_FLUSH : SIZE_MAX);
+}
+
+/**
+ * Delay or stop the write if compactions are too far behind, then flush
+ * memTable if the write would make it overflow.
+ */
+void KVStore::makeRoomForWrite(uint64_t writeBytes) {
+    if (writeController.isEnabled())
+        stallWrite(writeBytes);
+    flushOnOverflow(writeBytes);
+}
+
+/**
+ * Stop the write until compactions bring the store below the hard limits,
+ * or delay it at the write rate past the soft limits. Compactions run
+ * inside the writes, so a delay is spent running the next compaction, and
+ * only slept through if none is pending.
+ */
+void KVStore::stallWrite(uint64_t writeBytes) {
+
+    auto start = chrono::steady_clock::now();
+    auto countCause = [&](WriteStallCause cause) {
+        if (cause == L0_FILES_STALL)
+            statistics.L0FilesStallNumber++;
+        else
+            statistics.pendingBytesStallNumber++;
+    };
+
+    // Limits the compaction strategy never compacts below cannot stop writes.
+    if (writeController.getCondition() == WRITE_STOPPED) {
+        WriteStallCause cause = writeController.getCause();
+        size_t compactionNumber = 0;
+        while (writeController.getCondition() == WRITE_STOPPED && detectAndHandleOverflow(1) > 0)
+            compactionNumber++;
+        if (compactionNumber > 0) {
+            statistics.stoppedWriteNumber++;
+            statistics.writeStopMicros += microsSince(start);
+            countCause(cause);
+        }
+        start = chrono::steady_clock::now();
+    }
+
+    writeController.charge(writeBytes);
+    uint64_t delayMicros = writeController.getDelayMicros();
+    if (delayMicros < WRITE_DELAY_MIN_US)
+        return;
+    statistics.delayedWriteNumber++;
+    countCause(writeController.getCause());
+    if (detectAndHandleOverflow(1) == 0)
+        this_thread::sleep_for(chrono::microseconds(delayMicros));
+    statistics.writeDelayMicros += microsSince(start);
+}
+
+/**
+ * Run the compactions picked by the compaction strategy until no level
+ * overflows, or until `maxCompactionNumber` compactions have run.
+ * @return The number of compactions run.
+ */
+size_t KVStore::detectAndHandleOverflow(size_t maxCompactionNumber) {
+    CompactionTask task;
+    size_t compactionNumber = 0;
+    while (compactionNumber < maxCompactionNumber
+           && compactionStrategy->pickCompaction(ssTables, L0SubLevels, task)) {
+        if (rateLimiter)
+            rateLimiter->setCompactionDebt(compactionStrategy->estimatePendingBytes(ssTables, L0SubLevels), this);
+        auto start = chrono::steady_clock::now();
+        switch (task.kind) {
+            case COMPACT_L0:
+                compact0();
+                break;
+            case PUSH_DOWN:
+                compact(task.level, task.SSTs);
+                break;
+            case MERGE_RUNS:
+                compactRuns(task.SSTs, task.level);
+                break;
+        }
+        statistics.compactionMicros += microsSince(start);
+        compactionNumber++;
+    }
+
+    bool compacted = compactionNumber > 0;
+    if (compacted && !rangeTombstones.empty() && removeObsoleteRangeTombstones() > 0)
+        rangeTombstones.writeToFile(getRangeTombstoneFilename(), fileWriteOptions);
+    if (compacted && !blobStore.empty())
+        collectBlobGarbage();
+
+    // Report the debt left, if any, once the shape of the store settles.
+    if (rateLimiter || writeController.isEnabled()) {
+        uint64_t pendingBytes = compactionStrategy->estimatePendingBytes(ssTables, L0SubLevels);
+        if (rateLimiter && compacted)
+            rateLimiter->setCompactionDebt(pendingBytes, this);
+        writeController.update(ssTables[0]->size(), pendingBytes);
+    }
+    return compactionNumber;
+}
+
+/**
+ * Create the level and all the levels above it if they do not exist, so
+ * that levels are always numbered without gaps both in memory and on disk.
+ */
+void KVStore::ensureLevel(size_t level) {
+    for (size_t n = 0; n <= level; ++n) {
+        if (ssTables.count(n))
+            continue;
+        ssTables[n] = make_shared<vector<SSTPtr>>();
+        rebuildFences(n);
+        utils::mkdir(getLevelDir(n).c_str());
     }
 }
 
+/**
+ * @return true if no level below holds any SST, so that deleted keys
+ * written into this level can be discarded.
+ */
+bool KVStore::isLastLevel(size_t level) const {
+    size_t levelNumber = ssTables.size();
+    for (size_t n = level + 1; n < levelNumber; ++n)
+        if (!ssTables.at(n)->empty())
+            return false;
+    return true;
+}
+
+/**
+ * @return The sequence number reads with the snapshot see up to.
+ */
+SequenceNumber KVStore::getSnapshotSequence(const Snapshot* snapshot) {
+    return snapshot ? snapshot->getSequence() : MAX_SEQUENCE_NUMBER;
+}
+
+/**
+ * @return The sequence number of the newest live snapshot, or 0 if there is none.
+ */
+SequenceNumber KVStore::getNewestSnapshot() const {
+    return snapshots.empty() ? 0 : *snapshots.rbegin();
+}
+
+/**
+ * @return The sequence number of the oldest live snapshot that sees the
+ * version, or MAX_SEQUENCE_NUMBER if only reads without a snapshot see it.
+ * Versions of a key in the same stripe are seen by the same snapshots.
+ */
+SequenceNumber KVStore::getStripe(SequenceNumber sequence) const {
+    auto it = snapshots.lower_bound(sequence);
+    return it == snapshots.end() ? MAX_SEQUENCE_NUMBER : *it;
+}
+
+/**
+ * @return true if a live snapshot sees the versions written at `lower` but
+ * not the ones written at `upper`.
+ */
+bool KVStore::snapshotBetween(SequenceNumber lower, SequenceNumber upper) const {
+    auto it = snapshots.lower_bound(lower);
+    return it != snapshots.end() && *it < upper;
+}
+
 /**
  * Write the data in memTable to the disk on overflowing.
  * Truncate memTable.
  */
 void KVStore::memToDisk() {
-    SSTPtr sst = memTable->writeToDisk(timeStamp);   // Write the data into disk (level 0)
+    if (enableBlobFiles)
+        separateValues();
+    SSTPtr sst = memTable->writeToDisk(dataDir, timeStamp, nextFileNumber++, getCompression(0),
+                                       flushWriteOptions);   // Write the data into disk (level 0)
     ssTables[0]->push_back(sst);    // Append to level 0 cache
+    rebuildFences(0);
+    statistics.flushBytesWritten += sst->getFileSize();
     timeStamp++;
 }
 
 /**
- * @return The value corresponding with the key in the SST files in the disk
- * Retain "~DELETED~".
+ * Find the newest entry of the key the snapshot sees, in memTable or in the
+ * SST files, which may be a deletion. Merge operands are applied to the older
+ * entries they are found above, so the entry is never a merge.
+ * @param pinned: If given, the value is put here instead of into `entry`,
+ * pinned in the mapping of its SST if it was read from one and no merge
+ * operands were applied.
+ * @return false if the key has no entry the snapshot sees.
  */
-LsmValue KVStore::getValueFromDisk(LsmKey key) {
-
-    size_t levelNumber = ssTables.size();
-    if (levelNumber == 0)   // All data are stored in memTable.
-        return "";
+bool KVStore::getEntry(LsmKey key, SequenceNumber snapshot, LsmEntry& entry, PinnableValue* pinned) {
+
+    bool found = false;
+    bool valuePinned = false;
+    LsmVersions mergeEntries;           // From the newest to the oldest.
+    SequenceNumber bound = snapshot;    // Versions above an operand were all seen.
+
+    // Take `entry` as the next older version of the key.
+    // @return true if the search ends.
+    auto applyEntry = [&]() {
+        if (!rangeTombstones.empty() && rangeTombstones.covers(key, entry.sequence, snapshot))
+            entry.type = TYPE_DELETION;
+        if (entry.type == TYPE_MERGE) {
+            bound = entry.sequence - 1;
+            mergeEntries.push_back(std::move(entry));
+            return false;
+        }
+        found = true;
+        return true;
+    };
 
-    TimeStamp maxTimeStamp = 0;
-    LsmValue newestValue;
-
-    auto getNewestValue = [&](const SSTPtr& sst, LsmKey key) {
-        LsmValue newValue = sst->get(key);
-        TimeStamp newTimeStamp = sst->getTimeStamp();
-        if (newValue.length() != 0 && newTimeStamp > maxTimeStamp) {
-            newestValue = newValue;
-            maxTimeStamp = newTimeStamp;
+    // @return true if the search ends.
+    auto getEntryFromSST = [&](const SSTPtr& sst) {
+        statistics.sstProbeNumber++;
+        while (true) {
+            if (pinned && mergeEntries.empty()) {
+                if (!sst->get(key, bound, entry, *pinned))
+                    return false;
+                valuePinned = entry.type != TYPE_MERGE;
+                if (!valuePinned)
+                    entry.value.assign(pinned->value());
+            } else if (!sst->get(key, bound, entry))
+                return false;
+            if (applyEntry())
+                return true;
         }
     };
 
-    // Read from L0.
-    vector<SSTPtr> L0SSTs = *ssTables[0];
-    uint32_t L0SSTNumber = L0SSTs.size();
-    for (int i = L0SSTNumber - 1; i >= 0; --i) {
-        SSTPtr sst = L0SSTs[i];
-        getNewestValue(sst, key);
+    // Read from memTable, which may hold older versions kept for snapshots.
+    bool end = false;
+    while (!end && memTable->get(key, entry, bound))
+        end = applyEntry();
 
-        if (newestValue.length() != 0)
-            return newestValue;
+    // Read from L0, one binary search per sub-level from the newest to the oldest.
+    for (auto it = L0SubLevels.crbegin(); it != L0SubLevels.crend() && !end; ++it) {
+        int64_t sstIndex = it->fences.find(key);
+        if (sstIndex >= 0)
+            end = getEntryFromSST(it->SSTs[sstIndex]);
     }
 
     // Read from the rest levels.
-    for (size_t n = 1; n < levelNumber; n++) {
-        vector<SSTPtr> levelSSTs = *ssTables[n];
-        if (key < levelSSTs.front()->getMinKey() || key > levelSSTs.back()->getMaxKey())
+    size_t levelNumber = ssTables.size();
+    for (size_t n = 1; n < levelNumber && !end; n++) {
+        int64_t sstIndex = fences[n].find(key);
+        if (sstIndex >= 0)
+            end = getEntryFromSST((*ssTables[n])[sstIndex]);
+    }
+
+    if (!mergeEntries.empty()) {
+        foldMerges(key, mergeEntries, found ? &entry : nullptr);
+        entry = std::move(mergeEntries.front());
+        found = true;
+        valuePinned = false;
+    } else if (found && entry.type == TYPE_BLOB_INDEX) {
+        // Read the value from its blob file, pinned there if the index was.
+        BlobIndex index = BlobIndex::decode(valuePinned ? pinned->value() : string_view(entry.value));
+        entry.type = TYPE_VALUE;
+        if (valuePinned)
+            blobStore.get(index, *pinned);
+        else
+            blobStore.get(index, entry.value);
+    }
+    if (found && pinned && !valuePinned)
+        pinned->assign(std::move(entry.value));
+    return found;
+
+}
+
+/**
+ * Find the newest entry the snapshot sees among the versions of a key, like
+ * `getEntry` does.
+ * @param versions: Every version of the key, in any order. They are sorted
+ * from the newest to the oldest and may be moved from.
+ * @return false if the key has no entry the snapshot sees.
+ */
+bool KVStore::resolveVersions(LsmKey key, LsmVersions& versions, SequenceNumber snapshot,
+                              LsmEntry& entry) const {
+
+    if (versions.size() > 1)
+        sort(versions.begin(), versions.end(), [](const LsmEntry& e1, const LsmEntry& e2) {
+            return e1.sequence > e2.sequence;
+        });
+
+    LsmVersions mergeEntries;
+    const LsmEntry* olderEntry = nullptr;
+    for (auto& version : versions) {
+        if (version.sequence > snapshot)
             continue;
-        uint32_t sstIndex = sstBinarySearch(levelSSTs, key, 0, levelSSTs.size() - 1);
-        SSTPtr targetSST = levelSSTs[sstIndex];
-        getNewestValue(targetSST, key);
+        if (!rangeTombstones.empty() && rangeTombstones.covers(key, version.sequence, snapshot))
+            version.type = TYPE_DELETION;
+        if (version.type != TYPE_MERGE) {
+            olderEntry = &version;
+            break;
+        }
+        mergeEntries.push_back(std::move(version));
+    }
+
+    if (mergeEntries.empty()) {
+        if (!olderEntry)
+            return false;
+        entry = std::move(*olderEntry);
+        return true;
+    }
+    foldMerges(key, mergeEntries, olderEntry);
+    entry = std::move(mergeEntries.front());
+    return true;
+
+}
+
+/**
+ * Apply a merge entry to the entry of the same key written before it. The
+ * result is a value, or a combined operand if the older entry is an operand
+ * too. Does nothing if the entry is not a merge.
+ * @param olderEntry: nullptr if the key has no older entry.
+ */
+void KVStore::foldMerge(LsmKey key, LsmEntry& entry, const LsmEntry* olderEntry) const {
+    if (entry.type != TYPE_MERGE)
+        return;
+    if (!mergeOperator) {
+        cerr << "No merge operator is set." << endl;
+        exit(-1);
+    }
+    LsmEntry olderValue;
+    if (olderEntry && olderEntry->type == TYPE_BLOB_INDEX) {
+        olderValue = *olderEntry;
+        readBlobValue(olderValue);
+        olderEntry = &olderValue;
+    }
+    LsmValue newValue;
+    if (!olderEntry || olderEntry->type == TYPE_DELETION) {
+        mergeOperator->merge(key, nullptr, entry.value, newValue);
+        entry.type = TYPE_VALUE;
+    } else {
+        mergeOperator->merge(key, &olderEntry->value, entry.value, newValue);
+        entry.type = olderEntry->type;
+    }
+    entry.value = std::move(newValue);
+}
+
+/**
+ * Apply merge entries of one key to each other and to the entry written
+ * before them, from the oldest to the newest. The result is left in the
+ * newest entry.
+ * @param mergeEntries: From the newest to the oldest.
+ * @param olderEntry: nullptr if the key has no older entry.
+ */
+void KVStore::foldMerges(LsmKey key, LsmVersions& mergeEntries, const LsmEntry* olderEntry) const {
+    for (auto it = mergeEntries.rbegin(); it != mergeEntries.rend(); ++it) {
+        foldMerge(key, *it, olderEntry);
+        olderEntry = &*it;
+    }
+}
+
+/**
+ * Look up the key in memTable, then take the newest SST whose fence pointers
+ * and bloom filter accept the key, without reading the disk.
+ * @return false if the key surely does not exist. true if memTable holds
+ * the key, or an SST may hold it and no range tombstone deletes it.
+ */
+bool KVStore::keyProbablyExists(LsmKey key) {
+
+    LsmEntry entry;
+    if (memTable->get(key, entry))
+        return entry.type != TYPE_DELETION && !rangeTombstones.covers(key, entry.sequence);
+
+    for (auto it = L0SubLevels.crbegin(); it != L0SubLevels.crend(); ++it) {
+        int64_t sstIndex = it->fences.find(key);
+        if (sstIndex >= 0 && it->SSTs[sstIndex]->mayContain(key))
+            return !rangeTombstones.covers(key, it->SSTs[sstIndex]->getMaxSequence());
+    }
 
-        if (newestValue.length() != 0)
-            return newestValue;
+    size_t levelNumber = ssTables.size();
+    for (size_t n = 1; n < levelNumber; n++) {
+        int64_t sstIndex = fences[n].find(key);
+        if (sstIndex < 0)
+            continue;
+        const SSTPtr& sst = (*ssTables[n])[sstIndex];
+        if (sst->mayContain(key))
+            return !rangeTombstones.covers(key, sst->getMaxSequence());
     }
 
-    return newestValue;
+    return false;
 
 }
 
 /**
- * @return Number of overflowing SSTs in the level.
+ * Check the fence pointers and the bloom filters of the levels below
+ * without reading the disk. Only reads shared state, so that it can be
+ * called by concurrent subcompactions.
+ * @return false if no level below `level` can hold the key, so that a
+ * deletion of the key written into `level` can be discarded.
  */
-uint32_t KVStore::levelOverflow(size_t level) {
-    int currentNumber = ssTables[level]->size();
-    int maxNumber = (uint32_t)pow(2, level + 1);
-    int overflowNumber = currentNumber - maxNumber;
-    return overflowNumber > 0 ? overflowNumber : 0;
+bool KVStore::keyMayExistBelow(LsmKey key, size_t level) const {
+    size_t levelNumber = ssTables.size();
+    for (size_t n = level + 1; n < levelNumber; ++n) {
+        int64_t sstIndex = fences.at(n).find(key);
+        if (sstIndex >= 0 && (*ssTables.at(n))[sstIndex]->mayContain(key))
+            return true;
+    }
+    return false;
 }
 
 /**
  * Compact all SSTs in L0 into L1. Clear L0.
+ * SSTs that overlap neither the rest of L0 nor L1 are moved into L1 as they are.
  */
 void KVStore::compact0() {
 
-    vector<SSTPtr> SSTs = *ssTables[0];
-    if (SSTs.size() != 3) {
-        cerr << "Number of SSTs in L0 is not 3. L0-compaction error." << endl;
-        exit(-1);
-    }
+    ensureLevel(1);
 
-    if (!ssTables.count(1))
-        ssTables[1] = make_shared<vector<SSTPtr>>();
+    for (const auto& sst : getTrivialMoveL0SSTs())
+        moveSST(sst, 1);
+    if (ssTables[0]->empty())
+        return;
+
+    vector<SSTPtr> SSTs = *ssTables[0];
 
     // Get the overall interval of SSTs in L0.
     LsmKey minKey, maxKey;
@@ -279,14 +1255,15 @@ void KVStore::compact0() {
 
     // Get all k-v pairs from the disk.
     SSTs.insert(SSTs.end(), overlapSSTs.begin(), overlapSSTs.end());
-    KVPair data = getCompactionData(SSTs);
-
-    // Remove the overlapping SST files in the disk.
-    reconstructLowerLevelDisk( minOverlapIndex, maxOverlapIndex, 1);
+    KVPair data = getCompactionData(SSTs, 1);
 
     // Sort the keys and write the data into the disk.
     TimeStamp maxTimeStamp = getMaxTimeStamp(SSTs);
     vector<SSTPtr> mergedSSTs = merge0AndWriteToDisk(SSTs, maxTimeStamp, data);
+    recordCompaction(SSTs, mergedSSTs);
+
+    // Remove the overlapping SST files in the disk, now that the new ones are written.
+    reconstructLowerLevelDisk( minOverlapIndex, maxOverlapIndex, 1);
 
     // Reconstruct L1 in memory.
     reconstructLowerLevelMemory(minOverlapIndex, maxOverlapIndex, mergedSSTs, 1);
@@ -300,18 +1277,13 @@ void KVStore::compact0() {
 /**
  * Compact SSTs from an upper level to a lower level one by one.
  * @param level: The upper level that overflows.
- * @param compactNumber: Number of SSTs in the upper level to be compacted.
+ * @param compactSSTs: SSTs in the upper level to be compacted.
  */
-void KVStore::compact(size_t upperLevel, uint32_t overflowNumber) {
+void KVStore::compact(size_t upperLevel, const vector<SSTPtr>& compactSSTs) {
 
     // New the lower level if it does not exist.
     size_t lowerLevel = upperLevel + 1;
-    if (!ssTables.count(lowerLevel)) {
-        ssTables[lowerLevel] = make_shared<vector<SSTPtr>>();
-    }
-
-    // Find the SSTs possessing the smallest time stamps or minimum keys.
-    vector<SSTPtr> compactSSTs = getCompactSSTs(upperLevel, overflowNumber);
+    ensureLevel(lowerLevel);
 
     // Compact the SSTs one by one.
     for (const auto& compactSST : compactSSTs)
@@ -335,51 +1307,162 @@ void KVStore::compactOneSST(const SSTPtr& sst, size_t lowerLevel) {
     vector<SSTPtr> overlapSSTs = getOverlapSSTs(sst->getMinKey(), sst->getMaxKey(), lowerLevel,
                                                 minOverlapIndex, maxOverlapIndex);
 
-    KVPair data = getCompactionData(sst, overlapSSTs);
+    // No overlapping: relink the file into the lower level without rewriting it,
+    // unless its deletions can be discarded by rewriting it into the last level.
+    if (overlapSSTs.empty() && !(sst->getTombstoneNumber() > 0 && isLastLevel(lowerLevel))) {
+        moveSST(sst, lowerLevel);
+        return;
+    }
 
-    reconstructLowerLevelDisk(minOverlapIndex, maxOverlapIndex, lowerLevel);
+    KVPair data = getCompactionData(sst, overlapSSTs, lowerLevel);
 
     TimeStamp maxTimeStamp = getMaxTimeStamp(sst, overlapSSTs);
-    vector<SSTPtr> mergedSSTs;
+    vector<SSTPtr> mergedSSTs = mergeAndWriteToDisk(sst, overlapSSTs, maxTimeStamp, data);
 
-    if (overlapSSTs.empty())                 // no overlapping
-        mergedSSTs.push_back(generateNewSST(sst->getKeys(), data, lowerLevel, maxTimeStamp));
-    else                                     // does overlap
-        mergedSSTs = mergeAndWriteToDisk(sst, overlapSSTs, maxTimeStamp, data);
+    reconstructLowerLevelDisk(minOverlapIndex, maxOverlapIndex, lowerLevel);
+
+    overlapSSTs.push_back(sst);
+    recordCompaction(overlapSSTs, mergedSSTs);
 
     reconstructLowerLevelMemory(minOverlapIndex, maxOverlapIndex, mergedSSTs, lowerLevel);
 
 }
 
-void KVStore::getCompact0Range(LsmKey& minKey, LsmKey& maxKey) {
-    vector<SSTPtr> L0SSTs = *ssTables[0];
-    minKey = min(min(L0SSTs[0]->getMinKey(), L0SSTs[1]->getMinKey()),
-                 L0SSTs[2]->getMinKey());
-    maxKey = max(max(L0SSTs[0]->getMaxKey(), L0SSTs[1]->getMaxKey()),
-                 L0SSTs[2]->getMaxKey());
+/**
+ * Trivial move: rename the file of an SST into the lower level and update
+ * both levels in memory. No data is read or rewritten.
+ * @return The moved SST.
+ */
+SSTPtr KVStore::moveSST(const SSTPtr& sst, size_t lowerLevel) {
+
+    SSTPtr movedSST = sst->withLevel(lowerLevel);
+    string filename = sst->getFilename();
+    if (rename(filename.c_str(), movedSST->getFilename().c_str()) < 0) {
+        cerr << "Fail to move file `" << filename << "`." << endl;
+        exit(-1);
+    }
+
+    size_t upperLevel = sst->getLevel();
+    vector<SSTPtr>& upperSSTs = *ssTables[upperLevel];
+    upperSSTs.erase(find(upperSSTs.begin(), upperSSTs.end(), sst));
+    rebuildFences(upperLevel);
+
+    reconstructLowerLevelMemory(-1, -1, vector<SSTPtr>{movedSST}, lowerLevel);
+    statistics.trivialMoveNumber++;
+
+    return movedSST;
 }
 
 /**
- * Follow the rule that compactions occurs on SSTs possessing the smallest
- * time stamps. If time stamps are equal, select SSTs with smallest
- * minimum keys.
- * @param level: The level that a number of SSTs overflow.
- * @param overflowNumber: The number of the overflowing SSTs. Always greater
- * than 0.
- * @return An array of the SSTs that need compaction.
+ * @return The L0 SSTs that can be moved into L1 as they are: they overlap
+ * no other L0 SST, no L1 SST, and lie outside the key range of the L0 SSTs
+ * that still need a merge.
  */
-vector<SSTPtr> KVStore::getCompactSSTs(size_t level, uint32_t overflowNumber) {
+vector<SSTPtr> KVStore::getTrivialMoveL0SSTs() {
+
+    const vector<SSTPtr>& L0SSTs = *ssTables[0];
+    const FencePointers& L0Fences = fences[0];
+    size_t SSTNumber = L0SSTs.size();
+    vector<bool> movable(SSTNumber, true);
+
+    // Deletions are discarded by merging if L1 is the last level.
+    bool dropDeletes = isLastLevel(1);
+
+    for (size_t i = 0; i < SSTNumber; ++i) {
+        size_t first, last;
+        LsmKey minKey = L0Fences.getMinKey(i);
+        LsmKey maxKey = L0Fences.getMaxKey(i);
+        if (fences[1].overlap(minKey, maxKey, first, last))
+            movable[i] = false;
+        if (dropDeletes && L0SSTs[i]->getTombstoneNumber() > 0)
+            movable[i] = false;
+        for (size_t j = 0; j < SSTNumber && movable[i]; ++j)
+            if (j != i && L0Fences.getMaxKey(j) >= minKey && L0Fences.getMinKey(j) <= maxKey)
+                movable[i] = false;
+    }
 
-    vector<SSTPtr> levelSSTs = *ssTables[level];
-    SSTTimeStampPriorComparator sstComparator;
-    sort(levelSSTs.begin(), levelSSTs.end(), sstComparator);
+    // The merged output spans the whole range of the remaining SSTs.
+    bool hasRemaining = false;
+    LsmKey remainingMinKey = UINT64_MAX;
+    LsmKey remainingMaxKey = 0;
+    for (size_t i = 0; i < SSTNumber; ++i) {
+        if (movable[i])
+            continue;
+        hasRemaining = true;
+        remainingMinKey = min(remainingMinKey, L0Fences.getMinKey(i));
+        remainingMaxKey = max(remainingMaxKey, L0Fences.getMaxKey(i));
+    }
 
-    vector<SSTPtr> compactSSTs;
-    for (uint32_t i = 0; i < overflowNumber; ++i)
-        compactSSTs.push_back(levelSSTs[i]);
+    vector<SSTPtr> movedSSTs;
+    for (size_t i = 0; i < SSTNumber; ++i) {
+        if (!movable[i])
+            continue;
+        if (hasRemaining && L0Fences.getMaxKey(i) >= remainingMinKey
+            && L0Fences.getMinKey(i) <= remainingMaxKey)
+            continue;
+        movedSSTs.push_back(L0SSTs[i]);
+    }
+    return movedSSTs;
+}
 
-    return compactSSTs;
+/**
+ * Merge whole sorted runs into one run in the output level. The runs must
+ * include every SST of the output level, and no newer run may remain below it.
+ * @param SSTs: All the SSTs of the runs to merge.
+ * @param outputLevel: The level where the merged run is placed.
+ */
+void KVStore::compactRuns(const vector<SSTPtr>& SSTs, size_t outputLevel) {
+
+    ensureLevel(outputLevel);
+
+    KVPair data = getCompactionData(SSTs, outputLevel);
+    TimeStamp maxTimeStamp = getMaxTimeStamp(SSTs);
+
+    vector<SSTPtr> mergedSSTs = runSubcompactions(SSTs, outputLevel, maxTimeStamp, data);
+    recordCompaction(SSTs, mergedSSTs);
+
+    // Take the inputs out of their levels.
+    vector<bool> changedLevels(ssTables.size(), false);
+    for (const auto& sst : SSTs) {
+        size_t level = sst->getLevel();
+        vector<SSTPtr>& levelSSTs = *ssTables[level];
+        levelSSTs.erase(find(levelSSTs.begin(), levelSSTs.end(), sst));
+        changedLevels[level] = true;
+    }
+
+    // Place the merged run into the output level.
+    vector<SSTPtr>& outputSSTs = *ssTables[outputLevel];
+    outputSSTs.insert(outputSSTs.end(), mergedSSTs.begin(), mergedSSTs.end());
+    SSTKeyPriorComparator sstComparator;
+    sort(outputSSTs.begin(), outputSSTs.end(), sstComparator);
+    changedLevels[outputLevel] = true;
 
+    for (size_t level = 0; level < changedLevels.size(); ++level)
+        if (changedLevels[level])
+            rebuildFences(level);
+
+    // Remove the input files only now that the merged run is complete on
+    // the disk, so that a crash never loses the runs.
+    for (const auto& sst : SSTs)
+        removeSSTFromDisk(sst);
+}
+
+void KVStore::recordCompaction(const vector<SSTPtr>& inputSSTs, const vector<SSTPtr>& outputSSTs) {
+    for (const auto& sst : inputSSTs)
+        statistics.compactionBytesRead += sst->getFileSize();
+    for (const auto& sst : outputSSTs)
+        statistics.compactionBytesWritten += sst->getFileSize();
+    statistics.compactionNumber++;
+}
+
+void KVStore::getCompact0Range(LsmKey& minKey, LsmKey& maxKey) {
+    const FencePointers& L0Fences = fences[0];
+    minKey = L0Fences.getMinKey(0);
+    maxKey = L0Fences.getMaxKey(0);
+    for (size_t i = 1; i < L0Fences.size(); ++i) {
+        minKey = min(minKey, L0Fences.getMinKey(i));
+        maxKey = max(maxKey, L0Fences.getMaxKey(i));
+    }
 }
 
 /**
@@ -394,23 +1477,15 @@ vector<SSTPtr> KVStore::getOverlapSSTs(LsmKey minKey, LsmKey maxKey, size_t leve
 
     vector<SSTPtr> overlapSSTs;
 
-    if (ssTables[level]->empty())
+    size_t first, last;
+    if (!fences[level].overlap(minKey, maxKey, first, last))
         return overlapSSTs;
 
-    vector<SSTPtr> levelSSTs = *ssTables[level];
-    uint32_t length = levelSSTs.size();
-
-    uint32_t leftIndex = sstBinarySearch(levelSSTs, minKey, 0, length - 1);
-
-    if (levelSSTs[leftIndex]->getMaxKey() < minKey)
-        if ((leftIndex == length - 1)
-            || (leftIndex < length - 1 && levelSSTs[leftIndex+1]->getMinKey() > maxKey))
-            return overlapSSTs;
-
-    minOverlapIndex = leftIndex;
-    maxOverlapIndex = 1 + sstBinarySearch(levelSSTs, maxKey, 0, length - 1);
+    minOverlapIndex = first;
+    maxOverlapIndex = last;
 
-    for (uint32_t i = minOverlapIndex; i < maxOverlapIndex; ++i)
+    const vector<SSTPtr>& levelSSTs = *ssTables[level];
+    for (size_t i = first; i < last; ++i)
         overlapSSTs.push_back(levelSSTs[i]);
 
     return overlapSSTs;
@@ -418,55 +1493,13 @@ vector<SSTPtr> KVStore::getOverlapSSTs(LsmKey minKey, LsmKey maxKey, size_t leve
 
 
 /**
- * Merge sort the SSTs need compact in L0 and L1 using priority queue.
+ * Merge sort the SSTs need compact in L0 and L1.
  * Write the new SSTs into the disk.
  * @param SSTs: SSTs need compact in L0 and L1.
  * @return New SSTs generated during compaction.
  */
 vector<SSTPtr> KVStore::merge0AndWriteToDisk(const vector<SSTPtr> &SSTs, TimeStamp maxTimeStamp, const KVPair& data) {
-
-    vector<SSTPtr> newSSTs;
-    priority_queue<KeyRef, vector<KeyRef>, KeyRefGreaterThan> pq;
-    vector<LsmKey> sortedKeys;
-    KeyRef currentRef;
-    size_t currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
-
-    for (const auto & SST : SSTs)
-        pq.push(make_pair(SST, 0));
-
-    while (!pq.empty()) {
-        currentRef = pq.top();
-        SSTPtr currentSST = currentRef.first;
-        size_t currentIndex = currentRef.second;
-        vector<DataIndex> currentDataIndexes = currentSST->getDataIndexes();
-        LsmKey currentKey = currentDataIndexes[currentIndex].key;
-        LsmValue currentValue = data.at(currentKey);
-
-        if (sortedKeys.empty())
-            sortedKeys.push_back(currentKey);
-
-        if ((ssTables.size() != 2 || currentValue != DELETE_SIGN)
-            && !sortedKeys.empty() && sortedKeys.back() != currentKey) {
-            size_t sizeIncrement = DATA_INDEX_SIZE + currentValue.size();
-            if (currentSize + sizeIncrement > MAX_SSTABLE_SIZE) {
-                newSSTs.push_back(generateNewSST(sortedKeys, data, 1, maxTimeStamp));
-                sortedKeys.clear();
-                currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
-            }
-            sortedKeys.push_back(currentKey);
-            currentSize += sizeIncrement;
-        }
-
-        pq.pop();
-        if (currentIndex != currentDataIndexes.size() - 1)
-            pq.push(make_pair(currentSST, currentIndex + 1));
-    }
-
-    // Pack the remaining data into an SST.
-    if (!sortedKeys.empty())
-        newSSTs.push_back(generateNewSST(sortedKeys, data, 1, maxTimeStamp));
-
-    return newSSTs;
+    return runSubcompactions(SSTs, 1, maxTimeStamp, data);
 }
 
 /**
@@ -479,79 +1512,179 @@ vector<SSTPtr> KVStore::merge0AndWriteToDisk(const vector<SSTPtr> &SSTs, TimeSta
  */
 vector<SSTPtr> KVStore::mergeAndWriteToDisk(const SSTPtr& upperLevelSST, const vector<SSTPtr>& lowerLevelSSTs,
                                             TimeStamp maxTimeStamp, const KVPair& data) {
+    vector<SSTPtr> SSTs(lowerLevelSSTs);
+    SSTs.push_back(upperLevelSST);
+    return runSubcompactions(SSTs, upperLevelSST->getLevel() + 1, maxTimeStamp, data);
+}
 
-    // Initialize.
+/**
+ * Split one compaction into disjoint key ranges and merge each range on its
+ * own thread. The outputs are returned together in key order so that they
+ * can be installed into the lower level at once.
+ * @param SSTs: All the SSTs that need compact, from both levels.
+ * @param lowerLevel: The level where the new SSTs are written.
+ * @return New SSTs generated during compaction.
+ */
+vector<SSTPtr> KVStore::runSubcompactions(const vector<SSTPtr>& SSTs, size_t lowerLevel,
+                                          TimeStamp maxTimeStamp, const KVPair& data) {
+
+    vector<pair<LsmKey, LsmKey>> ranges = getSubcompactionRanges(SSTs, lowerLevel);
+
+    // Create the directory before the workers race for it.
+    utils::mkdir(getLevelDir(lowerLevel).c_str());
+
+    // Every range is written by a thread of its own while it is merged.
+    vector<vector<SSTPtr>> rangeSSTs(ranges.size());
+    vector<uint64_t> mergeMicros(ranges.size());
+    vector<unique_ptr<BackgroundFileWriter>> writers;
+    for (size_t i = 0; i < ranges.size(); ++i)
+        writers.push_back(make_unique<BackgroundFileWriter>(fileWriteOptions, COMPACTION_PENDING_OUTPUTS));
+    auto mergeRange = [&](size_t i) {
+        auto start = chrono::steady_clock::now();
+        rangeSSTs[i] = mergeRangeAndWriteToDisk(SSTs, ranges[i], lowerLevel, maxTimeStamp, data, *writers[i]);
+        mergeMicros[i] = microsSince(start);
+    };
+
+    if (ranges.size() == 1) {
+        mergeRange(0);
+    } else {
+        statistics.subcompactionNumber += ranges.size();
+        vector<thread> workers;
+        for (size_t i = 0; i < ranges.size(); ++i)
+            workers.emplace_back(mergeRange, i);
+        for (auto& worker : workers)
+            worker.join();
+    }
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        writers[i]->finish();
+        statistics.compactionMergeMicros += mergeMicros[i] - min(mergeMicros[i], writers[i]->getWaitMicros());
+        statistics.compactionWriteMicros += writers[i]->getWriteMicros();
+    }
 
     vector<SSTPtr> newSSTs;
-    vector<LsmKey> sortedKeys;
-    size_t currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
-    size_t upperKeyNumber = upperLevelSST->getKeyNumber();
-    size_t upperIndex = 0;
-    size_t lowerKeyNumber;
-    size_t lowerIndex;
-    size_t lowerLevel = upperLevelSST->getLevel() + 1;
-    KeyRefLessThan keyRefLessThan;
-
-    // Function for merging and writing data to the disk. Used in 2-way merge below.
-
-    auto merge = [&](const SSTPtr& sst, size_t& index) {
-        LsmKey key = sst->getDataIndexes()[index].key;
-        const LsmValue& value = data.at(key);
-        if ((lowerLevel != ssTables.size() || value != DELETE_SIGN)
-            && !sortedKeys.empty() && sortedKeys.back() != key) {
-            size_t sizeIncrement = DATA_INDEX_SIZE + value.size();
-            if (currentSize + sizeIncrement > MAX_SSTABLE_SIZE) {
-                newSSTs.push_back(generateNewSST(sortedKeys, data, lowerLevel, maxTimeStamp));
-                sortedKeys.clear();
-                currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+    for (const auto& SSTsOfRange : rangeSSTs)
+        newSSTs.insert(newSSTs.end(), SSTsOfRange.begin(), SSTsOfRange.end());
+    return newSSTs;
+}
+
+/**
+ * Cut the key space of a compaction into at most `maxSubcompactions` disjoint
+ * ranges. The minimum keys of the lower level SSTs are used as boundaries.
+ * If there are too few of them, keys sampled evenly from the largest input
+ * SST are used instead. Small compactions are not split.
+ * @return Inclusive key ranges covering the whole key space in order.
+ */
+vector<pair<LsmKey, LsmKey>> KVStore::getSubcompactionRanges(const vector<SSTPtr>& SSTs, size_t lowerLevel) const {
+
+    vector<LsmKey> boundaries;      // Minimum key of each range except the first.
+
+    if (maxSubcompactions > 1 && SSTs.size() >= SUBCOMPACTION_MIN_SST_NUMBER) {
+        for (const auto& sst : SSTs)
+            if (sst->getLevel() == lowerLevel && sst->getMinKey() > 0)
+                boundaries.push_back(sst->getMinKey());
+
+        if (boundaries.size() < 2) {
+            boundaries.clear();
+            SSTPtr largestSST = SSTs.front();
+            for (const auto& sst : SSTs)
+                if (sst->getKeyNumber() > largestSST->getKeyNumber())
+                    largestSST = sst;
+            size_t keyNumber = largestSST->getKeyNumber();
+            for (size_t i = 1; i < maxSubcompactions; ++i) {
+                LsmKey key = largestSST->getKey(keyNumber * i / maxSubcompactions);
+                if (key > 0)
+                    boundaries.push_back(key);
             }
-            sortedKeys.push_back(key);
-            currentSize += sizeIncrement;
         }
-        index++;
-    };
-
-    // 2-way merge sort and write data to the disk.
-
-    for (const auto& lowerLevelSST : lowerLevelSSTs) {
 
-        lowerIndex = 0;
-        lowerKeyNumber = lowerLevelSST->getKeyNumber();
+        sort(boundaries.begin(), boundaries.end());
+        boundaries.erase(unique(boundaries.begin(), boundaries.end()), boundaries.end());
 
-        if (sortedKeys.empty()) {
-            LsmKey upperKey = upperLevelSST->getDataIndexes()[0].key;
-            LsmKey lowerKey = lowerLevelSST->getDataIndexes()[0].key;
-            if ((upperKey < lowerKey) ||
-                (upperKey == lowerKey && upperLevelSST->getTimeStamp() < lowerLevelSST->getTimeStamp()))
-                sortedKeys.push_back(upperKey);
-            else
-                sortedKeys.push_back(lowerKey);
+        // Keep at most `maxSubcompactions` - 1 boundaries, evenly spaced.
+        if (boundaries.size() >= maxSubcompactions) {
+            vector<LsmKey> thinned;
+            for (size_t i = 1; i < maxSubcompactions; ++i)
+                thinned.push_back(boundaries[boundaries.size() * i / maxSubcompactions]);
+            thinned.erase(unique(thinned.begin(), thinned.end()), thinned.end());
+            boundaries = thinned;
         }
+    }
 
-        while (upperIndex != upperKeyNumber && lowerIndex != lowerKeyNumber) {
-            KeyRef upperKeyRef = make_pair(upperLevelSST, upperIndex);
-            KeyRef lowerKeyRef = make_pair(lowerLevelSST, lowerIndex);
+    vector<pair<LsmKey, LsmKey>> ranges;
+    LsmKey rangeStart = 0;
+    for (const auto& boundary : boundaries) {
+        ranges.emplace_back(rangeStart, boundary - 1);
+        rangeStart = boundary;
+    }
+    ranges.emplace_back(rangeStart, UINT64_MAX);
+    return ranges;
+}
 
-            if (keyRefLessThan(upperKeyRef, lowerKeyRef))
-                merge(upperLevelSST, upperIndex);
-            else
-                merge(lowerLevelSST, lowerIndex);
-        }
+/**
+ * Merge sort the keys of the SSTs within an inclusive key range using
+ * priority queue, and write them with the versions kept by
+ * `getCompactionData` into new SSTs. All the versions of a key go into the
+ * same SST. Only reads shared state, so that ranges can be merged concurrently.
+ * @return New SSTs generated for the range, in key order.
+ */
+vector<SSTPtr> KVStore::mergeRangeAndWriteToDisk(const vector<SSTPtr>& SSTs, const pair<LsmKey, LsmKey>& range,
+                                                 size_t lowerLevel, TimeStamp maxTimeStamp,
+                                                 const KVPair& data, BackgroundFileWriter& writer) const {
+
+    vector<SSTPtr> newSSTs;
+    CompressionType compression = getCompression(lowerLevel);
+    priority_queue<KeyRef, vector<KeyRef>, KeyRefGreaterThan> pq;
+    vector<LsmKey> sortedKeys;
+    size_t currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+    bool hasLastKey = false;
+    LsmKey lastKey = 0;
 
-        while (lowerIndex != lowerKeyNumber)
-            merge(lowerLevelSST, lowerIndex);
+    for (const auto& sst : SSTs) {
+        size_t startIndex = sst->lowerBound(range.first);
+        if (startIndex < sst->getKeyNumber() && sst->getKey(startIndex) <= range.second)
+            pq.push(make_pair(sst, startIndex));
     }
 
-    while (upperIndex != upperKeyNumber)
-        merge(upperLevelSST, upperIndex);
+    while (!pq.empty()) {
+        KeyRef currentRef = pq.top();
+        pq.pop();
+        const SSTPtr& currentSST = currentRef.first;
+        size_t currentIndex = currentRef.second;
+        LsmKey currentKey = currentSST->getKey(currentIndex);
 
-    // Pack the remaining data into an SST.
+        if (currentIndex + 1 < currentSST->getKeyNumber()
+            && currentSST->getKey(currentIndex + 1) <= range.second)
+            pq.push(make_pair(currentSST, currentIndex + 1));
 
-    if (!sortedKeys.empty())
-        newSSTs.push_back(generateNewSST(sortedKeys, data, lowerLevel, maxTimeStamp));
+        if (hasLastKey && currentKey == lastKey)    // Same key from an other SST.
+            continue;
+        hasLastKey = true;
+        lastKey = currentKey;
 
-    return newSSTs;
+        const LsmVersions& versions = data.at(currentKey);
+        if (versions.empty())       // Every version is discarded.
+            continue;
 
+        size_t sizeIncrement = 0;
+        for (const auto& version : versions)
+            sizeIncrement += DATA_INDEX_SIZE + version.value.size();
+        if (!sortedKeys.empty() && currentSize + sizeIncrement > MAX_SSTABLE_SIZE) {
+            newSSTs.push_back(generateNewSST(sortedKeys, data, lowerLevel, maxTimeStamp,
+                                             compression, writer));
+            sortedKeys.clear();
+            currentSize = HEADER_SIZE + BLOOM_FILTER_SIZE;
+        }
+        sortedKeys.push_back(currentKey);
+        currentSize += sizeIncrement;
+    }
+
+    // Pack the remaining data into an SST.
+    if (!sortedKeys.empty()) {
+        newSSTs.push_back(generateNewSST(sortedKeys, data, lowerLevel, maxTimeStamp,
+                                         compression, writer));
+    }
+
+    return newSSTs;
 }
 
 /**
@@ -563,6 +1696,7 @@ void KVStore::reconstructL0() {
     for (const auto& sst : L0SST)
         removeSSTFromDisk(sst);
     ssTables[0]->clear();
+    rebuildFences(0);
 }
 
 void KVStore::reconstructUpperLevel(size_t upperLevel, const vector<SSTPtr> &compactSSTs) {
@@ -574,6 +1708,7 @@ void KVStore::reconstructUpperLevel(size_t upperLevel, const vector<SSTPtr> &com
             ssTables[upperLevel]->erase(delIt);
         }
     }
+    rebuildFences(upperLevel);
 }
 
 /**
@@ -593,6 +1728,10 @@ void KVStore::reconstructLowerLevelDisk(int64_t minOverlapIndex, int64_t maxOver
 void KVStore::reconstructLowerLevelMemory(int64_t minOverlapIndex, int64_t maxOverlapIndex,
                                           const vector<SSTPtr>& newSSTs, size_t lowerLevel) {
 
+    // Every key has been discarded and nothing needs to be replaced.
+    if (minOverlapIndex == -1 && maxOverlapIndex == -1 && newSSTs.empty())
+        return;
+
     vector<SSTPtr> previousSSTs = *ssTables[lowerLevel];
     uint32_t length = previousSSTs.size();
     vector<SSTPtr> updatedSSTs;
@@ -601,14 +1740,9 @@ void KVStore::reconstructLowerLevelMemory(int64_t minOverlapIndex, int64_t maxOv
         minOverlapIndex = maxOverlapIndex = 0;
 
     // If no overlapping, binary search for the insert position.
-    if (minOverlapIndex == -1 && maxOverlapIndex == -1) {
-        LsmKey insertMinKey = newSSTs.front()->getMinKey();
-        if (insertMinKey < previousSSTs.front()->getMinKey())
-            minOverlapIndex = maxOverlapIndex = 0;
-        else
-            minOverlapIndex = maxOverlapIndex =
-                    sstBinarySearch(previousSSTs, insertMinKey, 0, length - 1) + 1;
-    }
+    if (minOverlapIndex == -1 && maxOverlapIndex == -1)
+        minOverlapIndex = maxOverlapIndex =
+                fences[lowerLevel].insertPosition(newSSTs.front()->getMinKey());
 
     // Old SSTs left to the overlapping SSTs.
     for (uint32_t i = 0; i < minOverlapIndex; ++i)
@@ -624,37 +1758,7 @@ void KVStore::reconstructLowerLevelMemory(int64_t minOverlapIndex, int64_t maxOv
 
     // Save the new layer in the memory.
     ssTables[lowerLevel] = make_shared<vector<SSTPtr>>(updatedSSTs);
-
-}
-
-
-/**
- * Find the index of the SST where the key might exist according to the
- * minimum keys of the SSTs. Can also be used for searching for the
- * inserting position of one or some SSTs.
- * @param SSTs: An array of sorted SSTs according to their minimum keys.
- * @param key: Key to be found or minimum key of the SST to be inserted.
- * @param left: Left bound of search range.
- * @param right: Right bound of search range.
- * @return The index of the SST where the its minimum key is exactly smaller
- * than or equal to the searched key.
- */
-uint32_t KVStore::sstBinarySearch(const vector<SSTPtr> &SSTs, LsmKey key,
-                                  uint32_t left, uint32_t right) {
-    if (left >= right) {
-        if (right && SSTs[right]->getMinKey() > key)
-            right--;
-        return right;
-    }
-
-    uint32_t mid = left + (right - left) / 2;
-    LsmKey midMinKey = SSTs[mid]->getMinKey();
-
-    if (key < midMinKey)
-        return sstBinarySearch(SSTs, key, left, mid ? mid - 1 : mid);
-    if (key > midMinKey)
-        return sstBinarySearch(SSTs, key, mid + 1, right);
-    return mid;
+    rebuildFences(lowerLevel);
 
 }
 
@@ -680,107 +1784,225 @@ TimeStamp KVStore::getMaxTimeStamp(const SSTPtr& oneSST, const vector<SSTPtr> &S
 }
 
 /**
+ * Read every version of the keys of the SSTs, and keep the versions still
+ * seen by some reader as `collapseVersions` decides. The values in blob
+ * files only discarded versions point at become garbage.
  * @param SSTs: SSTables to retrieve key-value pairs.
- * @return Pairs of key and its latest value stored in an unordered map.
+ * @param outputLevel: The level where the compaction writes its output.
+ * @return The kept versions of every key, from the newest to the oldest,
+ * stored in an unordered map. The versions of a key may be empty.
  */
-KVPair KVStore::getCompactionData(const vector<SSTPtr>& SSTs) {
-
-    // Sort the SSTs according to their time tokens so that the value of the same key
-    // in a newer SST will always overwrite the previous one.
-
-    auto sortByTimeStamp = [](const SSTPtr& sstA, const SSTPtr& sstB) {
-        return sstA->getTimeStamp() < sstB->getTimeStamp();
+KVPair KVStore::getCompactionData(const vector<SSTPtr>& SSTs, size_t outputLevel) {
+
+    // Every SST is read by a thread of its own, up to COMPACTION_PREFETCH_SSTS
+    // ahead of the one whose entries are taken.
+    size_t SSTNumber = SSTs.size();
+    vector<vector<pair<LsmKey, LsmEntry>>> entriesOf(SSTNumber);
+    vector<uint64_t> readMicros(SSTNumber);
+    vector<thread> readers(SSTNumber);
+    auto startReader = [&](size_t i) {
+        readers[i] = thread([&, i]() {
+            auto start = chrono::steady_clock::now();
+            SSTs[i]->getValuesFromDisk(entriesOf[i], useDirectIO);
+            readMicros[i] = microsSince(start);
+        });
     };
-
-    vector<SSTPtr> tempSSTs(SSTs);
-    sort(tempSSTs.begin(), tempSSTs.end(), sortByTimeStamp);
+    for (size_t i = 0; i < min<size_t>(SSTNumber, COMPACTION_PREFETCH_SSTS); ++i)
+        startReader(i);
 
     KVPair sstData;
-    for (const auto& sst : tempSSTs)
-        sst->getValuesFromDisk(sstData);
+    uint64_t mergeMicros = 0;
+    for (size_t i = 0; i < SSTNumber; ++i) {
+        readers[i].join();
+        if (i + COMPACTION_PREFETCH_SSTS < SSTNumber)
+            startReader(i + COMPACTION_PREFETCH_SSTS);
+        statistics.compactionReadMicros += readMicros[i];
+
+        auto start = chrono::steady_clock::now();
+        for (auto& entry : entriesOf[i]) {
+            if (entry.second.type == TYPE_BLOB_INDEX)
+                blobStore.release(BlobIndex::decode(entry.second.value));
+            sstData[entry.first].push_back(std::move(entry.second));
+        }
+        vector<pair<LsmKey, LsmEntry>>().swap(entriesOf[i]);
+        mergeMicros += microsSince(start);
+    }
+
+    auto start = chrono::steady_clock::now();
+    bool lastLevel = isLastLevel(outputLevel);
+    for (auto& pair : sstData) {
+        collapseVersions(pair.first, pair.second, outputLevel, lastLevel);
+        for (const auto& version : pair.second)
+            if (version.type == TYPE_BLOB_INDEX)
+                blobStore.retain(BlobIndex::decode(version.value));
+    }
+    statistics.compactionMergeMicros += mergeMicros + microsSince(start);
 
     return sstData;
 }
 
+/**
+ * Discard the versions of a key no reader can see. Every live snapshot, and
+ * the reads without one, sees the newest version up to its sequence number,
+ * so of the versions between two snapshots only the newest is kept, with
+ * older merge operands applied to it. A range tombstone deleting the key
+ * acts as a deletion at its sequence number, which is not written out.
+ * Merge operands become values, and deletions are discarded, once no level
+ * below the output level can hold the key.
+ * @param versions: Every version of the key, in any order. Left with the
+ * kept versions from the newest to the oldest.
+ */
+void KVStore::collapseVersions(LsmKey key, LsmVersions& versions, size_t outputLevel, bool lastLevel) const {
+
+    auto newerFirst = [](const LsmEntry& e1, const LsmEntry& e2) { return e1.sequence > e2.sequence; };
+    if (versions.size() > 1)
+        sort(versions.begin(), versions.end(), newerFirst);
+
+    vector<SequenceNumber> tombstoneSequences;
+    if (!rangeTombstones.empty())
+        rangeTombstones.getCoveringSequences(key, versions.back().sequence, tombstoneSequences);
+    sort(tombstoneSequences.begin(), tombstoneSequences.end(), greater<SequenceNumber>());
+
+    if (versions.size() > 1 || !tombstoneSequences.empty()) {
+        LsmVersions keptVersions;
+        bool hasNewer = false;
+        bool newerIsTombstone = false;
+        SequenceNumber newerStripe = 0;
+        size_t t = 0;
+        const LsmEntry deletion{TYPE_DELETION, ""};
+
+        for (auto& version : versions) {
+
+            // Range tombstones newer than the version come first.
+            for (; t < tombstoneSequences.size() && tombstoneSequences[t] > version.sequence; ++t) {
+                SequenceNumber stripe = getStripe(tombstoneSequences[t]);
+                if (hasNewer && stripe == newerStripe) {
+                    if (!newerIsTombstone && keptVersions.back().type == TYPE_MERGE)
+                        foldMerge(key, keptVersions.back(), &deletion);
+                    continue;
+                }
+                hasNewer = newerIsTombstone = true;
+                newerStripe = stripe;
+            }
+
+            SequenceNumber stripe = getStripe(version.sequence);
+            if (hasNewer && stripe == newerStripe) {    // Hidden by the newer version.
+                if (!newerIsTombstone && keptVersions.back().type == TYPE_MERGE)
+                    foldMerge(key, keptVersions.back(), &version);
+                continue;
+            }
+            keptVersions.push_back(std::move(version));
+            hasNewer = true;
+            newerIsTombstone = false;
+            newerStripe = stripe;
+        }
+
+        versions = std::move(keptVersions);
+    }
+
+    // Nothing older below the output level.
+    if (!versions.empty() && (versions.back().type == TYPE_MERGE || versions.back().type == TYPE_DELETION)
+        && (lastLevel || !keyMayExistBelow(key, outputLevel))) {
+        if (versions.back().type == TYPE_MERGE)
+            foldMerge(key, versions.back(), nullptr);
+        while (!versions.empty() && versions.back().type == TYPE_DELETION)
+            versions.pop_back();
+    }
+}
+
 
-KVPair KVStore::getCompactionData(const SSTPtr& sst, const vector<SSTPtr>& SSTs) {
+KVPair KVStore::getCompactionData(const SSTPtr& sst, const vector<SSTPtr>& SSTs, size_t outputLevel) {
 
     vector<SSTPtr> allSSTs(SSTs);
     allSSTs.push_back(sst);
-    return getCompactionData(allSSTs);
+    return getCompactionData(allSSTs, outputLevel);
 }
 
 /**
  * Write the keys and their values into the disk in the form of SST.
  * @param keys: All the sorted keys to generate the new SST.
  * @param data: Key-value pairs.
+ * @param compression: The codec of the blocks of values.
+ * @param writer: Writes the file, which is complete once the writer finishes.
+ * @param fileNumber: Names the file. 0 takes a number no other SST of the
+ * store has, so that the file never replaces an input of a compaction.
  * @return The generated SST.
  */
-SSTPtr KVStore::generateNewSST(const vector<LsmKey> &keys, const KVPair& data,
-                               size_t level, TimeStamp maxTimeStamp) {
+SSTPtr KVStore::generateNewSST(const vector<LsmKey> &keys, const KVPair& data, size_t level,
+                               TimeStamp maxTimeStamp, CompressionType compression,
+                               BackgroundFileWriter& writer, uint64_t fileNumber) const {
+
+    if (fileNumber == 0)
+        fileNumber = nextFileNumber++;
 
     // Create the directory.
-    string pathname = "./data/level-" + to_string(level) + "/";
+    string pathname = getLevelDir(level);
     utils::mkdir(pathname.c_str());
 
-    // Open the output file.
-    string filename = pathname + "table-" + to_string(maxTimeStamp)
-                      + "-" + to_string(keys.front())
-                      + "-" + to_string(keys.back())
-                      + ".sst";
-    ofstream out(filename, ios::out | ios::binary);
-    if (!out.is_open()) {
-        cerr << "Open file failed." << endl;
-        exit(-1);
-    }
-
     // Initialize.
-    size_t keyNumber = keys.size();
-    SSTHeader sstHeader = SSTHeader(maxTimeStamp, keyNumber, keys.front(), keys.back());
+    size_t keyNumber = 0;
+    uint64_t tombstoneNumber = 0;
+    SequenceNumber minSequence = MAX_SEQUENCE_NUMBER;
+    SequenceNumber maxSequence = 0;
+    for (const auto& key : keys) {
+        for (const auto& entry : data.at(key)) {
+            keyNumber++;
+            if (entry.type == TYPE_DELETION)
+                tombstoneNumber++;
+            minSequence = min(minSequence, entry.sequence);
+            maxSequence = max(maxSequence, entry.sequence);
+        }
+    }
     BloomFilter bloomFilter;
     vector<DataIndex> dataIndexes = vector<DataIndex>();
-    uint32_t dataIndexStart = HEADER_SIZE + BLOOM_FILTER_SIZE;
     uint32_t dataStart = HEADER_SIZE + BLOOM_FILTER_SIZE + DATA_INDEX_SIZE * keyNumber;
 
-    // Write header into the file.
-    out.write((char*)&sstHeader, HEADER_SIZE);
-
-    // Set the file position to tha start of data index.
-    out.seekp(dataIndexStart, ios::beg);
-
-    // Write data indexes into the file.
+    // Build data indexes and lay out the values in memory, so that the file
+    // is written in one pass.
     uint32_t offset = dataStart;
+    BlockBuilder blockBuilder(compression, dataStart);
     for (const auto& key : keys) {
-        out.write((char*)&key, sizeof(key));
-        out.write((char*)&offset, sizeof(offset));
+        for (const auto& entry : data.at(key)) {
+            bloomFilter.insert(key);
+            DataIndex dataIndex = DataIndex(key, entry.sequence, offset, entry.type);
+            dataIndexes.push_back(dataIndex);
+            blockBuilder.add(entry.value);
 
-        bloomFilter.insert(key);
-        DataIndex dataIndex = DataIndex(key, offset);
-        dataIndexes.push_back(dataIndex);
-
-        offset += data.at(key).size();
-    }
-
-    // Write data into the file.
-    for (const auto& key: keys) {
-        LsmValue value = data.at(key);
-        out.write((char*)&value[0], value.size());
+            offset += entry.value.size();
+        }
     }
+    const string& blocks = blockBuilder.finish();
+    const vector<BlockHandle>& blockHandles = blockBuilder.getHandles();
+    SSTHeader sstHeader = SSTHeader(maxTimeStamp, keyNumber, keys.front(), keys.back(), tombstoneNumber,
+                                    minSequence, maxSequence, compression, blockHandles.size(), fileNumber);
 
-    // Write bloom filter into the file.
-    out.seekp(HEADER_SIZE, ios::beg);
-    out.write((char*)(bloomFilter.byteArray), BLOOM_FILTER_SIZE);
-
-    // Close the file.
-    out.close();
+    // Lay out header, bloom filter, data indexes, data and footer, and hand
+    // the file to the writer.
+    string filename = pathname + "table-" + to_string(maxTimeStamp)
+                      + "-" + to_string(keys.front())
+                      + "-" + to_string(keys.back())
+                      + "-" + to_string(fileNumber)
+                      + ".sst";
+    SSTFooter sstFooter(sstHeader, bloomFilter, dataIndexes, blockHandles);
+    string contents;
+    contents.reserve(dataStart + blocks.size() + SST_FOOTER_SIZE);
+    contents.append((const char*)&sstHeader, HEADER_SIZE);
+    contents.append((const char*)bloomFilter.byteArray, BLOOM_FILTER_SIZE);
+    for (const auto& dataIndex : dataIndexes)
+        contents.append((const char*)&dataIndex, DATA_INDEX_SIZE);
+    contents.append(blocks);
+    contents.append((const char*)&sstFooter, SST_FOOTER_SIZE);
+    uint32_t fileSize = contents.size();
+    writer.write(filename, std::move(contents));
 
     // Return an SST.
-    SSTPtr sst = make_shared<SSTable>(level, sstHeader, bloomFilter, dataIndexes);
+    SSTPtr sst = make_shared<SSTable>(dataDir, level, sstHeader, bloomFilter, dataIndexes, fileSize, blockHandles);
     return sst;
 
 }
 
 void KVStore::removeSSTFromDisk(const SSTPtr& delSST) {
+    delSST->loadMetadata();     // Or the metadata warm-up may find the file gone.
     string filename = delSST->getFilename();
     if (utils::rmfile(filename.c_str()) < 0) {
         cerr << "Fail to remove file `" << filename << "`." << endl;
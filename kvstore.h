@@ -7,42 +7,124 @@
 #include <utility>
 #include <algorithm>
 #include <cmath>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <set>
+#include <string_view>
 #include "kvstore_api.h"
 #include "MemTable.h"
 #include "SSTable.h"
+#include "FencePointers.h"
+#include "RangeTombstone.h"
+#include "MergeOperator.h"
+#include "WriteBatch.h"
+#include "PinnableValue.h"
+#include "Snapshot.h"
+#include "BlobStore.h"
+#include "RateLimiter.h"
+#include "WriteController.h"
+#include "CompactionStrategy.h"
+#include "Options.h"
+#include "Statistics.h"
 #include "constants.h"
 #include "utils.h"
 
 class KVStore : public KVStoreAPI {
 
 private:
+    const string dataDir;       // Ends with a slash.
     shared_ptr<MemTable> memTable;
-    uint32_t memTableSize;
+    uint64_t memTableSize;
     unordered_map<size_t, shared_ptr<vector<SSTPtr>>> ssTables;
+    unordered_map<size_t, FencePointers> fences;
+    vector<SubLevel> L0SubLevels;
+    RangeTombstoneList rangeTombstones;
     TimeStamp timeStamp;
+    SequenceNumber lastSequence;
+    multiset<SequenceNumber> snapshots;     // Sequence numbers of the live snapshots.
+    shared_ptr<CompactionStrategy> compactionStrategy;
+    const DeleteMode deleteMode;
+    const shared_ptr<MergeOperator> mergeOperator;
+    BlobStore blobStore;
+    const bool enableBlobFiles;
+    const uint64_t minBlobSize;
+    const double blobGarbageCollectionRatio;
+    const vector<CompressionType> compressionPerLevel;
+    const shared_ptr<RateLimiter> rateLimiter;
+    WriteController writeController;
+    const bool useDirectIO;
+    const FileWriteOptions fileWriteOptions;    // Of compactions and blob garbage collection.
+    const FileWriteOptions flushWriteOptions;
+    const ChecksumVerification verifyChecksumsOnOpen;
+    const MetadataLoading metadataLoading;
+    thread metadataWarmUp;
+    atomic<bool> stopMetadataWarmUp;
+    Statistics statistics;
+    const uint64_t writeBufferSize;
+    const uint32_t maxSubcompactions;
+    mutable atomic<uint64_t> nextFileNumber;    // Taken by concurrent subcompactions.
 
     void readAllSSTsFromDisk();
-    static SSTPtr readSSTFromDisk(const string& filename, size_t level);
+    void startMetadataWarmUp();
+    void joinMetadataWarmUp();
+    CompressionType getCompression(size_t level) const;
+    SSTPtr readSSTFromDisk(const string& filename, size_t level) const;
     void clearDisk();
+    void rebuildFences(size_t level);
+    void rebuildL0SubLevels();
+    string getLevelDir(size_t level) const;
+    string getRangeTombstoneFilename() const;
+    void dropCoveredSSTs();
+    size_t removeObsoleteRangeTombstones();
 
-    bool memTableOverflow(const LsmValue& v) const;
+    // Blob files
+    void readBlobFilesFromDisk();
+    void separateValues();
+    void readBlobValue(LsmEntry& entry) const;
+    void releaseBlobs(const SSTPtr& sst);
+    void collectBlobGarbage();
+
+    bool memTableOverflow(uint64_t writeBytes) const;
+    void flushOnOverflow(uint64_t writeBytes);
+    void makeRoomForWrite(uint64_t writeBytes);
+    void stallWrite(uint64_t writeBytes);
     void memToDisk();
-    LsmValue getValueFromDisk(LsmKey key);
-    uint32_t levelOverflow(size_t level);
-    void detectAndHandleOverflow();
+    bool getEntry(LsmKey key, SequenceNumber snapshot, LsmEntry& entry, PinnableValue* pinned = nullptr);
+    bool resolveVersions(LsmKey key, LsmVersions& versions, SequenceNumber snapshot, LsmEntry& entry) const;
+    void foldMerge(LsmKey key, LsmEntry& entry, const LsmEntry* olderEntry) const;
+    void foldMerges(LsmKey key, LsmVersions& mergeEntries, const LsmEntry* olderEntry) const;
+    bool keyProbablyExists(LsmKey key);
+    bool keyMayExistBelow(LsmKey key, size_t level) const;
+    size_t detectAndHandleOverflow(size_t maxCompactionNumber = SIZE_MAX);
+    void ensureLevel(size_t level);
+    bool isLastLevel(size_t level) const;
+
+    // Snapshots
+    static SequenceNumber getSnapshotSequence(const Snapshot* snapshot);
+    SequenceNumber getNewestSnapshot() const;
+    SequenceNumber getStripe(SequenceNumber sequence) const;
+    bool snapshotBetween(SequenceNumber lower, SequenceNumber upper) const;
 
     void compact0();
-    void compact(size_t upperLevel, uint32_t overflowNumber);
+    void compact(size_t upperLevel, const vector<SSTPtr>& compactSSTs);
     void compactOneSST(const SSTPtr& sst, size_t lowerLevel);
+    void compactRuns(const vector<SSTPtr>& SSTs, size_t outputLevel);
+    SSTPtr moveSST(const SSTPtr& sst, size_t lowerLevel);
+    vector<SSTPtr> getTrivialMoveL0SSTs();
+    void recordCompaction(const vector<SSTPtr>& inputSSTs, const vector<SSTPtr>& outputSSTs);
 
     void getCompact0Range(LsmKey& minKey, LsmKey& maxKey);
     vector<SSTPtr> getOverlapSSTs(LsmKey minKey, LsmKey maxKey, size_t level,
                                   int64_t& minOverlapIndex, int64_t& maxOverlapIndex);
-    vector<SSTPtr> getCompactSSTs(size_t upperLevel, uint32_t overflowNumber);
 
     vector<SSTPtr> merge0AndWriteToDisk(const vector<SSTPtr>& SSTs, TimeStamp maxTimeStamp, const KVPair& data);
     vector<SSTPtr> mergeAndWriteToDisk(const SSTPtr& upperLevelSST, const vector<SSTPtr>& lowerLevelSSTs,
                                               TimeStamp maxTimeStamp, const KVPair& data);
+    vector<SSTPtr> runSubcompactions(const vector<SSTPtr>& SSTs, size_t lowerLevel,
+                                     TimeStamp maxTimeStamp, const KVPair& data);
 
     // Reconstruction
     void reconstructL0();
@@ -52,22 +134,50 @@ private:
                                      const vector<SSTPtr>& newSSTs, size_t lowerLevel);
 
     // Compaction utils
-    static uint32_t sstBinarySearch(const vector<SSTPtr>& SSTs, LsmKey key, uint32_t left, uint32_t right);
     static TimeStamp getMaxTimeStamp(const vector<SSTPtr>& SSTs);
     static TimeStamp getMaxTimeStamp(const SSTPtr& oneSST, const vector<SSTPtr>& SSTs);
-    static KVPair getCompactionData(const vector<SSTPtr>& SSTs);
-    static KVPair getCompactionData(const SSTPtr& sst, const vector<SSTPtr>& SSTs);
-    static SSTPtr generateNewSST(const vector<LsmKey>& keys, const KVPair& data, size_t level, TimeStamp maxTimeStamp);
+    KVPair getCompactionData(const vector<SSTPtr>& SSTs, size_t outputLevel);
+    KVPair getCompactionData(const SSTPtr& sst, const vector<SSTPtr>& SSTs, size_t outputLevel);
+    void collapseVersions(LsmKey key, LsmVersions& versions, size_t outputLevel, bool lastLevel) const;
+    vector<pair<LsmKey, LsmKey>> getSubcompactionRanges(const vector<SSTPtr>& SSTs, size_t lowerLevel) const;
+    vector<SSTPtr> mergeRangeAndWriteToDisk(const vector<SSTPtr>& SSTs, const pair<LsmKey, LsmKey>& range,
+                                            size_t lowerLevel, TimeStamp maxTimeStamp,
+                                            const KVPair& data, BackgroundFileWriter& writer) const;
+    SSTPtr generateNewSST(const vector<LsmKey>& keys, const KVPair& data, size_t level,
+                          TimeStamp maxTimeStamp, CompressionType compression,
+                          BackgroundFileWriter& writer, uint64_t fileNumber = 0) const;
     static void removeSSTFromDisk(const SSTPtr& delSST);
 
 
 public:
-    explicit KVStore(const std::string &dir);
+    explicit KVStore(const std::string &dir, const Options& options = Options());
     ~KVStore();
 
     void put(uint64_t key, const std::string &s) override;
+    void put(uint64_t key, std::string &&s);
+    void put(uint64_t key, std::string_view s);
+    void put(uint64_t key, const char *s);
     std::string get(uint64_t key) override;
+    std::string get(uint64_t key, const Snapshot *snapshot);
+    bool get(uint64_t key, PinnableValue &value, const Snapshot *snapshot = nullptr);
+    bool get(uint64_t key, std::string &value, const Snapshot *snapshot = nullptr);
     bool del(uint64_t key) override;
+    bool del(uint64_t key, DeleteMode mode);
+    void merge(uint64_t key, const std::string &operand);
+    void write(const WriteBatch &batch);
     void reset() override;
 
+    void deleteRange(uint64_t start, uint64_t end);
+    void scan(uint64_t start, uint64_t end, std::list<std::pair<uint64_t, std::string>> &list,
+              const Snapshot *snapshot = nullptr);
+
+    const Snapshot* getSnapshot();
+    void releaseSnapshot(const Snapshot *snapshot);
+
+    bool needsFlush(uint64_t writeBytes) const;
+    void flush();
+
+    bool verifyChecksums() const;
+    const Statistics& getStatistics() const;
+
 };
@@ -67,7 +67,8 @@ protected:
 	bool verbose;
 
 public:
-	Test(const std::string &dir, bool v=true): store(dir), verbose(v)
+	Test(const std::string &dir, bool v=true, const Options &options=Options())
+		: store(dir, options), verbose(v)
 	{
 		nr_tests = 0;
 		nr_passed_tests = 0;
@@ -103,7 +103,7 @@ namespace utils{
 
         while (std::getline(ss, dirName, '/')){
             currentPath += dirName;
-            if (!dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
+            if (!dirName.empty() && !dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
                 return -1;
             }
             currentPath += "/";